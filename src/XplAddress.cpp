@@ -0,0 +1,191 @@
+/***************************************************************************
+****																	****
+****	XplAddress.cpp													****
+****																	****
+****	Fixed size xPL address											****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include <ctype.h>
+#include "XplCore.h"
+#include "XplAddress.h"
+#include "XplStringUtils.h"
+
+using namespace xpl;
+
+
+/***************************************************************************
+****																	****
+****	XplAddress::Parse												****
+****																	****
+***************************************************************************/
+
+bool XplAddress::Parse
+(
+    XplStringView const& _str
+)
+{
+    XplStringView vendor;
+    XplStringView deviceInstance;
+    StringSplit ( _str, '-', &vendor, &deviceInstance );
+
+    XplStringView device;
+    XplStringView instance;
+    StringSplit ( deviceInstance, '.', &device, &instance );
+
+    // Set checks the lengths
+    if ( !Set ( vendor, device, instance ) )
+    {
+        return false;
+    }
+
+    char* pText = reinterpret_cast<char*> ( m_words );
+    for ( uint32 i=c_deviceOffset; i<sizeof ( m_words ); ++i )
+    {
+        pText[i] = ( char ) tolower ( ( unsigned char ) pText[i] );
+    }
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplAddress::Set													****
+****																	****
+***************************************************************************/
+
+bool XplAddress::Set
+(
+    XplStringView const& _vendor,
+    XplStringView const& _device,
+    XplStringView const& _instance
+)
+{
+    if ( _vendor.empty() || ( _vendor.size() > c_maxVendor )
+            || _device.empty() || ( _device.size() > c_maxDevice )
+            || _instance.empty() || ( _instance.size() > c_maxInstance ) )
+    {
+        return false;
+    }
+
+    memset ( m_words, 0, sizeof ( m_words ) );
+    char* pText = reinterpret_cast<char*> ( m_words );
+    memcpy ( pText + c_vendorOffset, _vendor.data(), _vendor.size() );
+    memcpy ( pText + c_deviceOffset, _device.data(), _device.size() );
+    memcpy ( pText + c_instanceOffset, _instance.data(), _instance.size() );
+    m_vendorLen = ( uint8 ) _vendor.size();
+    m_deviceLen = ( uint8 ) _device.size();
+    m_instanceLen = ( uint8 ) _instance.size();
+
+    XplStringView const any ( "*" );
+    m_flags = 0;
+    if ( _vendor == any )
+    {
+        m_flags |= c_vendorWildcard;
+    }
+    if ( _device == any )
+    {
+        m_flags |= c_deviceWildcard;
+    }
+    if ( _instance == any )
+    {
+        m_flags |= c_instanceWildcard;
+    }
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplAddress::IsGroup												****
+****																	****
+***************************************************************************/
+
+static XplAddress MakeGroupPattern()
+{
+    XplAddress address;
+    address.Set ( "xpl", "group", "*" );
+    return address;
+}
+
+bool XplAddress::IsGroup() const
+{
+    // Made on first use, so that it can be used while other
+    // statics are being initialised.
+    static XplAddress const s_group = MakeGroupPattern();
+    return ( !IsBroadcast() && s_group.Matches ( *this ) );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplAddress::ToString											****
+****																	****
+***************************************************************************/
+
+string XplAddress::ToString() const
+{
+    if ( IsBroadcast() )
+    {
+        return "*";
+    }
+
+    string str;
+    str.reserve ( GetTextSize() );
+    str.append ( GetText() + c_vendorOffset, m_vendorLen );
+    str += '-';
+    str.append ( GetText() + c_deviceOffset, m_deviceLen );
+    str += '.';
+    str.append ( GetText() + c_instanceOffset, m_instanceLen );
+    return str;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplAddress::GetHash												****
+****																	****
+****	Mixes the four words of text, so every character counts.		****
+****																	****
+***************************************************************************/
+
+uint32 XplAddress::GetHash() const
+{
+    if ( IsBroadcast() )
+    {
+        return 0;
+    }
+
+    uint64_t hash = 0;
+    for ( uint32 i=0; i<4; ++i )
+    {
+        hash = ( hash ^ m_words[i] ) * 0x9e3779b97f4a7c15ull;
+        hash ^= ( hash >> 32 );
+    }
+    return ( uint32 ) hash;
+}
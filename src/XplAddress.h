@@ -0,0 +1,213 @@
+/***************************************************************************
+****																	****
+****	XplAddress.h													****
+****																	****
+****	Fixed size xPL address											****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplAddress_H
+#define _XplAddress_H
+
+#include <string.h>
+#include <string>
+#include "XplCore.h"
+#include "XplStringView.h"
+
+namespace xpl
+{
+
+/**
+ * An xPL address of the form vendor-device.instance, or the broadcast
+ * address "*".
+ * xPL limits the vendor and device IDs to 8 characters and the instance ID
+ * to 16, so the three parts are held in a fixed 32 byte block with a length
+ * byte each, rather than in strings.  Unused bytes are always zero, so two
+ * addresses can be compared a whole 64 bit word at a time, and copying one
+ * never allocates.
+ * <p>
+ * Any part may be "*".  Such parts are recorded in a mask when the address
+ * is set, so that Matches can skip them without looking at the text.
+ */
+class XplAddress
+{
+public:
+    static uint32 const c_maxVendor = 8;
+    static uint32 const c_maxDevice = 8;
+    static uint32 const c_maxInstance = 16;
+
+    /**
+     * Constructor.  The address starts out as "*-*.*".
+     */
+    XplAddress()
+    {
+        Set ( XplStringView ( "*" ), XplStringView ( "*" ), XplStringView ( "*" ) );
+    }
+
+    /**
+     * Reads an address of the form vendor-device.instance.  The device
+     * and instance IDs are converted to lower case.
+     * @param _str the address text.  "*" is not accepted here; use
+     * SetBroadcast for that.
+     * @return True if the address was valid.  If not, the address is
+     * left unchanged.
+     */
+    bool Parse ( XplStringView const& _str );
+
+    /**
+     * Sets the three parts of the address, exactly as given.
+     * @return False if any part is empty or too long, in which case the
+     * address is left unchanged.
+     */
+    bool Set ( XplStringView const& _vendor, XplStringView const& _device, XplStringView const& _instance );
+
+    /**
+     * Makes this the broadcast address, "*".
+     */
+    void SetBroadcast()
+    {
+        m_flags |= c_broadcast;
+    }
+
+    bool IsBroadcast() const
+    {
+        return ( 0 != ( m_flags & c_broadcast ) );
+    }
+
+    XplStringView GetVendor() const
+    {
+        return XplStringView ( GetText() + c_vendorOffset, m_vendorLen );
+    }
+
+    XplStringView GetDevice() const
+    {
+        return XplStringView ( GetText() + c_deviceOffset, m_deviceLen );
+    }
+
+    XplStringView GetInstance() const
+    {
+        return XplStringView ( GetText() + c_instanceOffset, m_instanceLen );
+    }
+
+    /**
+     * Tests whether this is a group address, "xpl-group.name".
+     * The group name is the instance.
+     */
+    bool IsGroup() const;
+
+    /**
+     * Gets the number of characters in the text form of the address.
+     */
+    uint32 GetTextSize() const
+    {
+        return IsBroadcast() ? 1 : ( uint32 ) ( m_vendorLen + m_deviceLen + m_instanceLen + 2 );
+    }
+
+    /**
+     * Gets the address as vendor-device.instance, or "*".
+     */
+    string ToString() const;
+
+    /**
+     * Tests whether another address matches this one.  Parts of this
+     * address that are "*" match anything.  A broadcast address matches
+     * every address.
+     * @param _other the address to test.
+     */
+    bool Matches ( XplAddress const& _other ) const
+    {
+        if ( IsBroadcast() )
+        {
+            return true;
+        }
+
+        uint64_t const vendorMask = ( m_flags & c_vendorWildcard ) ? 0 : ~( uint64_t ) 0;
+        uint64_t const deviceMask = ( m_flags & c_deviceWildcard ) ? 0 : ~( uint64_t ) 0;
+        uint64_t const instanceMask = ( m_flags & c_instanceWildcard ) ? 0 : ~( uint64_t ) 0;
+        return ( 0 == ( ( ( m_words[0] ^ _other.m_words[0] ) & vendorMask )
+                        | ( ( m_words[1] ^ _other.m_words[1] ) & deviceMask )
+                        | ( ( ( m_words[2] ^ _other.m_words[2] ) | ( m_words[3] ^ _other.m_words[3] ) ) & instanceMask ) ) );
+    }
+
+    bool operator== ( XplAddress const& _other ) const
+    {
+        if ( IsBroadcast() || _other.IsBroadcast() )
+        {
+            return ( IsBroadcast() == _other.IsBroadcast() );
+        }
+        return ( 0 == ( ( m_words[0] ^ _other.m_words[0] ) | ( m_words[1] ^ _other.m_words[1] )
+                        | ( m_words[2] ^ _other.m_words[2] ) | ( m_words[3] ^ _other.m_words[3] ) ) );
+    }
+
+    bool operator!= ( XplAddress const& _other ) const
+    {
+        return !( *this == _other );
+    }
+
+    /**
+     * Gets a hash of the address, for use as a key.  Addresses that
+     * are equal have the same hash.
+     */
+    uint32 GetHash() const;
+
+private:
+    enum
+    {
+        c_vendorOffset = 0,
+        c_deviceOffset = 8,
+        c_instanceOffset = 16
+    };
+
+    enum
+    {
+        c_vendorWildcard	= 0x01,
+        c_deviceWildcard	= 0x02,
+        c_instanceWildcard	= 0x04,
+        c_broadcast			= 0x08
+    };
+
+    // The text lives in m_words, and is only ever accessed through a
+    // char pointer, which is allowed to alias anything.
+    char const* GetText() const
+    {
+        return reinterpret_cast<char const*> ( m_words );
+    }
+
+    uint64_t	m_words[4];		// vendor, device, and two words of instance, zero padded
+    uint8		m_vendorLen;
+    uint8		m_deviceLen;
+    uint8		m_instanceLen;
+    uint8		m_flags;		// Wildcard and broadcast bits
+
+}; // class XplAddress
+
+} // namespace xpl
+
+#endif // _XplAddress_H
@@ -39,6 +39,51 @@
 
 using namespace xpl;
 
+namespace
+{
+
+// Never destroyed, as notifications may still be
+// released while static objects are being torn down.
+XplBlockPool& GetNotificationPool()
+{
+    static XplBlockPool* s_pPool = new XplBlockPool ( sizeof ( MessageRxNotification ) );
+    return *s_pPool;
+}
+
+} // namespace
+
+
+/***************************************************************************
+****																	****
+****	MessageRxNotification::operator new								****
+****																	****
+***************************************************************************/
+
+void* MessageRxNotification::operator new
+(
+    size_t size
+)
+{
+    return GetNotificationPool().Allocate ( size );
+}
+
+
+/***************************************************************************
+****																	****
+****	MessageRxNotification::operator delete							****
+****																	****
+***************************************************************************/
+
+void MessageRxNotification::operator delete
+(
+    void* p,
+    size_t size
+)
+{
+    GetNotificationPool().Free ( p, size );
+}
+
+
 /***************************************************************************
 ****																	****
 ****	XplComms::Destroy												****
@@ -115,3 +160,32 @@ void XplComms::Disconnect()
 }
 
 
+/***************************************************************************
+****																	****
+****	XplComms::SetPooling											****
+****																	****
+***************************************************************************/
+
+void XplComms::SetPooling
+(
+    uint32 const maxCached
+)
+{
+    XplMsg::SetPooling ( maxCached );
+    GetNotificationPool().SetMaxCached ( maxCached );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplComms::GetPoolStats											****
+****																	****
+***************************************************************************/
+
+XplComms::PoolStats XplComms::GetPoolStats()
+{
+    PoolStats stats;
+    XplMsg::GetPoolStats ( &stats.messages, &stats.storage );
+    stats.notifications = GetNotificationPool().GetStats();
+    return stats;
+}
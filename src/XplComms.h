@@ -45,6 +45,8 @@
 #include <Poco/NotificationCenter.h>
 #include "XplCore.h"
 #include "XplMsg.h"
+#include "XplNotificationDispatcher.h"
+#include "XplPrefilter.h"
 
 using namespace Poco;
 
@@ -61,6 +63,10 @@ public:
         message = msgIn;
     }
     AutoPtr<XplMsg> message;
+
+    // Allocation goes through a pool when XplComms::SetPooling is used
+    static void* operator new ( size_t size );
+    static void operator delete ( void* p, size_t size );
 };
 
 /**
@@ -108,7 +114,54 @@ public:
      */
     virtual void SendConfigHeartbeat ( string const& source, uint32 const interval, string const& version ) = 0;
 
-    NotificationCenter rxNotificationCenter; // used to notify devices about incomming messages
+    XplNotificationDispatcher rxNotificationCenter; // used to notify devices about incomming messages
+
+    /**
+     * Rejects received messages that no device would accept, before they
+     * are parsed.  Off by default.  XplDevice keeps its rules up to date.
+     * @see XplPrefilter
+     */
+    XplPrefilter rxPrefilter;
+
+    /**
+     * Called by XplDevice each time it changes its rxPrefilter rules, so
+     * that anything derived from them can be brought up to date.
+     */
+    virtual void OnPrefilterChanged() {}
+
+    /**
+     * Called by XplDevice when a device is destroyed or changes its name,
+     * so that anything kept for the old source name can be freed.
+     * @param source the full vendor-device.instance name that is no
+     * longer in use.
+     */
+    virtual void OnSourceRemoved ( string const& /*source*/ ) {}
+
+    /**
+     * Turns pooling of received messages on or off.
+     * Received messages, their buffers and the notifications that carry
+     * them are recycled instead of being freed.  Pooling is off by default.
+     * @param maxCached the most objects of each kind to keep for reuse.
+     * Zero turns pooling off.
+     * @see GetPoolStats, XplMsg::SetPooling
+     */
+    static void SetPooling ( uint32 const maxCached );
+
+    /**
+     * Counters for the pools used when receiving messages.
+     */
+    struct PoolStats
+    {
+        XplPoolStats	messages;
+        XplPoolStats	storage;
+        XplPoolStats	notifications;
+    };
+
+    /**
+     * Gets the counters for the receive pools.
+     * @see SetPooling
+     */
+    static PoolStats GetPoolStats();
 
 protected:
     /**
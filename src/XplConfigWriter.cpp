@@ -0,0 +1,350 @@
+/***************************************************************************
+****																	****
+****	XplConfigWriter.cpp												****
+****																	****
+****	Background writer for device config files						****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include <fstream>
+#include "XplCore.h"
+#include "XplConfigWriter.h"
+#include "Poco/File.h"
+#include "Poco/Logger.h"
+#include "Poco/Timestamp.h"
+#include "Poco/Exception.h"
+
+using namespace xpl;
+using Poco::FastMutex;
+using Poco::Logger;
+
+
+/***************************************************************************
+****																	****
+****	XplConfigWriter Constructor										****
+****																	****
+***************************************************************************/
+
+XplConfigWriter::XplConfigWriter
+(
+    uint32 const _delay
+) :
+    m_numWriting ( 0 ),
+    m_delay ( ( int64_t ) _delay * 1000 ),
+    m_bFlushing ( false ),
+    m_bStarted ( false ),
+    m_bStopping ( false )
+{
+    m_stats.m_numRequests = 0;
+    m_stats.m_numWritten = 0;
+    m_stats.m_numFailed = 0;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplConfigWriter Destructor										****
+****																	****
+***************************************************************************/
+
+XplConfigWriter::~XplConfigWriter()
+{
+    bool bStarted;
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        m_bStopping = true;
+        bStarted = m_bStarted;
+    }
+
+    // The thread writes whatever is left before it stops
+    if ( bStarted )
+    {
+        m_wake.set();
+        m_thread.join();
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplConfigWriter::Get											****
+****																	****
+***************************************************************************/
+
+XplConfigWriter& XplConfigWriter::Get()
+{
+    static XplConfigWriter s_writer;
+    return s_writer;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplConfigWriter::SetDelay										****
+****																	****
+***************************************************************************/
+
+void XplConfigWriter::SetDelay
+(
+    uint32 const _delay
+)
+{
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        m_delay = ( int64_t ) _delay * 1000;
+    }
+
+    // Files already waiting keep their old times, but the thread may
+    // be asleep until a later one
+    m_wake.set();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplConfigWriter::Write											****
+****																	****
+***************************************************************************/
+
+void XplConfigWriter::Write
+(
+    string const& _path,
+    string const& _contents
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    ++m_stats.m_numRequests;
+
+    map<string,Pending>::iterator iter = m_pending.find ( _path );
+    if ( iter != m_pending.end() )
+    {
+        // Not written yet.  Keep the time it was first asked for, so that
+        // a file that keeps changing is still saved.
+        iter->second.m_contents = _contents;
+        return;
+    }
+
+    bool const bWasEmpty = m_pending.empty();
+    Pending& pending = m_pending[_path];
+    pending.m_contents = _contents;
+    pending.m_due = Poco::Timestamp().epochMicroseconds() + m_delay;
+
+    if ( !m_bStarted )
+    {
+        m_thread.setName ( "config writer" );
+        m_thread.start ( *this );
+        m_bStarted = true;
+    }
+
+    // Anything else waiting is due no later than this, so the thread
+    // only needs waking if it had nothing to wait for
+    if ( bWasEmpty )
+    {
+        m_wake.set();
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplConfigWriter::Flush											****
+****																	****
+***************************************************************************/
+
+void XplConfigWriter::Flush()
+{
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        if ( m_pending.empty() && ( 0 == m_numWriting ) )
+        {
+            return;
+        }
+        m_bFlushing = true;
+    }
+    m_wake.set();
+
+    while ( 1 )
+    {
+        // Only done on shutdown, so not worth a condition variable
+        Poco::Thread::sleep ( 1 );
+
+        FastMutex::ScopedLock lock ( m_lock );
+        if ( m_pending.empty() && ( 0 == m_numWriting ) )
+        {
+            return;
+        }
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplConfigWriter::GetStats										****
+****																	****
+***************************************************************************/
+
+XplConfigWriter::Stats XplConfigWriter::GetStats() const
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    return m_stats;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplConfigWriter::run											****
+****																	****
+***************************************************************************/
+
+void XplConfigWriter::run()
+{
+    vector<std::pair<string,string> > batch;
+    uint32 numWritten = 0;
+    uint32 numFailed = 0;
+
+    while ( 1 )
+    {
+        long wait = -1;
+        {
+            FastMutex::ScopedLock lock ( m_lock );
+            m_stats.m_numWritten += numWritten;
+            m_stats.m_numFailed += numFailed;
+            m_numWriting = 0;
+            numWritten = 0;
+            numFailed = 0;
+
+            // Take every file that is due, and work out when the next
+            // of the rest will be
+            bool const bAll = m_bFlushing || m_bStopping;
+            int64_t const now = Poco::Timestamp().epochMicroseconds();
+            int64_t next = 0;
+            map<string,Pending>::iterator iter = m_pending.begin();
+            while ( iter != m_pending.end() )
+            {
+                if ( bAll || ( iter->second.m_due <= now ) )
+                {
+                    batch.push_back ( std::make_pair ( iter->first, string() ) );
+                    batch.back().second.swap ( iter->second.m_contents );
+                    m_pending.erase ( iter++ );
+                }
+                else
+                {
+                    if ( ( 0 == next ) || ( iter->second.m_due < next ) )
+                    {
+                        next = iter->second.m_due;
+                    }
+                    ++iter;
+                }
+            }
+
+            if ( batch.empty() )
+            {
+                m_bFlushing = false;
+                if ( m_bStopping )
+                {
+                    return;
+                }
+                if ( next )
+                {
+                    wait = ( long ) ( ( next - now + 999 ) / 1000 );
+                }
+            }
+            else
+            {
+                m_numWriting = ( uint32 ) batch.size();
+            }
+        }
+
+        if ( !batch.empty() )
+        {
+            for ( uint32 i=0; i<batch.size(); ++i )
+            {
+                if ( WriteFile ( batch[i].first, batch[i].second ) )
+                {
+                    ++numWritten;
+                }
+                else
+                {
+                    ++numFailed;
+                }
+            }
+            batch.clear();
+            continue;
+        }
+
+        if ( wait < 0 )
+        {
+            m_wake.wait();
+        }
+        else
+        {
+            m_wake.tryWait ( wait ? wait : 1 );
+        }
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplConfigWriter::WriteFile										****
+****																	****
+***************************************************************************/
+
+bool XplConfigWriter::WriteFile
+(
+    string const& _path,
+    string const& _contents
+)
+{
+    string const tempPath = _path + ".tmp";
+    try
+    {
+        std::ofstream out ( tempPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+        out.write ( _contents.data(), _contents.size() );
+        out.close();
+        if ( out.fail() )
+        {
+            poco_warning ( Logger::get ( "xplsdk.config" ), "failed to write " + tempPath );
+            Poco::File tempFile ( tempPath );
+            if ( tempFile.exists() )
+            {
+                tempFile.remove();
+            }
+            return false;
+        }
+
+        // Replaces the old file in one step
+        Poco::File ( tempPath ).renameTo ( _path );
+        return true;
+    }
+    catch ( Poco::Exception& e )
+    {
+        poco_warning ( Logger::get ( "xplsdk.config" ), "failed to save " + _path + ": " + e.displayText() );
+    }
+    return false;
+}
@@ -0,0 +1,161 @@
+/***************************************************************************
+****																	****
+****	XplConfigWriter.h												****
+****																	****
+****	Background writer for device config files						****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplConfigWriter_H
+#define _XplConfigWriter_H
+
+#include <map>
+#include <string>
+#include "XplCore.h"
+#include "Poco/Mutex.h"
+#include "Poco/Event.h"
+#include "Poco/Thread.h"
+#include "Poco/Runnable.h"
+
+namespace xpl
+{
+
+/**
+ * Writes config files on a thread of its own, so that saving a device's
+ * config never holds up the thread that receives messages.
+ * Write() only takes a copy of the new contents and returns.  The file is
+ * written a short delay later, and if it is written to again in the
+ * meantime, only the latest contents are saved.  When xPLHal configures
+ * many devices at once, each file is written once, in a single batch.
+ * <p>
+ * Each file is written to a temporary file next to it, which is then
+ * renamed over the old one, so a crash part way through leaves either the
+ * old file or the new one, never a mixture.
+ * <p>
+ * Get() returns a writer shared by the whole process.  The thread is only
+ * started when the first file is written.
+ */
+class XplConfigWriter: private Poco::Runnable
+{
+public:
+    /**
+     * Constructor.
+     * @param _delay milliseconds to wait after a file is first written to
+     * before saving it.
+     */
+    XplConfigWriter ( uint32 const _delay = 500 );
+
+    /**
+     * Destructor.  Saves anything still waiting, then stops the thread.
+     */
+    ~XplConfigWriter();
+
+    /**
+     * Gets the writer shared by the whole process.
+     */
+    static XplConfigWriter& Get();
+
+    /**
+     * Sets how long to wait before saving a file, so that later changes
+     * can be saved along with it.
+     * @param _delay the delay in milliseconds.  Zero saves files as soon
+     * as the thread gets to them.
+     */
+    void SetDelay ( uint32 const _delay );
+
+    /**
+     * Queues a file to be written.  Replaces any contents already waiting
+     * to be written to the same file.
+     * @param _path full path of the file.  Its directory must exist.
+     * @param _contents everything that should be in the file.
+     */
+    void Write ( string const& _path, string const& _contents );
+
+    /**
+     * Saves everything that is waiting, without the delay, and returns
+     * once it has all been written.
+     */
+    void Flush();
+
+    /**
+     * Counters for the writes.
+     */
+    struct Stats
+    {
+        uint32	m_numRequests;		// Calls to Write
+        uint32	m_numWritten;		// Files written
+        uint32	m_numFailed;		// Files that could not be written
+    };
+
+    /**
+     * Gets the counters.  Requests that were replaced by later ones before
+     * being written account for the difference between m_numRequests and
+     * m_numWritten plus m_numFailed.
+     */
+    Stats GetStats() const;
+
+private:
+    // Not copyable
+    XplConfigWriter ( XplConfigWriter const& );
+    XplConfigWriter& operator = ( XplConfigWriter const& );
+
+    struct Pending
+    {
+        string		m_contents;
+        int64_t		m_due;			// When to write it, in epoch microseconds
+    };
+
+    /**
+     * Writes files as they fall due, until the writer is destroyed.
+     */
+    virtual void run();
+
+    /**
+     * Writes a file by way of a temporary file.
+     * @return true if the file was written.
+     */
+    static bool WriteFile ( string const& _path, string const& _contents );
+
+    map<string,Pending>			m_pending;		// Files waiting to be written, by path
+    uint32						m_numWriting;	// Files taken from m_pending and not yet written
+    int64_t						m_delay;		// Microseconds to wait before writing
+    bool						m_bFlushing;	// Write everything without waiting for it to fall due
+    bool						m_bStarted;
+    bool						m_bStopping;
+    Stats						m_stats;
+    Poco::Thread				m_thread;
+    Poco::Event					m_wake;			// Set when there is something new to write
+    mutable Poco::FastMutex		m_lock;
+
+}; // class XplConfigWriter
+
+} // namespace xpl
+
+#endif // _XplConfigWriter_H
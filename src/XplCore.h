@@ -85,39 +85,6 @@ using namespace std;
 }
 using namespace std;
 
-class XPLAddress
-{
-public:
-    bool bcast;
-    string vendor, device, instance;
-    XPLAddress()
-    {
-        vendor="*";
-        device="*";
-        instance="*";
-        bcast = false;
-    }
-    string toString() const
-    {
-        if ( bcast )
-        {
-            return "*";
-        }
-        return vendor + "-" + device + "." + instance;
-    }
-    /**
-     * @brief Tests to see if the other address matches against our own (which may have *'s)
-     *
-     * @param other to test against
-     **/
-    bool match(XPLAddress other){
-        return (bcast  || (
-        (vendor=="*" || vendor.compare ( other.vendor ) == 0) 
-        && (device=="*" || device.compare ( other.device ) == 0)
-        && (instance=="*" || instance.compare ( other.instance ) == 0)));
-    }
-};
-
 class XPLSchema
 {
 public:
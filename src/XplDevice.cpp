@@ -40,9 +40,11 @@
 #include "XplMsg.h"
 #include "xplFilter.h"
 #include "XplConfigItem.h"
+#include "XplConfigWriter.h"
 #include <../../src/heeks/skeleton/prim.h>
 
 #include <strings.h>
+#include <sstream>
 #include <Poco/String.h>
 #include <Poco/Util/PropertyFileConfiguration.h>
 #include <Poco/Path.h>
@@ -54,7 +56,6 @@ using Poco::Util::PropertyFileConfiguration;
 using Poco::Util::AbstractConfiguration;
 using Poco::toLower;
 
-string const XplDevice::c_xplGroup = "xpl-group";
 
 uint32 const XplDevice::c_rapidHeartbeatFastInterval = 3;	// Three seconds for the first
 uint32 const XplDevice::c_rapidHeartbeatTimeout = 120;		// two minutes, after which the rate drops to
@@ -77,16 +78,17 @@ XplDevice::XplDevice
     XplComms* _pComms
 ) :
     m_version ( _version ),
-    m_bFilterMsgs ( _bFilterMsgs ),
-    m_pComms ( _pComms ),
-    m_bConfigRequired ( true ),
-    m_bInitialised ( false ),
-    m_heartbeatInterval ( 5 ),
     m_nextHeartbeat ( 0 ),
-    m_bExitThread ( false ),
-
-    m_bWaitingForHub ( true ),
+    m_heartbeatPeriod ( 0 ),
+    m_heartbeatCount ( 0 ),
+    m_heartbeatInterval ( 5 ),
     m_rapidHeartbeatCounter ( c_rapidHeartbeatTimeout/c_rapidHeartbeatFastInterval ),
+    m_bWaitingForHub ( true ),
+    m_pScheduler ( &XplScheduler::Get() ),
+    m_bConfigRequired ( true ),
+    m_bFilterMsgs ( _bFilterMsgs ),
+    m_bInitialised ( false ),
+    m_pComms ( _pComms ),
     devLog ( Logger::get ( "xplsdk.device" ) )
 
 {
@@ -99,9 +101,6 @@ XplDevice::XplDevice
     m_instanceId = "default";
     
     SetCompleteId();
-
-    m_hRxInterrupt = new Poco::Event ( false );
-
 }
 
 
@@ -114,32 +113,41 @@ XplDevice::XplDevice
 XplDevice::~XplDevice ( void )
 {
      cout << "destroying XplDevice\n";
-    if ( m_bInitialised )
+    bool bInitialised;
     {
-        m_bExitThread = true;
-        //cout << "trying to trigger exit of hbeat thread with m_hRxInterrupt: " << m_hRxInterrupt << "\n";
-        m_hRxInterrupt->set();
+        // SetNextHeartbeatTime checks this under the same lock, so once
+        // it is clear a received message cannot put the device back on
+        // the scheduler.
+        Poco::FastMutex::ScopedLock lock ( m_heartbeatLock );
+        bInitialised = m_bInitialised;
+        m_bInitialised = false;
+    }
 
-        // Wait for the thread to exit
-        m_hThread.join();
-        //cout << "joined with hbeat thread\n";
+    if ( bInitialised )
+    {
+        // Stop receiving messages.  Disabling the observer waits for
+        // one that is being handled right now.
+        m_pComms->rxNotificationCenter.removeObserver ( Observer<XplDevice, MessageRxNotification> ( *this,&XplDevice::HandleRx ) );
+
+        m_pComms->rxPrefilter.RemoveDevice ( this );
+        m_pComms->OnPrefilterChanged();
 
-        //Delete the filters
-        uint32 i;
-        for ( i=0; i<m_filters.size(); ++i )
+        // Waits for a heartbeat that is being sent right now
+        m_pScheduler->Cancel ( this );
         {
-            delete m_filters[i];
+            Poco::FastMutex::ScopedLock lock ( m_heartbeatLock );
+            m_pComms->OnSourceRemoved ( m_completeId );
         }
-
-        m_bInitialised = false;
     }
 
+    // Make sure the last config change is on disk
+    XplConfigWriter::Get().Flush();
+
     //Delete the config items
 //     for ( int i=0; i<m_configItems.size(); ++i )
 //     {
 //         delete m_configItems[i];
 //     }
-    delete m_hRxInterrupt ;
 }
 
 
@@ -161,11 +169,23 @@ bool XplDevice::Init()
     m_bConfigRequired = true;
     LoadConfig();
 
+    // The groups are normally indexed by Configure, but that is
+    // not called if the device has never been configured.
+    if ( m_pGroups.isNull() )
+    {
+        UpdateGroups();
+    }
+
     m_bInitialised = true;
-    m_bExitThread = false;
+    UpdatePrefilter();
 
-    // Create the thread that will handle heartbeats
-    m_hThread.start ( *this );
+    // Send the first heartbeat within the first rapid interval
+    {
+        Poco::FastMutex::ScopedLock lock ( m_heartbeatLock );
+        m_heartbeatPeriod = ( int64_t ) c_rapidHeartbeatFastInterval * 1000000l;
+        m_nextHeartbeat = Poco::Timestamp().epochMicroseconds() + m_pScheduler->GetPhase ( m_address.GetHash(), m_heartbeatPeriod );
+        m_pScheduler->Schedule ( this, m_nextHeartbeat );
+    }
 
     //register to get all the rxed messages from the comms
     m_pComms->rxNotificationCenter.addObserver ( Observer<XplDevice, MessageRxNotification> ( *this,&XplDevice::HandleRx ) );
@@ -174,6 +194,24 @@ bool XplDevice::Init()
 }
 
 
+/***************************************************************************
+****																	****
+****	XplDevice::GetConfigFilePath									****
+****																	****
+***************************************************************************/
+
+string const& XplDevice::GetConfigFilePath()
+{
+    // The file name only changes with the instance ID
+    if ( m_configPathId != m_completeId )
+    {
+        m_configPath = GetConfigFileLocation().toString();
+        m_configPathId = m_completeId;
+    }
+    return m_configPath;
+}
+
+
 Poco::Path XplDevice::GetConfigFileLocation() {
     Poco::Path p ( Poco::Path::home() );
     p.pushDirectory ( ".xPL" );
@@ -209,13 +247,13 @@ void XplDevice::LoadConfig()
 
     poco_trace ( devLog, "loading config for  "  + GetCompleteId() );
     
-    Poco::Path p = GetConfigFileLocation();
+    string const& path = GetConfigFilePath();
 
     PropertyFileConfiguration* cfgp;
     try{
-        cfgp =  new PropertyFileConfiguration(p.toString());
+        cfgp =  new PropertyFileConfiguration(path);
     } catch (Poco::FileException e) {
-        poco_debug ( devLog, "Failed to parse  " + p.toString() );
+        poco_debug ( devLog, "Failed to parse  " + path );
         cfgp = (new PropertyFileConfiguration());
     }
     m_configStore = cfgp;
@@ -290,10 +328,8 @@ void XplDevice::LoadConfig()
 
 void XplDevice::SaveConfig()
 {
-    
-    
-    Poco::Path p = GetConfigFileLocation();
-    poco_debug ( devLog, "saving config for  " + GetCompleteId() + " to " + p.toString());
+    string const& path = GetConfigFilePath();
+    poco_debug ( devLog, "saving config for  " + GetCompleteId() + " to " + path );
 
     m_configStore->setString("vendorId", GetVendorId());
     m_configStore->setString("deviceId", GetDeviceId());
@@ -304,7 +340,6 @@ void XplDevice::SaveConfig()
         m_configStore->setInt("configItems",m_configItems.size());
         for ( vector<AutoPtr<XplConfigItem> >::iterator iter = m_configItems.begin(); iter != m_configItems.end(); ++iter )
         {
-            poco_debug ( devLog, "saving config item  " + (*iter)->GetName());
             m_configStore->setString("configItems." + (*iter)->GetName(), ""  );
             m_configStore->setString("configItems." + (*iter)->GetName() + ".numValues" , NumberFormatter::format((*iter)->GetNumValues())  );
             
@@ -314,10 +349,11 @@ void XplDevice::SaveConfig()
         }
     }
     
-    
-    m_configStore->save(p.toString());
-    poco_debug ( devLog, "saved to " + p.toString());
-    
+    // Only the text is made here.  The file is written later, on the
+    // config writer's thread, so receiving messages is not held up.
+    std::ostringstream contents;
+    m_configStore->save(contents);
+    XplConfigWriter::Get().Write(path, contents.str());
 }
 
 
@@ -345,38 +381,66 @@ void XplDevice::Configure()
     pItem = GetConfigItem ( "interval" );
     if ( pItem )
     {
-        m_heartbeatInterval = atol ( pItem->GetValue().c_str() );
-        if ( m_heartbeatInterval < 5 )
+        uint32 interval = atol ( pItem->GetValue().c_str() );
+        if ( interval < 5 )
         {
-            m_heartbeatInterval = 5;
+            interval = 5;
         }
-        else if ( m_heartbeatInterval > 30 )
+        else if ( interval > 30 )
         {
-            m_heartbeatInterval = 30;
+            interval = 30;
         }
+
+        Poco::FastMutex::ScopedLock lock ( m_heartbeatLock );
+        m_heartbeatInterval = interval;
     }
 
-    // Note: Groups are simple strings, and are
-    // read from the config items as needed
+    // Index the groups, so that group messages need no search
+    UpdateGroups();
 
-    // Remove any old filters
-    uint32 i;
-    for ( i=0; i<m_filters.size(); ++i )
+    // Compile the new filters, and swap them in for the old ones
+    vector<string> filterStrs;
+    pItem = GetConfigItem ( "filter" );
+    if ( pItem )
     {
-        delete m_filters[i];
+        for ( uint32 i=0; i<pItem->GetNumValues(); ++i )
+        {
+            filterStrs.push_back ( pItem->GetValue ( i ) );
+        }
     }
-    m_filters.clear();
 
-    // Create the new filters
-    pItem = GetConfigItem ( "filter" );
-    if ( pItem )
+    AutoPtr<xplFilterSet> pFilterSet = new xplFilterSet ( filterStrs );
+    {
+        Poco::FastMutex::ScopedLock lock ( m_filterLock );
+        m_pFilterSet.swap ( pFilterSet );
+    }
+
+    // The groups and filters may have changed
+    UpdatePrefilter();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplDevice::UpdateGroups											****
+****																	****
+***************************************************************************/
+
+void XplDevice::UpdateGroups()
+{
+    AutoPtr<GroupSet> pGroups = new GroupSet();
+    AutoPtr<XplConfigItem> pItem = GetConfigItem ( "group" );
+    if ( !pItem.isNull() )
     {
-        for ( i=0; i<pItem->GetNumValues(); ++i )
+        for ( uint32 i=0; i<pItem->GetNumValues(); ++i )
         {
-            xplFilter* pFilter = new xplFilter ( pItem->GetValue ( i ) );
-            m_filters.push_back ( pFilter );
+            pGroups->m_names.push_back ( pItem->GetValue ( i ) );
+            pGroups->m_index.Insert ( XplNameIndex::Hash ( pGroups->m_names.back() ), i );
         }
     }
+
+    Poco::FastMutex::ScopedLock lock ( m_filterLock );
+    m_pGroups.swap ( pGroups );
 }
 
 
@@ -401,13 +465,14 @@ bool XplDevice::AddConfigItem
     }
 
     // Make sure the item does not already exist
-    if ( NULL != GetConfigItem ( _pItem->GetName() ) )
+    if ( FindConfigItem ( _pItem->GetName() ) < m_configItems.size() )
     {
         // Item exists
         assert ( 0 );
         return false;
     }
     // Add the item to the list
+    m_configIndex.Insert ( XplNameIndex::Hash ( _pItem->GetName() ), ( uint32 ) m_configItems.size() );
     m_configItems.push_back ( _pItem );
     return true;
 }
@@ -425,17 +490,21 @@ bool XplDevice::RemoveConfigItem
 )
 {
     poco_debug ( devLog, "removing config item for "  + GetCompleteId() + ": " + _name );
-    for ( vector< AutoPtr<XplConfigItem> >::iterator iter = m_configItems.begin(); iter != m_configItems.end(); ++iter )
+    uint32 const index = FindConfigItem ( _name );
+    if ( index == m_configItems.size() )
     {
-        if ( ( *iter )->GetName() == _name )
-        {
-            // Found
-            m_configItems.erase ( iter );
-            return true;
-        }
+        // Item not found
+        return false;
     }
-    // Item not found
-    return false;
+
+    // The items after it move down, so the index is rebuilt
+    m_configItems.erase ( m_configItems.begin() + index );
+    m_configIndex.Clear();
+    for ( uint32 i=0; i<m_configItems.size(); ++i )
+    {
+        m_configIndex.Insert ( XplNameIndex::Hash ( m_configItems[i]->GetName() ), i );
+    }
+    return true;
 }
 
 
@@ -450,13 +519,10 @@ AutoPtr<XplConfigItem> XplDevice::GetConfigItem
     string const& _name
 ) const
 {
-    poco_debug ( devLog, "get config item for "  + GetCompleteId() + ": " + _name );
-    for ( vector< AutoPtr<XplConfigItem> >::const_iterator iter = m_configItems.begin(); iter != m_configItems.end(); ++iter )
+    uint32 const index = FindConfigItem ( _name );
+    if ( index < m_configItems.size() )
     {
-        if ( ( *iter )->GetName() == _name )
-        {
-            return ( *iter );
-        }
+        return m_configItems[index];
     }
 
     // Item not found
@@ -464,6 +530,56 @@ AutoPtr<XplConfigItem> XplDevice::GetConfigItem
 }
 
 
+/***************************************************************************
+****																	****
+****	XplDevice::FindConfigItem										****
+****																	****
+***************************************************************************/
+
+uint32 XplDevice::FindConfigItem
+(
+    string const& _name
+) const
+{
+    uint32 const hash = XplNameIndex::Hash ( _name );
+    uint32 slot = m_configIndex.Begin ( hash );
+    uint32 index;
+    while ( m_configIndex.Next ( hash, &slot, &index ) )
+    {
+        if ( m_configItems[index]->GetName() == _name )
+        {
+            return index;
+        }
+    }
+    return ( uint32 ) m_configItems.size();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplDevice::GroupSet::Contains									****
+****																	****
+***************************************************************************/
+
+bool XplDevice::GroupSet::Contains
+(
+    XplStringView const& _name
+) const
+{
+    uint32 const hash = XplNameIndex::Hash ( _name );
+    uint32 slot = m_index.Begin ( hash );
+    uint32 index;
+    while ( m_index.Next ( hash, &slot, &index ) )
+    {
+        if ( _name == XplStringView ( m_names[index] ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
 // void XplDevice::addRXObserver ( Observer(C& object, Callback method) arg1) {
 //     rxTaskManager.addObserver(arg1);
 // }
@@ -486,14 +602,19 @@ bool XplDevice::IsMsgForThisApp
 )
 {
     // Reject any messages that were originally broadcast by us
-    if ( _pMsg->GetSource().toString() == m_completeId )
+    if ( _pMsg->GetSource() == m_address )
     {
         // If we're waiting for a hub, then receiving a
         // reflected message (which will be our heartbeat)
         // means it is up and running.
-        if ( m_bWaitingForHub )
+        bool bHubFound;
         {
+            Poco::FastMutex::ScopedLock lock ( m_heartbeatLock );
+            bHubFound = m_bWaitingForHub;
             m_bWaitingForHub = false;
+        }
+        if ( bHubFound )
+        {
             SetNextHeartbeatTime();
         }
 
@@ -501,43 +622,28 @@ bool XplDevice::IsMsgForThisApp
     }
 
     // Check the target.
-    string const& target = _pMsg->GetTarget().toString();
+    XplAddress const& target = _pMsg->GetTarget();
 
     // Is the message for all devices
-    if ( target != string ( "*" ) )
+    if ( !target.IsBroadcast() )
     {
-//         poco_debug ( devLog, "target compare " + target + " " + m_completeId );
         // Is the message for this device
-        if ( target != m_completeId )
+        if ( target != m_address )
         {
             // Is the message for a group?
-            string targetVendorDevice;
-            string group;
-            StringSplit ( target, '.', &targetVendorDevice, &group );
-            if ( targetVendorDevice != c_xplGroup )
+            if ( !target.IsGroup() )
             {
                 // Target is not a group either, so stop now
                 return false;
             }
 
             // Target is a group - but does this device belong to it?
-            XplConfigItem const* pItem = GetConfigItem ( "group" );
-            if ( NULL == pItem )
+            AutoPtr<GroupSet> pGroups;
             {
-                // No groups item
-                return false;
+                Poco::FastMutex::ScopedLock lock ( m_filterLock );
+                pGroups = m_pGroups;
             }
-
-            uint32 i;
-            for ( i=0; i<pItem->GetNumValues(); ++i )
-            {
-                if ( group == pItem->GetValue ( i ) )
-                {
-                    break;
-                }
-            }
-
-            if ( i == pItem->GetNumValues() )
+            if ( pGroups.isNull() || !pGroups->Contains ( target.GetInstance() ) )
             {
                 // Target did not match any of the groups
                 return false;
@@ -545,18 +651,14 @@ bool XplDevice::IsMsgForThisApp
         }
     }
 
-    // Apply the filters
-    uint32 i;
-    for ( i=0; i<m_filters.size(); ++i )
+    // Apply the filters.  If there are filters, and none of them
+    // passes the message, stop here.
+    AutoPtr<xplFilterSet> pFilterSet;
     {
-        if ( m_filters[i]->Allow ( *_pMsg ) )
-        {
-            break;
-        }
+        Poco::FastMutex::ScopedLock lock ( m_filterLock );
+        pFilterSet = m_pFilterSet;
     }
-
-    // If there are filters, and we haven't found one that passes the message, stop here.
-    if ( i && ( i==m_filters.size() ) )
+    if ( !pFilterSet.isNull() && !pFilterSet->Allow ( *_pMsg ) )
     {
         return false;
     }
@@ -574,6 +676,10 @@ bool XplDevice::IsMsgForThisApp
 
 void XplDevice::SetNextHeartbeatTime()
 {
+    // Called from the scheduler's threads as well as the thread
+    // that handles received messages
+    Poco::FastMutex::ScopedLock lock ( m_heartbeatLock );
+
     // Set the new heartbeat time
     int64_t currentTime;
     Poco::Timestamp tst;
@@ -584,6 +690,7 @@ void XplDevice::SetNextHeartbeatTime()
     // If we're waiting for a hub, we have to send at more
     // rapid intervals - every 3 seconds for the first two
     // minutes, then once every 30 seconds after that.
+    int64_t period;
     if ( m_bWaitingForHub )
     {
         if ( m_rapidHeartbeatCounter )
@@ -591,31 +698,45 @@ void XplDevice::SetNextHeartbeatTime()
             // This counter starts at 40 for 2 minutes of
             // heartbeats at 3 second intervals.
             --m_rapidHeartbeatCounter;
-
-
-            m_nextHeartbeat = currentTime + ( ( int64_t ) c_rapidHeartbeatFastInterval * 1000l );
+            period = ( int64_t ) c_rapidHeartbeatFastInterval * 1000000l;
         }
         else
         {
-            // one second
-            m_nextHeartbeat = currentTime + ( ( int64_t ) c_rapidHeartbeatSlowInterval * 1000l );
+            period = ( int64_t ) c_rapidHeartbeatSlowInterval * 1000000l;
         }
     }
     else
     {
-        // It is time to send a heartbeat
         if ( m_bConfigRequired )
         {
             // one minute
-            m_nextHeartbeat = currentTime + 60*1000l;
+            period = 60*1000000l;
         }
         else
         {
-            // 60000000 is one minute in the 100 nanosecond intervals
-            // that the system time is measured in.
-            m_nextHeartbeat = currentTime + ( ( int64_t ) m_heartbeatInterval * 60*1000l );
+            period = ( int64_t ) m_heartbeatInterval * 60*1000000l;
         }
     }
+
+    // When the period changes, devices that made the change together
+    // (at start-up, or when the hub appears) are spread across the new
+    // period.  After that, each heartbeat is nudged a little either way
+    // so that they do not fall back into step.
+    uint32 const key = m_address.GetHash();
+    if ( period != m_heartbeatPeriod )
+    {
+        m_heartbeatPeriod = period;
+        m_nextHeartbeat = currentTime + m_pScheduler->GetPhase ( key, period );
+    }
+    else
+    {
+        m_nextHeartbeat = currentTime + period + m_pScheduler->GetJitter ( key, ++m_heartbeatCount, period );
+    }
+
+    if ( m_bInitialised )
+    {
+        m_pScheduler->Schedule ( this, m_nextHeartbeat );
+    }
 }
 
 
@@ -632,10 +753,10 @@ bool XplDevice::HandleMsgForUs
 {
     if ( _pMsg->GetType() == XplMsg::c_xplCmnd )
     {
-        if ( "config" == _pMsg->GetSchemaClass() )
+        if ( _pMsg->GetSchemaClass() == "config" )
         {
             poco_debug ( devLog, "config message");
-            if ( "current" == _pMsg->GetSchemaType() )
+            if ( _pMsg->GetSchemaType() == "current" )
             {
                 // Config values request
                 if ( "request" == toLower ( _pMsg->GetValue ( "command" ) ) )
@@ -644,7 +765,7 @@ bool XplDevice::HandleMsgForUs
                     return true;
                 }
             }
-            else if ( "list" == _pMsg->GetSchemaType() )
+            else if ( _pMsg->GetSchemaType() == "list" )
             {
                 // Config list request
                 if ( string ( "request" ) == toLower ( _pMsg->GetValue ( "command" ) ) )
@@ -653,7 +774,7 @@ bool XplDevice::HandleMsgForUs
                     return true;
                 }
             }
-            else if ( "response" == _pMsg->GetSchemaType() )
+            else if ( _pMsg->GetSchemaType() == "response" )
             {
                 uint32 i;
                 for ( i=0; i<m_configItems.size(); ++i )
@@ -693,26 +814,17 @@ bool XplDevice::HandleMsgForUs
                 cout << "posted reconfig from thread " << Thread::currentTid()  << "\n";
 
                 // Send a heartbeat so everyone gets our latest status
-                m_pComms->SendHeartbeat ( m_completeId, m_heartbeatInterval, m_version );
+                SendHeartbeat();
                 SetNextHeartbeatTime();
                 return true;
             }
         }
-        else if ( "hbeat" == _pMsg->GetSchemaClass() )
+        else if ( _pMsg->GetSchemaClass() == "hbeat" )
         {
-            if ( "request" == _pMsg->GetSchemaType() )
+            if ( _pMsg->GetSchemaType() == "request" )
             {
                 // We've been asked to send a heartbeat
-                if ( m_bConfigRequired )
-                {
-                    // Send a config heartbeat
-                    m_pComms->SendConfigHeartbeat ( m_completeId, m_heartbeatInterval, m_version );
-                }
-                else
-                {
-                    // Send a heartbeat
-                    m_pComms->SendHeartbeat ( m_completeId, m_heartbeatInterval, m_version );
-                }
+                SendHeartbeat();
 
                 // Calculate the time of the next heartbeat
                 SetNextHeartbeatTime();
@@ -905,60 +1017,89 @@ bool XplDevice::SendMsg
 
 void XplDevice::SetCompleteId()
 {
-    m_completeId = toLower ( m_vendorId + string ( "-" ) + m_deviceId + string ( "." ) + m_instanceId );
+    {
+        Poco::FastMutex::ScopedLock lock ( m_heartbeatLock );
+        string const oldId = m_completeId;
+        m_completeId = toLower ( m_vendorId + string ( "-" ) + m_deviceId + string ( "." ) + m_instanceId );
+        m_address = XplAddress();
+        m_address.Parse ( m_completeId );
+
+        // Frees the heartbeat templates kept for the old name
+        if ( m_bInitialised && ( oldId != m_completeId ) )
+        {
+            m_pComms->OnSourceRemoved ( oldId );
+        }
+    }
+    UpdatePrefilter();
 }
 
 
 /***************************************************************************
 ****																	****
-****	XplDevice::Run													****
+****	XplDevice::UpdatePrefilter										****
 ****																	****
 ***************************************************************************/
 
-void XplDevice::run ( void )
+void XplDevice::UpdatePrefilter()
 {
+    // Rules are only registered once the device is running
     if ( !m_bInitialised )
     {
-        assert ( 0 );
         return;
     }
 
-    while ( !m_bExitThread )
+    vector<string> groups;
+    AutoPtr<xplFilterSet> pFilterSet;
     {
-        // Deal with heartbeats
-        int64_t currentTime;
-        Poco::Timestamp tst;
-        tst.update();
-        currentTime = tst.epochMicroseconds();
-        //GetSystemTimeAsFileTime( (FILETIME*)&currentTime );
-        
-        if ( m_nextHeartbeat <= currentTime )
+        Poco::FastMutex::ScopedLock lock ( m_filterLock );
+        pFilterSet = m_pFilterSet;
+        if ( !m_pGroups.isNull() )
         {
-            poco_debug( devLog, "Sending heartbeat" );
-            // It is time to send a heartbeat
-            if ( m_bConfigRequired )
-            {
-                // Send a config heartbeat, then calculate the time of the next one
-                m_pComms->SendConfigHeartbeat ( m_completeId, m_heartbeatInterval, m_version );
-            }
-            else
-            {
-                // Send a heartbeat, then calculate the time of the next one
-                m_pComms->SendHeartbeat ( m_completeId, m_heartbeatInterval, m_version );
-            }
-
-            SetNextHeartbeatTime();
+            groups = m_pGroups->m_names;
         }
-        // Calculate the time (in milliseconds) until the next heartbeat
-        int32 heartbeatTimeout = ( int32 ) ( ( m_nextHeartbeat - currentTime ) ); // Divide by 10000 to convert 100 nanosecond intervals to milliseconds.
-        poco_debug ( devLog, "Sleeping " + NumberFormatter::format ( heartbeatTimeout/1000 ) + " seconds till next hbeat" );
-        m_hRxInterrupt->tryWait ( heartbeatTimeout );
-        //Thread::sleep();
-        poco_debug ( devLog, "Woken up for hbeat or interrupt" );
+    }
+
+    m_pComms->rxPrefilter.SetDeviceRules ( this, m_address, groups, pFilterSet, m_bFilterMsgs );
+    m_pComms->OnPrefilterChanged();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplDevice::OnScheduled											****
+****																	****
+***************************************************************************/
+
+void XplDevice::OnScheduled()
+{
+    poco_debug ( devLog, "Sending heartbeat" );
+
+    // Send a heartbeat, then calculate the time of the next one
+    SendHeartbeat();
+    SetNextHeartbeatTime();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplDevice::SendHeartbeat										****
+****																	****
+***************************************************************************/
 
+void XplDevice::SendHeartbeat()
+{
+    // The lock stops the device being renamed part way through, and
+    // a heartbeat for the old name bringing its template back after
+    // SetCompleteId has removed it.
+    Poco::FastMutex::ScopedLock lock ( m_heartbeatLock );
+    if ( m_bConfigRequired )
+    {
+        m_pComms->SendConfigHeartbeat ( m_completeId, m_heartbeatInterval, m_version );
+    }
+    else
+    {
+        m_pComms->SendHeartbeat ( m_completeId, m_heartbeatInterval, m_version );
     }
-// 	cout << "exiting dev thread (ret)\n";
-    return;
 }
 
 
@@ -975,19 +1116,21 @@ void XplDevice::HandleRx ( MessageRxNotification* mNot )
             // Call our own handler
             HandleMsgForUs ( pMsg );
 
-            //EnterCriticalSection( &m_criticalSection );
-            m_criticalSection.lock();
-            //m_rxBuffer.push_back( pMsg );
-            //pMsg->AddRef();
+            // Pooled observers read the message on other threads, so
+            // it has to be finished with before they are given it.
+            if ( rxNotificationCenter.HasPooledObservers() )
+            {
+                pMsg->ParseBody();
+            }
 
 //             cout << "device: posting message from thread " << Thread::currentTid() << "\n";
 
             //increase the ref count before handing it off
             mNot->duplicate();
-            rxNotificationCenter.postNotification ( mNot );
+            uint32 topics[XplTopic::kNumMsgTopics];
+            uint32 const numTopics = XplTopic::GetMsgTopics ( *pMsg, topics );
+            rxNotificationCenter.postNotification ( mNot, GetSourceKey ( pMsg->GetSource() ), topics, numTopics );
 //             cout << "device: posted message from thread " << Thread::currentTid()  << "\n";
-            //LeaveCriticalSection( &m_criticalSection );
-            m_criticalSection.unlock();
         }
 
 //         pMsg->Release();
@@ -997,21 +1140,18 @@ void XplDevice::HandleRx ( MessageRxNotification* mNot )
 }
 
 
-
 /***************************************************************************
 ****																	****
-****	DeviceThread													****
+****	XplDevice::GetSourceKey											****
 ****																	****
 ***************************************************************************/
 
-bool XplDevice::DeviceThread
+uint32 XplDevice::GetSourceKey
 (
-    void* _lpArg
+    XplAddress const& _source
 )
 {
-    XplDevice* pDevice = ( XplDevice* ) _lpArg;
-    pDevice->run();
-    return ( 0 );
+    return _source.GetHash();
 }
 
 
@@ -54,6 +54,11 @@
 #include <fstream>
 #include "XplCore.h"
 #include "XplComms.h"
+#include "XplNotificationDispatcher.h"
+#include "XplTopic.h"
+#include "XplScheduler.h"
+#include "XplNameIndex.h"
+#include "Poco/RefCountedObject.h"
 #include "Poco/Logger.h"
 #include "Poco/NumberFormatter.h"
 
@@ -66,6 +71,7 @@ namespace xpl
 class XplComms;
 class XplMsg;
 class xplFilter;
+class xplFilterSet;
 class XplConfigItem;
 
 
@@ -113,7 +119,7 @@ class DeviceConfigNotification: public Notification
  * The method XplDevice::IsInConfigMode can be used to determine whether your
  * processing should go ahead.
  */
-class XplDevice : public Runnable
+class XplDevice : public XplScheduler::Task
 {
 public:
 
@@ -154,7 +160,7 @@ public:
      * Initialises the XplDevice.  Loads any existing configuration
      * data from the registry or a file, which will trigger the
      * registered config callback functions if successful.  It then
-     * starts the thread that will handle all xPL Msg traffic.
+     * schedules the device's first heartbeat.
      * <p>
      * All config items and callbacks must be set up before calling
      * this method.
@@ -215,6 +221,19 @@ public:
         return m_bConfigRequired;
     }
 
+    /**
+     * Sets the scheduler that sends this device's heartbeats.
+     * By default every device uses XplScheduler::Get(), so a process with
+     * thousands of devices still has just one heartbeat thread.  Must be
+     * called before Init.
+     * @param _pScheduler the scheduler.  It must outlive the device.
+     */
+    void SetScheduler ( XplScheduler* _pScheduler )
+    {
+        assert ( !m_bInitialised );
+        m_pScheduler = _pScheduler;
+    }
+
     /**
      * Sends an xPL message.
      * This method will fail if the application is in config mode (that
@@ -340,9 +359,43 @@ public:
     //void addDeviceConfigObserver ( Observer< typename tname,  typename notname > arg1 );
 
     //TaskManager configTaskManager;
-    NotificationCenter configNotificationCenter;
+    XplNotificationDispatcher configNotificationCenter;
     //TaskManager rxTaskManager;
-    NotificationCenter rxNotificationCenter;
+
+    /**
+     * Notifies the application of messages for this device.
+     * Observers added as XplNotificationDispatcher::kPooled are called on a
+     * worker thread, so that slow handlers do not hold up the xPL stack.
+     * Messages from the same source are always handled in order.  The
+     * message may be read by other threads at the same time, so pooled
+     * observers must not change it.  If a worker falls more than
+     * SetQueueSize messages behind, the oldest are dropped.
+     */
+    XplNotificationDispatcher rxNotificationCenter;
+
+    /**
+     * Adds an observer for just the messages of one topic.
+     * Only the observers whose topic could match are looked at when a
+     * message arrives, so this scales much better than lots of observers
+     * added to rxNotificationCenter that each check every message.
+     * @param _pTopic the messages to pass to the observer.  The device keeps
+     * a reference to it.
+     * @param _observer the observer.
+     * @param _mode whether to call the observer inline or on a worker thread.
+     * @see Unsubscribe
+     */
+    void Subscribe ( XplTopic* _pTopic, AbstractObserver const& _observer, XplNotificationDispatcher::Mode const _mode = XplNotificationDispatcher::kInline )
+    {
+        rxNotificationCenter.addObserver ( _observer, _pTopic->GetTopic(), _pTopic, _mode );
+    }
+
+    /**
+     * Removes an observer added with Subscribe.
+     */
+    void Unsubscribe ( AbstractObserver const& _observer )
+    {
+        rxNotificationCenter.removeObserver ( _observer );
+    }
 
 
 private:
@@ -353,6 +406,12 @@ private:
      * @return
      **/
     Poco::Path GetConfigFileLocation();
+
+    /**
+     * Gets the path of the device's config file.  It is only looked up,
+     * with GetConfigFileLocation, when the device's name has changed.
+     */
+    string const& GetConfigFilePath();
     
     /**
      * Handles the xPL configuration messages.
@@ -401,8 +460,10 @@ private:
     /**
      * Saves the config items.  Values for the config items are written
      * to the registry or config file.  Where the values are stored
-     * depends on m_bConfigInRegistry, whcih is set during Create
-     * @see LoadConfig, Create
+     * depends on m_bConfigInRegistry, whcih is set during Create.
+     * The file is written in the background by XplConfigWriter, so it may
+     * not be on disk when this returns.
+     * @see LoadConfig, Create, XplConfigWriter
      */
     void SaveConfig() ;
 
@@ -421,6 +482,12 @@ private:
      */
     void SetNextHeartbeatTime();
 
+    /**
+     * Sends a heartbeat, or a config heartbeat if the device
+     * has not been configured yet.
+     */
+    void SendHeartbeat();
+
     /**
      * Builds the complete ID string.
      * The complete ID is the vendor, device and instance IDs combined into the
@@ -430,58 +497,93 @@ private:
      */
     void SetCompleteId();
 
+    /**
+     * Indexes the values of the "group" config item, for IsMsgForThisApp.
+     * @see GroupSet
+     */
+    void UpdateGroups();
+
+    /**
+     * Gives the comms object's prefilter this device's current address,
+     * groups and filters.
+     * @see XplPrefilter
+     */
+    void UpdatePrefilter();
+
     void HandleRx ( MessageRxNotification* );
 
     /**
-     * Thread procedure that handles all the XplDevice message traffic
-     * @param _lpArg thread procedure argument.  Points to the XplDevice object.
-     * @return The exit code of the thread.
+     * Works out the key that keeps the messages from one source in order.
+     * @param _source the source of a message.
+     * @return A hash of the source.
      */
-    static  bool DeviceThread ( void* _lpArg );
+    static uint32 GetSourceKey ( XplAddress const& _source );
 
     /**
-     * Handles all the XplDevice message traffic.
-     * This method is called from DeviceThread and does not
-     * exit until the thread is finished.  It handles heartbeats,
-     * triggers callbacks when messages are received, and sends
-     * messages queued by calls to SendMsg.
-     * @return False if the XplDevice has not been initialised,
-     * otherwise it returns true.
+     * Finds a config item by name.
+     * @return the item's index in m_configItems, or the number of
+     * items if there isn't one with that name.
      */
-    void run();
+    uint32 FindConfigItem ( string const& _name ) const;
+
+    /**
+     * The groups that the device belongs to, from the "group" config item.
+     * Built by Configure, and replaced rather than changed.
+     */
+    struct GroupSet: public Poco::RefCountedObject
+    {
+        vector<string>	m_names;
+        XplNameIndex	m_index;		// Position in m_names of each name
+
+        /**
+         * Checks whether a group is in the set.
+         */
+        bool Contains ( XplStringView const& _name ) const;
+    };
+
+    /**
+     * Sends a heartbeat.  Called on the scheduler's thread when
+     * m_nextHeartbeat is reached.
+     */
+    virtual void OnScheduled();
 
     string					m_vendorId;					// Application vendor name
     string					m_deviceId;					// Application device name
     string					m_instanceId;				// Application instance name
     string					m_completeId;				// Complete ID string of the form "vendor-device.instance"
+    XplAddress				m_address;					// m_completeId as an address, for comparing with messages
     string					m_version;					// Version number of the application.  This should match the version number used in the installer properties.
 
-    int64_t					m_nextHeartbeat;			// Time of next heartbeat message
+    int64_t					m_nextHeartbeat;			// Time of next heartbeat message, in epoch microseconds
+    int64_t					m_heartbeatPeriod;			// Microseconds between the current series of heartbeats
+    uint32					m_heartbeatCount;			// Heartbeats sent, for varying the jitter
     uint32					m_heartbeatInterval;		// Interval in minutes between heartbeats.  Must be between 5 and 9 inclusive.
     uint32					m_rapidHeartbeatCounter;	// Counts down to zero to stop the rapid heatbeats after two minutes.
     bool					m_bWaitingForHub;			// True if we haven't yet detected the presence of the hub
+    Poco::FastMutex			m_heartbeatLock;			// Held while the heartbeat fields above or the device's name are used or changed
 
-    Poco::Thread					m_hThread;					// Handle to the XplDevice thread
-    Poco::Event*          m_hRxInterrupt;       // Event that is signalled to interrupt the device thread waiting for messages.
+    XplScheduler*			m_pScheduler;				// Runs the heartbeats.  Shared with other devices.
     //     Poco::Event*          m_hConfig;       // Event that is signalled when the device is configured
     Poco::Mutex		m_criticalSection;			// Used to serialise access to m_txBuffer.
 
-    bool					m_bExitThread;				// If true, the device thread should exit.
-
     bool					m_bConfigRequired;			// True if configuration via xPLHal is required
     bool					m_bConfigInRegistry;		// Config values to be loaded/saved in the registry
     vector<AutoPtr<XplConfigItem> >	m_configItems;				// List of config items
-    vector<xplFilter*>		m_filters;					// List of message filters
+    XplNameIndex			m_configIndex;				// Position in m_configItems of each item, by name
+    AutoPtr<xplFilterSet>	m_pFilterSet;				// Message filters.  Replaced, never changed.
+    AutoPtr<GroupSet>		m_pGroups;					// Groups the device belongs to.  Replaced, never changed.
+    Poco::FastMutex			m_filterLock;				// Held while m_pFilterSet or m_pGroups is read or replaced
     bool					m_bFilterMsgs;				// If false, all messages received by the app are queued - regardless of the message target or any filters that have been set.
     bool					m_bInitialised;				// True if Init() has been called
     XplComms*				m_pComms;					// Communications object to use for sending/receiving  messages
 
-    static string const		c_xplGroup;						// Constant containing the string for a group message target
     static uint32 const		c_rapidHeartbeatFastInterval;	// Three seconds for the first
     static uint32 const		c_rapidHeartbeatTimeout;		// two minutes, after which the rate drops to
     static uint32 const		c_rapidHeartbeatSlowInterval;	// once every thirty seconds.
 
     AutoPtr<Util::PropertyFileConfiguration> m_configStore; //a place to store our config values;
+    string					m_configPath;				// Path of the config file, from GetConfigFilePath
+    string					m_configPathId;				// The m_completeId that m_configPath was worked out for
     
     Logger& devLog;
 
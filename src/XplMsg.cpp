@@ -33,9 +33,10 @@
 
 #include "XplCore.h"
 #include "XplStringUtils.h"
+#include "XplScanner.h"
+#include "XplNameIndex.h"
 #include "XplMsg.h"
 #include <iostream>
-#include <sstream>
 #include <Poco/Logger.h>
 #include <Poco/String.h>
 
@@ -61,6 +62,16 @@ string const XplMsg::c_xplTargetAll = "*";
 
 XplMsg::XplMsg() :
     m_hop ( 1 ),
+    m_schemaClassId ( XplSymbolTable::c_empty ),
+    m_schemaTypeId ( XplSymbolTable::c_empty ),
+    m_schemaClassLen ( 0 ),
+    m_schemaTypeLen ( 0 ),
+    m_bBodyInRaw ( false ),
+    m_arenaWaste ( 0 ),
+    m_bNamesValid ( true ),
+    m_bBodyParsed ( true ),
+    m_bodyStart ( 0 ),
+    m_pStorage ( NULL ),
     m_refCount ( 1 )
 {
 }
@@ -73,6 +84,16 @@ XplMsg::XplMsg (
     string const& _schemaType
 ) :
     m_hop ( 1 ),
+    m_schemaClassId ( XplSymbolTable::c_empty ),
+    m_schemaTypeId ( XplSymbolTable::c_empty ),
+    m_schemaClassLen ( 0 ),
+    m_schemaTypeLen ( 0 ),
+    m_bBodyInRaw ( false ),
+    m_arenaWaste ( 0 ),
+    m_bNamesValid ( true ),
+    m_bBodyParsed ( true ),
+    m_bodyStart ( 0 ),
+    m_pStorage ( NULL ),
     m_refCount ( 1 )
 {
     SetType ( _type );
@@ -82,9 +103,60 @@ XplMsg::XplMsg (
     SetSchemaType ( _schemaType );
 }
 
-XplMsg::XplMsg ( string str )
+XplMsg::XplMsg ( string const& str, bool const _bParseBody ) :
+    m_hop ( 1 ),
+    m_schemaClassId ( XplSymbolTable::c_empty ),
+    m_schemaTypeId ( XplSymbolTable::c_empty ),
+    m_schemaClassLen ( 0 ),
+    m_schemaTypeLen ( 0 ),
+    m_bBodyInRaw ( false ),
+    m_arenaWaste ( 0 ),
+    m_bNamesValid ( true ),
+    m_bBodyParsed ( true ),
+    m_bodyStart ( 0 ),
+    m_pStorage ( NULL ),
+    m_refCount ( 1 )
+{
+    TakeStorage();
+    m_raw.assign ( str );
+    try
+    {
+        ParseRawData ( _bParseBody );
+    }
+    catch ( ... )
+    {
+        // The destructor will not be called
+        ReturnStorage();
+        throw;
+    }
+}
+
+XplMsg::XplMsg ( char const* _pData, uint32 const _size, bool const _bParseBody ) :
+    m_hop ( 1 ),
+    m_schemaClassId ( XplSymbolTable::c_empty ),
+    m_schemaTypeId ( XplSymbolTable::c_empty ),
+    m_schemaClassLen ( 0 ),
+    m_schemaTypeLen ( 0 ),
+    m_bBodyInRaw ( false ),
+    m_arenaWaste ( 0 ),
+    m_bNamesValid ( true ),
+    m_bBodyParsed ( true ),
+    m_bodyStart ( 0 ),
+    m_pStorage ( NULL ),
+    m_refCount ( 1 )
 {
-    ParseFromString ( str );
+    TakeStorage();
+    m_raw.assign ( _pData, GetTextSize ( _pData, _size ) );
+    try
+    {
+        ParseRawData ( _bParseBody );
+    }
+    catch ( ... )
+    {
+        // The destructor will not be called
+        ReturnStorage();
+        throw;
+    }
 }
 
 
@@ -98,32 +170,213 @@ XplMsg::XplMsg ( string str )
 
 XplMsg::~XplMsg()
 {
-    vector<AutoPtr<XplMsgItem> >::iterator iter = m_msgItems.begin();
-    while ( iter != m_msgItems.end() )
+    ReturnStorage();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::Storage													****
+****																	****
+***************************************************************************/
+
+struct XplMsg::Storage
+{
+    string			m_raw;
+    string			m_arena;
+    vector<Pair>	m_pairs;
+    vector<Name>	m_names;
+    XplLineTable	m_lines;
+    XplNameIndex	m_nameIndex;
+};
+
+
+namespace
+{
+
+// The pools are never destroyed, as messages may still
+// be released while static objects are being torn down.
+XplBlockPool& GetMsgPool()
+{
+    static XplBlockPool* s_pPool = new XplBlockPool ( sizeof ( XplMsg ) );
+    return *s_pPool;
+}
+
+} // namespace
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::GetStoragePool											****
+****																	****
+***************************************************************************/
+
+XplObjectPool<XplMsg::Storage>& XplMsg::GetStoragePool()
+{
+    static XplObjectPool<Storage>* s_pPool = new XplObjectPool<Storage>;
+    return *s_pPool;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::SetPooling												****
+****																	****
+***************************************************************************/
+
+void XplMsg::SetPooling
+(
+    uint32 const _maxCached
+)
+{
+    GetMsgPool().SetMaxCached ( _maxCached );
+    GetStoragePool().SetMaxCached ( _maxCached );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::GetPoolStats											****
+****																	****
+***************************************************************************/
+
+void XplMsg::GetPoolStats
+(
+    XplPoolStats* _pMsgStats,
+    XplPoolStats* _pStorageStats
+)
+{
+    *_pMsgStats = GetMsgPool().GetStats();
+    *_pStorageStats = GetStoragePool().GetStats();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::operator new											****
+****																	****
+***************************************************************************/
+
+void* XplMsg::operator new
+(
+    size_t _size
+)
+{
+    return GetMsgPool().Allocate ( _size );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::operator delete											****
+****																	****
+***************************************************************************/
+
+void XplMsg::operator delete
+(
+    void* _p,
+    size_t _size
+)
+{
+    GetMsgPool().Free ( _p, _size );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::TakeStorage												****
+****																	****
+***************************************************************************/
+
+void XplMsg::TakeStorage()
+{
+    XplObjectPool<Storage>& pool = GetStoragePool();
+    if ( !pool.IsEnabled() )
+    {
+        return;
+    }
+
+    m_pStorage = pool.Take();
+    SwapStorage ( m_pStorage );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::ReturnStorage											****
+****																	****
+***************************************************************************/
+
+void XplMsg::ReturnStorage()
+{
+    if ( NULL == m_pStorage )
     {
-//         delete ( *iter );
-        iter = m_msgItems.erase ( iter );
+        return;
     }
 
+    // Emptying the buffers keeps their capacity
+    m_raw.clear();
+    m_arena.clear();
+    m_pairs.clear();
+    m_names.clear();
+    m_lines.Clear();
+    m_nameIndex.Clear();
+
+    SwapStorage ( m_pStorage );
+    GetStoragePool().Give ( m_pStorage );
+    m_pStorage = NULL;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::SwapStorage												****
+****																	****
+***************************************************************************/
+
+void XplMsg::SwapStorage
+(
+    Storage* _pStorage
+)
+{
+    m_raw.swap ( _pStorage->m_raw );
+    m_arena.swap ( _pStorage->m_arena );
+    m_pairs.swap ( _pStorage->m_pairs );
+    m_names.swap ( _pStorage->m_names );
+    m_lines.Swap ( _pStorage->m_lines );
+    m_nameIndex.Swap ( _pStorage->m_nameIndex );
 }
 
 
 /***************************************************************************
 ****																	****
-****	XplMsg::Create													****
+****	XplMsg::ParseRawData											****
+****																	****
+****	Works directly on m_raw.  Only the header and schema are		****
+****	decoded here.  The body is left until it is first needed.		****
 ****																	****
 ***************************************************************************/
 
-void XplMsg::ParseFromString ( string str )
+void XplMsg::ParseRawData
+(
+    bool const _bParseBody
+)
 {
+    XplStringView const str ( m_raw );
+
     // Read the message type
-    string line;
-    int32 pos = StringReadLine ( str, 0, &line );
-    SetType ( line );
+    XplStringView line;
+    uint32 pos = ReadLine ( str, 0, &line );
+    string const* pType = FindType ( line );
+    if ( NULL == pType )
+    {
+        throw XplMsgParseException("Invalid message type");
+    }
+    m_type = *pType;
 
     // Skip the opening brace
-    pos = StringReadLine ( str, pos, &line );
-    if ( c_xplOpenBrace != line )
+    pos = ReadLine ( str, pos, &line );
+    if ( line != XplStringView ( c_xplOpenBrace ) )
     {
         throw XplMsgParseException("Opening brace not found");
     }
@@ -131,28 +384,52 @@ void XplMsg::ParseFromString ( string str )
     // Read the name-value pairs  from the header
     while ( 1 )
     {
-        string name;
-        string value;
-
-        pos = ReadNameValuePair ( str, pos, &name, &value );
+        pos = ReadLine ( str, pos, &line );
 
-        if ( c_xplCloseBrace == name )
+        if ( line == XplStringView ( c_xplCloseBrace ) )
         {
             // Closing brace found
             break;
         }
 
-        if ( c_xplHop == name )
+        uint32 equals = line.find ( '=' );
+        XplStringView name = line.substr ( 0, equals ).trim();
+        XplStringView value = line.substr ( equals + 1 ).trim();
+        if ( XplStringView::npos == equals )
         {
-            SetHop ( atol ( value.c_str() ) );
+            value = XplStringView();
         }
-        else if ( c_xplSource == name )
+
+        if ( name == XplStringView ( c_xplHop ) )
         {
-            SetSource ( value );
+            uint32 hop = 0;
+            for ( uint32 i=0; ( i<value.size() ) && isdigit ( ( unsigned char ) value[i] ); ++i )
+            {
+                hop = hop*10 + ( value[i] - '0' );
+            }
+            if ( hop > 9 )
+            {
+                throw XplMsgParseException("Invalid hop count");
+            }
+            m_hop = hop;
         }
-        else if ( c_xplTarget == name )
+        else if ( name == XplStringView ( c_xplSource ) )
         {
-            SetTarget ( value );
+            if ( !m_source.Parse ( value ) )
+            {
+                Logger::get ( "xplsdk.comms" ).warning("Invalid xPl source: " + value.toString());
+            }
+        }
+        else if ( name == XplStringView ( c_xplTarget ) )
+        {
+            if ( value == XplStringView ( c_xplTargetAll ) )
+            {
+                m_target.SetBroadcast();
+            }
+            else if ( !m_target.Parse ( value ) )
+            {
+                Logger::get ( "xplsdk.comms" ).warning("Invalid xPl dest: " + value.toString());
+            }
         }
         else
         {
@@ -162,89 +439,516 @@ void XplMsg::ParseFromString ( string str )
 
     // Read the schema class and type
     {
-        string schemaClass;
-        string schemaType;
-        pos = StringReadLine ( str, pos, &line );
+        XplStringView schemaClass;
+        XplStringView schemaType;
+        pos = ReadLine ( str, pos, &line );
         StringSplit ( line, '.', &schemaClass, &schemaType );
-        SetSchemaClass ( schemaClass );
-        SetSchemaType ( schemaType );
+        if ( schemaClass.empty() || ( schemaClass.size() > c_maxSchemaLen ) || schemaType.empty() || ( schemaType.size() > c_maxSchemaLen ) )
+        {
+            throw XplMsgParseException("Invalid schema");
+        }
+
+        // Anyone on the network can send any name they like, so only
+        // look the names up.  Adding them would let a stream of made-up
+        // schemas fill the table.
+        m_schemaClassId = StoreSchemaName ( schemaClass, false, m_schemaClass, &m_schemaClassLen );
+        m_schemaTypeId = StoreSchemaName ( schemaType, false, m_schemaType, &m_schemaTypeLen );
+    }
+
+    // Skip the opening brace of the body
+    pos = ReadLine ( str, pos, &line );
+    if ( line != XplStringView ( c_xplOpenBrace ) )
+    {
+        throw XplMsgParseException("Opening brace not found");
+    }
+
+    // A well formed message ends with the closing brace of the body.
+    // Checking that now means a truncated message is still rejected
+    // here, even though the body itself is not read yet.
+    XplStringView const rest = str.substr ( pos ).trim();
+    if ( rest.empty() || ( rest[rest.size()-1] != '}' ) )
+    {
+        throw XplMsgParseException("Reached the end of the data without hitting a closing brace.  The message is malformed.");
+    }
+
+    // The body stays in the raw data until somebody needs it
+    m_bodyStart = pos;
+    m_bBodyInRaw = true;
+    m_bBodyParsed = false;
+    m_bNamesValid = false;
+
+    if ( _bParseBody && !TokenizeBody() )
+    {
+        throw XplMsgParseException("Reached the end of the data without hitting a closing brace.  The message is malformed.");
+    }
+
+    // Message successfully read from buffer
+    return;
+    
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::ParseBody												****
+****																	****
+***************************************************************************/
+
+void XplMsg::ParseBody() const
+{
+    // The names are indexed too, so that looking up values
+    // afterwards only reads the message.
+    BuildNameIndex();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::TokenizeBody											****
+****																	****
+****	Records the positions of the name=value pairs of the body.		****
+****	Returns false if the closing brace was not found, in which		****
+****	case the pairs before the end of the data are kept.				****
+****																	****
+***************************************************************************/
+
+bool XplMsg::TokenizeBody() const
+{
+    m_bBodyParsed = true;
+    m_pairs.clear();
+    m_bNamesValid = false;
+
+    XplStringView const str ( m_raw );
+    XplStringView const body = str.substr ( m_bodyStart );
+    m_lines.Build ( body.data(), body.size() );
+
+    uint32 index = 0;
+    while ( 1 )
+    {
+        XplStringView name;
+        XplStringView value;
+
+        ReadNameValuePair ( body, m_lines, &index, &name, &value );
+
+        if ( name.empty() )
+        {
+            // Ran out of data
+            return false;
+        }
+
+        if ( name == XplStringView ( c_xplCloseBrace ) )
+        {
+            // Closing brace found
+            return true;
+        }
+
+        Pair pair;
+        pair.m_name.m_pos = ( uint32 ) ( name.data() - str.data() );
+        pair.m_name.m_len = name.size();
+        pair.m_value.m_pos = ( uint32 ) ( value.data() - str.data() );
+        pair.m_value.m_len = value.size();
+        pair.m_next = c_noPair;
+        m_pairs.push_back ( pair );
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::MakeMsgItem												****
+****																	****
+****	Copies the values of one name into a new XplMsgItem, for		****
+****	GetMsgItem.  The names must have been indexed.					****
+****																	****
+***************************************************************************/
+
+AutoPtr<XplMsgItem> XplMsg::MakeMsgItem
+(
+    uint32 const _nameIndex
+) const
+{
+    Name const& name = m_names[_nameIndex];
+    AutoPtr<XplMsgItem> pItem = new XplMsgItem ( GetSlice ( m_pairs[name.m_first].m_name ).toString() );
+    for ( uint32 i = name.m_first; i != c_noPair; i = m_pairs[i].m_next )
+    {
+        pItem->AddValue ( GetSlice ( m_pairs[i].m_value ).toString() );
+    }
+    return pItem;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::BuildNameIndex											****
+****																	****
+***************************************************************************/
+
+void XplMsg::BuildNameIndex() const
+{
+    FastMutex::ScopedLock lock ( m_lazyLock );
+    IndexNames();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::EnsureTokenized											****
+****																	****
+***************************************************************************/
+
+void XplMsg::EnsureTokenized() const
+{
+    FastMutex::ScopedLock lock ( m_lazyLock );
+    if ( !m_bBodyParsed )
+    {
+        TokenizeBody();
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::IndexNames												****
+****																	****
+****	Links together the pairs that share a name, and indexes the		****
+****	names.  Done the first time a received body is searched.		****
+****	Called with m_lazyLock held.									****
+****																	****
+***************************************************************************/
+
+void XplMsg::IndexNames() const
+{
+    if ( m_bNamesValid )
+    {
+        return;
+    }
+
+    if ( !m_bBodyParsed )
+    {
+        TokenizeBody();
+    }
+    m_names.clear();
+    m_nameIndex.Clear();
+    for ( uint32 i=0; i<m_pairs.size(); ++i )
+    {
+        m_pairs[i].m_next = c_noPair;
+        LinkPair ( i );
+    }
+
+    m_bNamesValid = true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::LinkPair												****
+****																	****
+****	Adds a pair to the end of the list for its name.				****
+****																	****
+***************************************************************************/
+
+void XplMsg::LinkPair
+(
+    uint32 const _pair
+) const
+{
+    XplStringView const name = GetSlice ( m_pairs[_pair].m_name );
+    uint32 const hash = XplNameIndex::Hash ( name );
+    uint32 const nameIndex = FindName ( name, hash );
+    if ( c_noPair == nameIndex )
+    {
+        Name entry;
+        entry.m_first = _pair;
+        entry.m_last = _pair;
+        entry.m_count = 1;
+        m_nameIndex.Insert ( hash, ( uint32 ) m_names.size() );
+        m_names.push_back ( entry );
+        return;
+    }
+
+    Name& entry = m_names[nameIndex];
+    m_pairs[entry.m_last].m_next = _pair;
+    entry.m_last = _pair;
+    ++entry.m_count;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::FindName												****
+****																	****
+***************************************************************************/
+
+uint32 XplMsg::FindName
+(
+    XplStringView const& _name,
+    uint32 const _hash
+) const
+{
+    uint32 slot = m_nameIndex.Begin ( _hash );
+    uint32 nameIndex;
+    while ( m_nameIndex.Next ( _hash, &slot, &nameIndex ) )
+    {
+        if ( _name.equalsNoCase ( GetSlice ( m_pairs[m_names[nameIndex].m_first].m_name ) ) )
+        {
+            return nameIndex;
+        }
+    }
+
+    return c_noPair;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::FindPair												****
+****																	****
+****	Gets the pair holding a particular value of a name.				****
+****																	****
+***************************************************************************/
+
+uint32 XplMsg::FindPair
+(
+    XplStringView const& _name,
+    uint32 const _index
+) const
+{
+    BuildNameIndex();
+    uint32 const nameIndex = FindName ( _name, XplNameIndex::Hash ( _name ) );
+    if ( ( c_noPair == nameIndex ) || ( _index >= m_names[nameIndex].m_count ) )
+    {
+        return c_noPair;
+    }
+
+    uint32 pair = m_names[nameIndex].m_first;
+    for ( uint32 i=0; i<_index; ++i )
+    {
+        pair = m_pairs[pair].m_next;
+    }
+    return pair;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::GetRawData												****
+****																	****
+***************************************************************************/
+
+string const& XplMsg::GetRawData() const
+{
+    FastMutex::ScopedLock lock ( m_lazyLock );
+    if ( m_raw.empty() )
+    {
+        // Serialize straight into the cache.  Its capacity is kept
+        // when the message is modified, so a message that is sent
+        // over and over does not need to allocate each time.
+        IndexNames();
+        m_raw.resize ( CalcRawSize() );
+        FormatRawData ( &m_raw[0] );
     }
 
-    // Read the message body
-    // Skip the opening brace
-    pos = StringReadLine ( str, pos, &line );
-    if ( c_xplOpenBrace != line )
+    return m_raw;
+}
+
+
+namespace
+{
+
+/***************************************************************************
+****																	****
+****	Serialization helpers											****
+****																	****
+***************************************************************************/
+
+inline char* WriteText ( char* _pDest, char const* _pSrc, uint32 const _len )
+{
+    memcpy ( _pDest, _pSrc, _len );
+    return _pDest + _len;
+}
+
+inline char* WriteText ( char* _pDest, string const& _str )
+{
+    return WriteText ( _pDest, _str.data(), ( uint32 ) _str.size() );
+}
+
+inline char* WriteChar ( char* _pDest, char const _ch )
+{
+    *_pDest = _ch;
+    return _pDest + 1;
+}
+
+// Formats a number into the end of a buffer, returning the first digit
+inline char* FormatNumber ( char* _pEnd, uint32 _value )
+{
+    do
+    {
+        *--_pEnd = ( char ) ( '0' + ( _value % 10 ) );
+        _value /= 10;
+    }
+    while ( _value );
+    return _pEnd;
+}
+
+inline char* WriteAddress ( char* _pDest, XplAddress const& _address )
+{
+    if ( _address.IsBroadcast() )
+    {
+        return WriteChar ( _pDest, '*' );
+    }
+    _pDest = WriteText ( _pDest, _address.GetVendor().data(), _address.GetVendor().size() );
+    _pDest = WriteChar ( _pDest, '-' );
+    _pDest = WriteText ( _pDest, _address.GetDevice().data(), _address.GetDevice().size() );
+    _pDest = WriteChar ( _pDest, '.' );
+    return WriteText ( _pDest, _address.GetInstance().data(), _address.GetInstance().size() );
+}
+
+char const c_hopLine[] = "hop=";
+char const c_sourceLine[] = "source=";
+char const c_targetLine[] = "target=";
+
+} // namespace
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::GetRawSize												****
+****																	****
+***************************************************************************/
+
+uint32 XplMsg::GetRawSize() const
+{
+    // GetRawData may be filling in m_raw on another thread
+    FastMutex::ScopedLock lock ( m_lazyLock );
+    if ( !m_raw.empty() )
+    {
+        return ( uint32 ) m_raw.size();
+    }
+
+    return CalcRawSize();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::CalcRawSize												****
+****																	****
+***************************************************************************/
+
+uint32 XplMsg::CalcRawSize() const
+{
+    char digits[12];
+    char* pEnd = digits + sizeof ( digits );
+    uint32 size = 0;
+
+    size += ( uint32 ) m_type.size() + 1;												// type
+    size += 2;																			// {
+    size += ( sizeof ( c_hopLine ) - 1 ) + ( uint32 ) ( pEnd - FormatNumber ( pEnd, ( uint32 ) m_hop ) ) + 1;
+    size += ( sizeof ( c_sourceLine ) - 1 ) + m_source.GetTextSize() + 1;
+    size += ( sizeof ( c_targetLine ) - 1 ) + m_target.GetTextSize() + 1;
+    size += 2;																			// }
+    size += ( uint32 ) ( m_schemaClassLen + 1 + m_schemaTypeLen ) + 1;		// class.type
+    size += 2;																			// {
+
+    for ( vector<Pair>::const_iterator iter = m_pairs.begin(); iter != m_pairs.end(); ++iter )
     {
-        throw XplMsgParseException("Opening brace not found");
+        size += iter->m_name.m_len + 1 + iter->m_value.m_len + 1;
     }
 
-    // Read the name-value pairs
-    while ( 1 )
-    {
-        string name;
-        string value;
-
-        pos = ReadNameValuePair ( str, pos, &name, &value );
+    size += 2;																			// }
+    return size;
+}
 
-        if ( name.empty() )
-        {
-            throw XplMsgParseException("Reached the end of the data without hitting a closing brace.  The message is malformed.");
-        }
 
-        if ( c_xplCloseBrace == name )
-        {
-            // Closing brace found
-            break;
-        }
+/***************************************************************************
+****																	****
+****	XplMsg::WriteRawData											****
+****																	****
+***************************************************************************/
 
-        // Add the name=value pair to the message
-        AddValue ( name, value );
+uint32 XplMsg::WriteRawData
+(
+    char* _pBuffer,
+    uint32 const _size
+) const
+{
+    FastMutex::ScopedLock lock ( m_lazyLock );
+    uint32 const rawSize = m_raw.empty() ? CalcRawSize() : ( uint32 ) m_raw.size();
+    if ( _size < rawSize )
+    {
+        // Buffer too small
+        return 0;
     }
 
-    // Copy the original raw data
-    m_raw = str;
-
-    // Message successfully read from buffer
-    return;
-    
+    if ( !m_raw.empty() )
+    {
+        memcpy ( _pBuffer, m_raw.data(), rawSize );
+    }
+    else
+    {
+        IndexNames();
+        FormatRawData ( _pBuffer );
+    }
+    return rawSize;
 }
 
 
-
-
 /***************************************************************************
 ****																	****
-****	XplMsg::GetAsRawData											****
+****	XplMsg::FormatRawData											****
+****																	****
+****	Writes the message out from its fields.  The buffer must have	****
+****	room for CalcRawSize() bytes, and the names must have been		****
+****	indexed.														****
 ****																	****
 ***************************************************************************/
 
-string XplMsg::GetRawData( )
+void XplMsg::FormatRawData
+(
+    char* _pBuffer
+) const
 {
-    if ( m_raw.size() ==0 )
+    char digits[12];
+    char* pEnd = digits + sizeof ( digits );
+    char* pHop = FormatNumber ( pEnd, ( uint32 ) m_hop );
+
+    char* p = _pBuffer;
+    p = WriteText ( p, m_type );
+    p = WriteChar ( p, '\n' );
+    p = WriteText ( p, "{\n", 2 );
+    p = WriteText ( p, c_hopLine, sizeof ( c_hopLine ) - 1 );
+    p = WriteText ( p, pHop, ( uint32 ) ( pEnd - pHop ) );
+    p = WriteChar ( p, '\n' );
+    p = WriteText ( p, c_sourceLine, sizeof ( c_sourceLine ) - 1 );
+    p = WriteAddress ( p, m_source );
+    p = WriteChar ( p, '\n' );
+    p = WriteText ( p, c_targetLine, sizeof ( c_targetLine ) - 1 );
+    p = WriteAddress ( p, m_target );
+    p = WriteChar ( p, '\n' );
+    p = WriteText ( p, "}\n", 2 );
+    p = WriteText ( p, m_schemaClass, m_schemaClassLen );
+    p = WriteChar ( p, '.' );
+    p = WriteText ( p, m_schemaType, m_schemaTypeLen );
+    p = WriteChar ( p, '\n' );
+    p = WriteText ( p, "{\n", 2 );
+
+    // Values are written out grouped by name
+    char const* pBody = m_arena.data();
+    for ( vector<Name>::const_iterator iter = m_names.begin(); iter != m_names.end(); ++iter )
     {
-        ostringstream msgstream;
-        msgstream << m_type << "\n";
-        msgstream << "{\n";
-        msgstream << "hop=" << m_hop << "\n";
-        msgstream << "source=" << m_source.toString() << "\n";
-        msgstream << "target=" << m_target.toString() << "\n";
-        msgstream << "}\n";
-        msgstream << m_schemaClass<<"." << m_schemaType << "\n";
-        msgstream << "{\n";
-
-        for ( std::vector< AutoPtr<XplMsgItem>  >::iterator iter = m_msgItems.begin(); iter != m_msgItems.end(); ++iter )
+        for ( uint32 i = iter->m_first; i != c_noPair; i = m_pairs[i].m_next )
         {
-            AutoPtr<XplMsgItem>  pItem = *iter;
-            for ( int i=0; i<pItem->GetNumValues(); ++i )
-            {
-                msgstream << pItem->GetName() << "=" << pItem->GetValue ( i ) << "\n";
-            }
+            Pair const& pair = m_pairs[i];
+            p = WriteText ( p, pBody + pair.m_name.m_pos, pair.m_name.m_len );
+            p = WriteChar ( p, '=' );
+            p = WriteText ( p, pBody + pair.m_value.m_pos, pair.m_value.m_len );
+            p = WriteChar ( p, '\n' );
         }
-        msgstream <<"}\n";
-        m_raw = msgstream.str();;
     }
 
-    return m_raw;
+    p = WriteText ( p, "}\n", 2 );
+
+    assert ( ( uint32 ) ( p - _pBuffer ) == CalcRawSize() );
 }
 
 
@@ -262,34 +966,62 @@ void XplMsg::AddValue
 )
 {
     InvalidateRawData();
+    BuildNameIndex();
 
-    XplMsgItem* pItem;
-
-    // See if there is already an existing XplMsgItem with this name
-    string lowerName = toLower ( _name );
-    vector<AutoPtr<XplMsgItem> >::iterator iter;
-    for ( iter = m_msgItems.begin(); iter != m_msgItems.end(); ++iter )
+    // Pairs that share a name share its text
+    XplStringView const name ( _name );
+    uint32 const nameIndex = FindName ( name, XplNameIndex::Hash ( name ) );
+    Slice nameSlice;
+    if ( c_noPair != nameIndex )
     {
-        if ( _name == ( *iter )->GetName() )
+        nameSlice = m_pairs[m_names[nameIndex].m_first].m_name;
+    }
+    else
+    {
+        // A new name.  Names are stored in lower case.
+        nameSlice = AppendToArena ( name );
+        for ( uint32 i=0; i<nameSlice.m_len; ++i )
         {
-            // Found a match
-            break;
+            m_arena[nameSlice.m_pos+i] = ( char ) tolower ( ( unsigned char ) m_arena[nameSlice.m_pos+i] );
         }
     }
 
-    if ( iter != m_msgItems.end() )
+    // Add the value, ensuring that it does not exceed the 128 character
+    // maximum length.  If the string is longer, it must be broken down
+    // and multiple name=value pairs created.
+    XplStringView remainder ( _value );
+    bool bMore = true;
+    while ( bMore )
     {
-        // Item found
-        pItem = *iter;
-    }
-    else
-    {
-        // Create a new XplMsgItem
-        pItem = new XplMsgItem ( lowerName );
-        m_msgItems.push_back ( pItem );
-    }
+        XplStringView part = remainder;
+        bMore = ( part.size() > 128 );
+        if ( bMore )
+        {
+            // remainder needs to be split into multiple shorter strings
+            uint32 breakpos = XplStringView::npos;
+            for ( uint32 i=0; i<=128; ++i )
+            {
+                if ( remainder[i] == _delimiter )
+                {
+                    breakpos = i;
+                }
+            }
+            if ( XplStringView::npos == breakpos )
+            {
+                // Failed to break the string down.
+                break;
+            }
+            part = remainder.substr ( 0, breakpos );
+            remainder = remainder.substr ( breakpos+1 );
+        }
 
-    pItem->AddValue ( _value, _delimiter );
+        Pair pair;
+        pair.m_name = nameSlice;
+        pair.m_value = AppendToArena ( part );
+        pair.m_next = c_noPair;
+        m_pairs.push_back ( pair );
+        LinkPair ( ( uint32 ) m_pairs.size() - 1 );
+    }
 }
 
 
@@ -326,17 +1058,34 @@ bool XplMsg::SetValue
 {
     InvalidateRawData();
 
-    // Find the XplMsgItem with this name
-    for ( vector<AutoPtr<XplMsgItem> >::iterator iter = m_msgItems.begin();  iter != m_msgItems.end(); ++iter )
+    // Find the pair with this name and index
+    uint32 const pairIndex = FindPair ( _name, _index );
+    if ( c_noPair == pairIndex )
     {
-        if ( _name == ( *iter )->GetName() )
-        {
-            return ( ( *iter )->SetValue ( _value, _index ) );
-        }
+        // No entry found for this name
+        return ( false );
     }
 
-    // No entry found for this name
-    return ( false );
+    Pair& pair = m_pairs[pairIndex];
+    if ( _value.size() <= pair.m_value.m_len )
+    {
+        // The new value fits in the space used by the old one
+        memcpy ( &m_arena[pair.m_value.m_pos], _value.data(), _value.size() );
+        m_arenaWaste += pair.m_value.m_len - ( uint32 ) _value.size();
+        pair.m_value.m_len = ( uint32 ) _value.size();
+    }
+    else
+    {
+        m_arenaWaste += pair.m_value.m_len;
+        pair.m_value = AppendToArena ( _value );
+    }
+
+    // Stop a value that keeps changing from growing the arena for ever
+    if ( ( m_arenaWaste > 256 ) && ( m_arenaWaste > ( m_arena.size() / 2 ) ) )
+    {
+        CompactArena();
+    }
+    return true;
 }
 
 
@@ -351,18 +1100,17 @@ AutoPtr<XplMsgItem>  XplMsg::GetMsgItem
     string const& _name
 ) const
 {
-    string lowerName = toLower ( _name );
-    for ( vector<AutoPtr<XplMsgItem> >::const_iterator iter = m_msgItems.begin();  iter != m_msgItems.end(); ++iter )
+    BuildNameIndex();
+
+    XplStringView const name ( _name );
+    uint32 const nameIndex = FindName ( name, XplNameIndex::Hash ( name ) );
+    if ( c_noPair == nameIndex )
     {
-        if ( lowerName == ( *iter )->GetName() )
-        {
-            // Found a matching item
-            return ( *iter );
-        }
+        // No entry found for this name
+        return ( NULL );
     }
 
-    // No entry found for this name
-    return ( NULL );
+    return ( MakeMsgItem ( nameIndex ) );
 }
 
 
@@ -377,14 +1125,16 @@ AutoPtr<XplMsgItem>  XplMsg::GetMsgItem
     uint32 const _index
 ) const
 {
-    if ( _index >= m_msgItems.size() )
+    BuildNameIndex();
+
+    if ( _index >= m_names.size() )
     {
         // Index out of range
         assert ( 0 );
         return NULL;
     }
 
-    return ( m_msgItems[_index] );
+    return ( MakeMsgItem ( _index ) );
 }
 
 
@@ -400,10 +1150,10 @@ string const XplMsg::GetValue
     uint32 const _index /*=0*/
 ) const
 {
-    if ( XplMsgItem const* pMsgItem = GetMsgItem ( _name ) )
+    XplStringView value;
+    if ( GetValueView ( _name, &value, _index ) )
     {
-        // Get the value from the  XplMsgItem object
-        return ( pMsgItem->GetValue ( _index ) );
+        return ( value.toString() );
     }
 
     // No entry found for this name
@@ -411,6 +1161,82 @@ string const XplMsg::GetValue
 }
 
 
+/***************************************************************************
+****																	****
+****	XplMsg::GetValueView											****
+****																	****
+***************************************************************************/
+
+bool XplMsg::GetValueView
+(
+    XplStringView const& _name,
+    XplStringView* _pValue,
+    uint32 const _index /*=0*/
+) const
+{
+    uint32 const pairIndex = FindPair ( _name, _index );
+    if ( c_noPair == pairIndex )
+    {
+        // No entry found for this name
+        return false;
+    }
+
+    *_pValue = GetSlice ( m_pairs[pairIndex].m_value );
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::GetNumMsgItems											****
+****																	****
+***************************************************************************/
+
+uint32 XplMsg::GetNumMsgItems() const
+{
+    BuildNameIndex();
+    return ( uint32 ) m_names.size();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::GetNumValuePairs										****
+****																	****
+***************************************************************************/
+
+uint32 XplMsg::GetNumValuePairs() const
+{
+    EnsureTokenized();
+    return ( uint32 ) m_pairs.size();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::GetValuePair											****
+****																	****
+***************************************************************************/
+
+bool XplMsg::GetValuePair
+(
+    uint32 const _index,
+    XplStringView* _pName,
+    XplStringView* _pValue
+) const
+{
+    EnsureTokenized();
+    if ( _index >= m_pairs.size() )
+    {
+        return false;
+    }
+
+    *_pName = GetSlice ( m_pairs[_index].m_name );
+    *_pValue = GetSlice ( m_pairs[_index].m_value );
+    return true;
+}
+
+
 /***************************************************************************
 ****																	****
 ****	XplMsg::GetIntValue												****
@@ -447,17 +1273,15 @@ string const XplMsg::GetCompleteValue
 ) const
 {
     string str;
-    if ( XplMsgItem const* pMsgItem = GetMsgItem ( _name ) )
+    uint32 pairIndex = FindPair ( _name, 0 );
+    for ( uint32 i=0; c_noPair != pairIndex; ++i, pairIndex = m_pairs[pairIndex].m_next )
     {
-        // Get the values from the XplMsgItem object
-        for ( int i=0; i<pMsgItem->GetNumValues(); ++i )
+        if ( i )
         {
-            if ( i )
-            {
-                str += _delimiter;
-            }
-            str += pMsgItem->GetValue ( i );
+            str += _delimiter;
         }
+        XplStringView value = GetSlice ( m_pairs[pairIndex].m_value );
+        str.append ( value.data(), value.size() );
     }
 
     return str;
@@ -502,25 +1326,52 @@ bool XplMsg::SetType
 {
     InvalidateRawData();
 
-    string lowerType = toLower ( _type );
+    string const* pType = FindType ( _type );
+    if ( NULL == pType )
+    {
+        // Invalid message type
+        assert ( 0 );
+        return ( false );
+    }
+
+    m_type = *pType;
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::FindType												****
+****																	****
+***************************************************************************/
 
+string const* XplMsg::FindType
+(
+    XplStringView const& _type
+)
+{
     //in case we've forgotten the leading bit...
-    if ( lowerType.size() ==4 )
+    XplStringView type = _type;
+    if ( ( type.size() == 8 ) && type.substr ( 0, 4 ).equalsNoCase ( "xpl-" ) )
     {
-        lowerType = "xpl-" + lowerType;
+        type = type.substr ( 4 );
     }
 
-    if ( ( "xpl-trig" != lowerType )
-            && ( "xpl-cmnd" != lowerType )
-            && ( "xpl-stat" != lowerType ) )
+    if ( type.equalsNoCase ( "cmnd" ) )
     {
-        // Invalid message type
-        assert ( 0 );
-        return ( false );
+        return &c_xplCmnd;
+    }
+    if ( type.equalsNoCase ( "trig" ) )
+    {
+        return &c_xplTrig;
+    }
+    if ( type.equalsNoCase ( "stat" ) )
+    {
+        return &c_xplStat;
     }
 
-    m_type = lowerType;
-    return true;
+    // Invalid message type
+    return NULL;
 }
 
 
@@ -535,44 +1386,28 @@ bool XplMsg::SetSource
     string const& _source
 )
 {
+    InvalidateRawData();
+
     // Source must consist of vendor ID (max 8 chars), device ID
     // (max 8 chars) and instance ID (max 16 chars) in the form
     // vendor-device.instance
-    string vendor;
-    string deviceInstance;
-    StringSplit ( _source, '-', &vendor, &deviceInstance );
-
-    if ( ( vendor.size() > 8 ) || vendor.empty() || deviceInstance.empty() )
+    if ( !m_source.Parse ( _source ) )
     {
         Logger::get ( "xplsdk.comms" ).warning("Invalid xPl source: " + _source);
         return false;
     }
-    m_source.vendor = vendor;
-
-    string device;
-    string instance;
-    StringSplit ( deviceInstance, '.', &device, &instance );
-
-    if ( ( device.size() > 8 ) || device.empty() || ( instance.size() > 16 ) || instance.empty() )
-    {
-        assert ( 0 );
-        return false;
-    }
-
-    m_source.device = toLower(device);
-    m_source.instance = toLower(instance);
     
     return true;
 }
 
 bool XplMsg::SetSource
 (
-    XPLAddress const& _source
+    XplAddress const& _source
 )
 {
     InvalidateRawData();
     m_source = _source;
-
+    return true;
 }
 
 
@@ -593,53 +1428,30 @@ bool XplMsg::SetTarget
     // For broadcasts, the target can be "*"
     if ( "*" == _target )
     {
-        m_target.bcast = true;
+        m_target.SetBroadcast();
         return ( true );
     }
 
     // If not "*", the target must consist of vendor ID (max 8 chars),
     // device ID (max 8 chars) and instance ID (max 16 chars) in the
     // form vendor-device.instance
-    string vendor;
-    string deviceInstance;
-    StringSplit ( _target, '-', &vendor, &deviceInstance );
-
-
-    //if( ( vendor.size() > 8 ) || vendor.empty() || deviceInstance.empty() )
-    if ( vendor.empty() || deviceInstance.empty() )
-    {
-        assert ( 0 );
-        return false;
-    }
-    if ( vendor.size() > 8 )
-    {
-        Logger::get ( "xplsdk.comms" ).warning("Invalid xPl vendor: " + vendor);
-    }
-    m_target.vendor = vendor;
-
-    string device;
-    string instance;
-    StringSplit ( deviceInstance, '.', &device, &instance );
-
-    if ( ( device.size() > 8 ) || device.empty() || ( instance.size() > 16 ) || instance.empty() )
+    if ( !m_target.Parse ( _target ) )
     {
-        Logger::get ( "xplsdk.comms" ).warning("Invalid xPl dest: " + device);
+        Logger::get ( "xplsdk.comms" ).warning("Invalid xPl dest: " + _target);
         assert ( 0 );
         return false;
     }
-    m_target.device = toLower(device);
-    m_target.instance = toLower(instance);
     return true;
 }
 
 bool XplMsg::SetTarget
 (
-    XPLAddress const& _target
+    XplAddress const& _target
 )
 {
     InvalidateRawData();
     m_target = _target;
-
+    return true;
 }
 
 
@@ -657,13 +1469,16 @@ bool XplMsg::SetSchemaClass
     InvalidateRawData();
 
     // Schema class cannot exceed 8 characters
-    if ( _schemaClass.empty() || ( _schemaClass.size() > 8 ) )
+    if ( _schemaClass.empty() || ( _schemaClass.size() > c_maxSchemaLen ) )
     {
         assert ( 0 );
         return false;
     }
 
-    m_schemaClass = toLower ( _schemaClass );
+    // Names used by this program are added to the table, so that
+    // filters and topics can compare them by ID.  If the table is
+    // full the ID is c_none, but the text is still set.
+    m_schemaClassId = StoreSchemaName ( _schemaClass, true, m_schemaClass, &m_schemaClassLen );
     return true;
 }
 
@@ -682,44 +1497,124 @@ bool XplMsg::SetSchemaType
     InvalidateRawData();
 
     // Schema type cannot exceed 8 characters
-    if ( _schemaType.empty() || ( _schemaType.size() > 8 ) )
+    if ( _schemaType.empty() || ( _schemaType.size() > c_maxSchemaLen ) )
     {
         assert ( 0 );
         return false;
     }
 
-    m_schemaType = toLower ( _schemaType );
+    // Names used by this program are added to the table, so that
+    // filters and topics can compare them by ID.  If the table is
+    // full the ID is c_none, but the text is still set.
+    m_schemaTypeId = StoreSchemaName ( _schemaType, true, m_schemaType, &m_schemaTypeLen );
     return true;
 }
 
 
+/***************************************************************************
+****																	****
+****	XplMsg::StoreSchemaName											****
+****																	****
+***************************************************************************/
+
+uint32 XplMsg::StoreSchemaName
+(
+    XplStringView const& _str,
+    bool const _bIntern,
+    char* _pText,
+    uint8* _pLen
+)
+{
+    for ( uint32 i=0; i<_str.size(); ++i )
+    {
+        _pText[i] = ( char ) tolower ( ( unsigned char ) _str[i] );
+    }
+    *_pLen = ( uint8 ) _str.size();
+
+    XplStringView const name ( _pText, _str.size() );
+    return _bIntern ? XplSymbolTable::Intern ( name ) : XplSymbolTable::Find ( name );
+}
+
+
 /***************************************************************************
 ****																	****
 ****	XplMsg::ReadNameValuePair										****
 ****																	****
 ***************************************************************************/
 
-int32 XplMsg::ReadNameValuePair
+void XplMsg::ReadNameValuePair
 (
-    string const& _str,
-    int32 const _start,
-    string* _name,
-    string* _value
+    XplStringView const& _str,
+    XplLineTable const& _lines,
+    uint32* _pIndex,
+    XplStringView* _name,
+    XplStringView* _value
 )
 {
-    // Scan the string, noting the positions of the = and \n characters
-    string line;
-    int32 pos = StringReadLine ( _str, _start, &line );
+    if ( *_pIndex >= _lines.GetNumLines() )
+    {
+        // End of the data
+        *_name = XplStringView();
+        *_value = XplStringView();
+        return;
+    }
 
-    if ( !StringSplit ( line, '=', _name, _value ) )
+    XplLineTable::Line const& line = _lines.GetLine ( ( *_pIndex )++ );
+    if ( XplStringView::npos == line.m_equals )
     {
         // We didn't find an = sign, so we return the whole line in name.
         // The line is probably a closing brace - by returning it
         // we allow the caller to see if that is the case.
-        *_name = line;
+        *_name = _str.substr ( line.m_start, line.m_end - line.m_start ).trim();
+        *_value = XplStringView();
+
+        if ( _name->empty() )
+        {
+            // Nothing but whitespace, so try the next line
+            ReadNameValuePair ( _str, _lines, _pIndex, _name, _value );
+        }
+        return;
+    }
+
+    *_name = _str.substr ( line.m_start, line.m_equals - line.m_start ).trim();
+    *_value = _str.substr ( line.m_equals + 1, line.m_end - line.m_equals - 1 ).trim();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::ReadLine												****
+****																	****
+***************************************************************************/
+
+uint32 XplMsg::ReadLine
+(
+    XplStringView const& _str,
+    uint32 const _start,
+    XplStringView* _pLine
+)
+{
+    uint32 pos = _start;
+    while ( pos < _str.size() )
+    {
+        uint32 end = _str.find ( '\n', pos );
+        if ( XplStringView::npos == end )
+        {
+            end = _str.size();
+        }
+
+        // Trimming also removes any carriage return
+        *_pLine = _str.substr ( pos, end - pos ).trim();
+        pos = end + 1;
+        if ( !_pLine->empty() )
+        {
+            return pos;
+        }
     }
 
-    return ( pos );
+    // End of the data
+    *_pLine = XplStringView();
+    return _str.size();
 }
 
 
@@ -731,31 +1626,102 @@ int32 XplMsg::ReadNameValuePair
 
 void XplMsg::InvalidateRawData()
 {
-    m_raw = "";
+    if ( m_bBodyInRaw )
+    {
+        // The pairs refer to the raw data, so rather than copy
+        // them out, the raw data simply becomes the arena.
+        EnsureTokenized();
+        m_arena.swap ( m_raw );
+        m_arenaWaste = ( uint32 ) m_arena.size();
+        m_bBodyInRaw = false;
+        m_lines.Clear();
+
+        // Names are stored in lower case
+        for ( vector<Pair>::const_iterator iter = m_pairs.begin(); iter != m_pairs.end(); ++iter )
+        {
+            for ( uint32 i=0; i<iter->m_name.m_len; ++i )
+            {
+                m_arena[iter->m_name.m_pos+i] = ( char ) tolower ( ( unsigned char ) m_arena[iter->m_name.m_pos+i] );
+            }
+            m_arenaWaste -= iter->m_name.m_len + iter->m_value.m_len;
+        }
+    }
+
+    m_raw.clear();
 }
 
 
 /***************************************************************************
 ****																	****
-****	XplMsg::operator ==												****
+****	XplMsg::AppendToArena											****
 ****																	****
 ***************************************************************************/
 
-bool XplMsg::operator ==
+XplMsg::Slice XplMsg::AppendToArena
 (
-    XplMsg const& _rhs
+    XplStringView const& _str
 )
 {
-    string pMsgDataLHS = GetRawData();
+    Slice slice;
+    slice.m_pos = ( uint32 ) m_arena.size();
+    slice.m_len = _str.size();
+    m_arena.append ( _str.data(), _str.size() );
+    return slice;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsg::CompactArena											****
+****																	****
+****	Copies the names and values that are still in use into a		****
+****	fresh arena, dropping any that have been replaced.				****
+****																	****
+***************************************************************************/
+
+void XplMsg::CompactArena()
+{
+    BuildNameIndex();
+
+    string arena;
+    arena.reserve ( m_arena.size() - m_arenaWaste );
+
+    // Each name is copied once, and shared by all of its pairs
+    for ( vector<Name>::const_iterator iter = m_names.begin(); iter != m_names.end(); ++iter )
+    {
+        Slice name = m_pairs[iter->m_first].m_name;
+        uint32 const namePos = ( uint32 ) arena.size();
+        arena.append ( m_arena, name.m_pos, name.m_len );
+        name.m_pos = namePos;
 
-    // I know this is pure evil, but all we are doing is filling the
-    // raw data cache, and we do not modify the actual xPL message.
+        for ( uint32 i = iter->m_first; i != c_noPair; i = m_pairs[i].m_next )
+        {
+            Pair& pair = m_pairs[i];
+            pair.m_name = name;
+
+            uint32 const valuePos = ( uint32 ) arena.size();
+            arena.append ( m_arena, pair.m_value.m_pos, pair.m_value.m_len );
+            pair.m_value.m_pos = valuePos;
+        }
+    }
+
+    m_arena.swap ( arena );
+    m_arenaWaste = 0;
+}
 
-    XplMsg* pNonConstRHS = const_cast<XplMsg*> ( &_rhs );
 
-    string pMsgDataRHS = pNonConstRHS->GetRawData( );
+/***************************************************************************
+****																	****
+****	XplMsg::operator ==												****
+****																	****
+***************************************************************************/
 
-    return ( pMsgDataLHS == pMsgDataRHS );
+bool XplMsg::operator ==
+(
+    XplMsg const& _rhs
+) const
+{
+    return ( GetRawData() == _rhs.GetRawData() );
 }
 
 
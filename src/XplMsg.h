@@ -45,6 +45,13 @@
 #include "XplCore.h"
 #include "xplRef.h"
 #include "XplMsgItem.h"
+#include "XplStringView.h"
+#include "XplScanner.h"
+#include "XplSymbol.h"
+#include "XplAddress.h"
+#include "XplNameIndex.h"
+#include "XplPool.h"
+#include "Poco/Mutex.h"
 #include "Poco/AutoPtr.h"
 #include "Poco/RefCountedObject.h"
 #include <exception>
@@ -80,6 +87,31 @@ public:
  * when it receives a message, but it could also be used to build an XplMsg from
  * a string of data created by sprintf, for example.
  * <p>
+ * A message created from raw data keeps that data.  Only the header and schema
+ * are decoded when the message is created, which is all that is needed to
+ * decide whether a message is of any interest.  The body is not looked at
+ * until one of its values is asked for, and even then the name=value pairs
+ * are only recorded as positions within the raw data.
+ * <p>
+ * The body is held as a single list of name=value pairs, each of which is
+ * just the position of its name and value in a block of text.  For a
+ * received message that text is the raw data itself.  When the body is
+ * modified, new names and values are appended to a separate block.  Pairs
+ * that share a name are kept next to each other, in the order they will be
+ * written out.  The pairs can be read without any copying through
+ * GetValueView and GetValuePair.  Copies are only made when a string is
+ * asked for (GetValue), when an XplMsgItem is requested, or when the
+ * message is modified.
+ * <p>
+ * The message no longer holds XplMsgItem objects.  GetMsgItem builds a new
+ * one each time, as a detached copy of the values, so changing it does not
+ * change the message.  Use SetValue and AddValue for that.
+ * <p>
+ * A message can be read by several threads at once.  The parts of a
+ * received message that are only worked out when they are first needed are
+ * filled in once, under a lock.  Changing a message while other threads
+ * read it is not safe.
+ * <p>
  * The second method creates a skeleton xPL message containing a header and
  * schema but with no name=value pairs in the message body.  These values are
  * added individually through subsequent calls to XplMsg::AddValue.
@@ -103,9 +135,24 @@ public:
     
     /**
      * @brief Tries to parse the sting into an XplMsg
+     * @param _bParseBody if true, the body is read straight away instead
+     * of when it is first needed.
      * @return :XplMsgParseException
      **/
-    XplMsg ( string str );
+    XplMsg ( string const& str, bool const _bParseBody = false );
+
+    /**
+     * @brief Tries to parse a receive buffer into an XplMsg
+     * The data is copied once into the message, and everything else refers
+     * to that copy.
+     * @param _pData the raw message data.  It does not need to be zero
+     * terminated, and anything after a zero byte is ignored.
+     * @param _size the number of bytes of message data.
+     * @param _bParseBody if true, the body is read straight away instead
+     * of when it is first needed.
+     * @return :XplMsgParseException
+     **/
+    XplMsg ( char const* _pData, uint32 const _size, bool const _bParseBody = false );
 
 
 //     /**
@@ -239,43 +286,105 @@ public:
      */
     string const GetCompleteValue ( string const& _name, char const _delimiter = ',' ) const;
 
+    /**
+     * Gets the value from a name-value pair in the message body without copying it.
+     * @param _name name of the item for which we wish to obtain the value.  The
+     * comparison ignores case.
+     * @param _pValue pointer to a view that will be set to the value.  The view
+     * is only valid until the message is modified or destroyed.
+     * @param _index the value index.  For a more detailed description of how the
+     * indexing works, @see XplMsg::SetValue.  Defaults to zero.
+     * @return True if the value was found.
+     * @see GetValue, GetValuePair.
+     */
+    bool GetValueView ( XplStringView const& _name, XplStringView* _pValue, uint32 const _index = 0 ) const;
+
+    /**
+     * Gets the number of name=value lines in the message body.
+     * Unlike GetNumMsgItems, names that appear more than once are counted
+     * once for each value.
+     * @return The number of name=value pairs.
+     * @see GetValuePair.
+     */
+    uint32 GetNumValuePairs() const;
+
+    /**
+     * Gets a name=value pair from the message body without copying it.
+     * Pairs are returned in the order they appear in the raw message, or
+     * were added, which is not necessarily the order they are written out.
+     * @param _index index of the pair, from zero to GetNumValuePairs()-1.
+     * @param _pName pointer to a view that will be set to the name.
+     * @param _pValue pointer to a view that will be set to the value.
+     * @return False if the index is out of range.
+     * @see GetNumValuePairs, GetValueView.
+     */
+    bool GetValuePair ( uint32 const _index, XplStringView* _pName, XplStringView* _pValue ) const;
+
+    /**
+     * Reads the message body, if that has not already been done.
+     * The body of a received message is normally read the first time one of
+     * its values is asked for.  That is done under a lock, and only once, so
+     * several threads can read the same message at the same time.  Calling
+     * this first simply moves the work to the calling thread.
+     */
+    void ParseBody() const;
+
     /**
      * Gets the number of XplMsgItems in the message.
      * @return The number of XplMsgItems contained in the message.
      * @see GetMsgItem.
      */
-    uint32 GetNumMsgItems() const
-    {
-        return ( uint32 ) m_msgItems.size();
-    }
+    uint32 GetNumMsgItems() const;
 
     /**
      * Gets an XplMsgItem.
-     * Gets a pointer to the XplMsgItem object that stores the array of values for the named item.
+     * Gets a copy of the values for the named item.  Changing the copy does
+     * not change the message.
      * @param _name name of the item for which we wish to retrieve the value(s).
-     * @return A pointer to the XplMsgItem object, or NULL if the named item does not exist.
+     * @return A pointer to a new XplMsgItem object, or NULL if the named item does not exist.
      * @see AddValue, GetValue, SetValue.
      */
     AutoPtr<XplMsgItem>  GetMsgItem ( string const& _name ) const;
 
     /**
      * Gets an XplMsgItem.
-     * Gets a pointer to the XplMsgItem by index.
+     * Gets a copy of the values of an item by index.  Changing the copy does
+     * not change the message.
      * @param _index index of the item for which we wish to retrieve the value(s).
-     * @return A pointer to the XplMsgItem object, or NULL if the index is out of range.
+     * @return A pointer to a new XplMsgItem object, or NULL if the index is out of range.
      * @see AddValue, GetValue, SetValue.
      */
     AutoPtr< XplMsgItem > GetMsgItem ( uint32 const _index ) const;
 
     /**
      * Gets the message in it's raw data form.
-     * Fills a buffer with the message in the form of a string of characters
-     * as would be transmitted over a network to another xPL application.
-     * @param _pBuffer On return this will contain a pointer to the raw data.
-     * @return The size of the message buffer in bytes.
-     * @see Create
+     * The message is formatted as it would be transmitted over a network to
+     * another xPL application.  The result is cached, so asking again
+     * costs nothing until the message is modified.
+     * @return A reference to the raw data.  It is only valid until the
+     * message is modified or destroyed.
+     * @see GetRawSize, WriteRawData
      */
-    string GetRawData( );
+    string const& GetRawData() const;
+
+    /**
+     * Gets the size of the message in it's raw data form.
+     * @return The exact number of bytes that WriteRawData will write.
+     * @see WriteRawData
+     */
+    uint32 GetRawSize() const;
+
+    /**
+     * Writes the message in it's raw data form into a buffer.
+     * Unlike GetRawData, this does not touch the cached copy, so it can be
+     * used to format a message straight into a send buffer.
+     * @param _pBuffer the buffer to write into.  No terminating zero is written.
+     * @param _size the size of the buffer.
+     * @return The number of bytes written, or zero if the buffer is smaller
+     * than GetRawSize().
+     * @see GetRawSize, GetRawData
+     */
+    uint32 WriteRawData ( char* _pBuffer, uint32 const _size ) const;
 
     /**
      * Gets the hop count of the message.
@@ -305,7 +414,7 @@ public:
      * @return A string containing the message source.
      * @see SetSource.
      */
-    const XPLAddress& GetSource() const
+    const XplAddress& GetSource() const
     {
         return m_source;
     }
@@ -319,7 +428,7 @@ public:
      * @return A string containing the message target.
      * @see SetTarget.
      */
-    const XPLAddress& GetTarget() const
+    const XplAddress& GetTarget() const
     {
         return m_target;
     }
@@ -328,24 +437,53 @@ public:
      * Gets the schema class.  An xPL message schema name has two parts
      * separated by a period,  The schema class is the left hand part.
      * For example, the "x10" in "x10.basic".
-     * @return A string containing the message schema class.
+     * @return the message schema class, in lower case.  The text is held
+     * in the message, so the view is valid for as long as the message is
+     * not changed.
      * @see SetSchemaClass.
      */
-    string const& GetSchemaClass() const
+    XplStringView GetSchemaClass() const
+    {
+        return XplStringView ( m_schemaClass, m_schemaClassLen );
+    }
+
+    /**
+     * Gets the schema class as an XplSymbolTable ID, for comparing
+     * without looking at the text.  A received message only looks the
+     * name up, so that made-up names cannot fill the table.
+     * @return the ID, or XplSymbolTable::c_none if neither a filter nor
+     * a message built by this program has used the name.
+     * @see GetSchemaClass.
+     */
+    uint32 GetSchemaClassId() const
     {
-        return m_schemaClass;
+        return m_schemaClassId;
     }
 
     /**
      * Gets the schema type.  An xPL message schema name has two parts
      * separated by a period,  The schema type is the right hand part.
      * For example, the "basic" in "x10.basic".
-     * @return A string containing the message schema type.
+     * @return the message schema type, in lower case.  The text is held
+     * in the message, so the view is valid for as long as the message is
+     * not changed.
      * @see SetSchemaType.
      */
-    string const& GetSchemaType() const
+    XplStringView GetSchemaType() const
     {
-        return m_schemaType;
+        return XplStringView ( m_schemaType, m_schemaTypeLen );
+    }
+
+    /**
+     * Gets the schema type as an XplSymbolTable ID, for comparing
+     * without looking at the text.
+     * @return the ID, or XplSymbolTable::c_none if neither a filter nor
+     * a message built by this program has used the name.
+     * @see GetSchemaType.
+     */
+    uint32 GetSchemaTypeId() const
+    {
+        return m_schemaTypeId;
     }
 
     /**
@@ -377,7 +515,7 @@ public:
      * @see GetSource.
      */
     bool SetSource ( string const& _source );
-    bool SetSource ( XPLAddress const& _source );
+    bool SetSource ( XplAddress const& _source );
     /**
      * Sets the message target.  The target is a string made
      * from the vendor, device and instance IDs of the message
@@ -390,7 +528,7 @@ public:
      * @see GetTarget.
      */
     bool SetTarget ( string const& _target );
-    bool SetTarget ( XPLAddress const& _target );
+    bool SetTarget ( XplAddress const& _target );
     /**
      * Sets the schema class.  An xPL message schema name has two parts
      * separated by a period,  The schema class is the left hand part.
@@ -413,7 +551,33 @@ public:
      */
     bool SetSchemaType ( string const& _schemaType );
 
-    bool operator == ( XplMsg const& _rhs );
+    bool operator == ( XplMsg const& _rhs ) const;
+
+    /**
+     * Turns pooling of received messages on or off.
+     * While pooling is on, the memory for XplMsg objects, and the buffers
+     * used to hold and index their raw data, are recycled instead of being
+     * freed when the last reference to a message goes.  Once the pools have
+     * grown to the number of messages alive at the busiest moment, receiving
+     * a message no longer calls the global allocator.  Pooling is off by
+     * default.
+     * @param _maxCached the most messages to keep for reuse.  Zero turns
+     * pooling off and frees anything currently kept.
+     * @see GetPoolStats
+     */
+    static void SetPooling ( uint32 const _maxCached );
+
+    /**
+     * Gets the counters for the message pools.
+     * @param _pMsgStats filled in with the counters for the XplMsg objects.
+     * @param _pStorageStats filled in with the counters for their buffers.
+     * @see SetPooling
+     */
+    static void GetPoolStats ( XplPoolStats* _pMsgStats, XplPoolStats* _pStorageStats );
+
+    // Allocation goes through the message pool
+    static void* operator new ( size_t _size );
+    static void operator delete ( void* _p, size_t _size );
 
     // String constants for various pieces of an xPL message
     static string const c_xplCmnd;
@@ -427,43 +591,253 @@ public:
     static string const c_xplTargetAll;
 
 private:
+    // Reads the headers of datagrams with ReadLine and FindType
+    friend class XplPrefilter;
+
     XplMsg();
     ~XplMsg();
 
     /**
-     * Helper method for extracting a name=value pair from a string.
-     * @param _str the string containing the xPL message in raw form.
-     * @param _start the position in the string from which to start
-     * reading.  This can contain whitespace (including newlines).
-     * @param _pName pointer to a string that will be filled with
+     * Position of a piece of text within m_raw.
+     */
+    struct Slice
+    {
+        uint32	m_pos;
+        uint32	m_len;
+    };
+
+    /**
+     * Position of a name=value pair within m_raw or m_arena.
+     */
+    struct Pair
+    {
+        Slice	m_name;
+        Slice	m_value;
+        uint32	m_next;			// Next pair with the same name, or c_noPair
+    };
+
+    /**
+     * The pairs that share a name, linked through Pair::m_next.
+     */
+    struct Name
+    {
+        uint32	m_first;
+        uint32	m_last;
+        uint32	m_count;
+    };
+
+    static uint32 const c_noPair = 0xffffffff;
+
+    // xPL limits the schema class and type to 8 characters each
+    static uint32 const c_maxSchemaLen = 8;
+
+    /**
+     * The buffers of a message that are worth recycling.
+     */
+    struct Storage;
+
+    /**
+     * Gets the pool of Storage objects.
+     */
+    static XplObjectPool<Storage>& GetStoragePool();
+
+    /**
+     * Swaps in a set of buffers from the pool, if pooling is on.
+     */
+    void TakeStorage();
+
+    /**
+     * Empties the buffers, and gives them back to the pool.
+     */
+    void ReturnStorage();
+
+    /**
+     * Exchanges the buffers with those held in a Storage object.
+     */
+    void SwapStorage ( Storage* _pStorage );
+
+    /**
+     * Helper method for extracting a name=value pair from a buffer.
+     * @param _str view of the xPL message in raw form.
+     * @param _lines table of the lines in _str.
+     * @param _pIndex index of the line from which to start reading.  On
+     * return it is the index of the line from which to continue reading.
+     * Lines containing only whitespace are skipped.
+     * @param _pName pointer to a view that will be set to
      * the name part of the name=value pair.
-     * @param _pValue pointer to a string that will be filled with
+     * @param _pValue pointer to a view that will be set to
      * the value part of the name=value pair.
-     * @return The position in the string from which to continue reading.
      */
-    static int32 ReadNameValuePair ( string const& _str, int32 const _start, string* _pName, string* _pValue );
+    static void ReadNameValuePair ( XplStringView const& _str, XplLineTable const& _lines, uint32* _pIndex, XplStringView* _pName, XplStringView* _pValue );
+
+    /**
+     * Helper method for reading the next non-empty line from a buffer.
+     * Used for the header, which is only a few lines long.
+     * @param _str view of the xPL message in raw form.
+     * @param _start the position in the buffer from which to start reading.
+     * @param _pLine pointer to a view that will be set to the trimmed
+     * line, or to an empty view at the end of the data.
+     * @return The position in the buffer from which to continue reading.
+     */
+    static uint32 ReadLine ( XplStringView const& _str, uint32 const _start, XplStringView* _pLine );
+
+    /**
+     * Gets the length of the message text in a receive buffer.  Some
+     * senders add a zero byte or padding after the message, so the text
+     * stops at the first zero byte, as it did when the buffer was read
+     * as a C string.
+     * @param _pData the received data.
+     * @param _size the number of bytes received.
+     * @return the number of bytes before the first zero byte, or _size.
+     */
+    static uint32 GetTextSize ( char const* _pData, uint32 const _size )
+    {
+        void const* pEnd = memchr ( _pData, 0, _size );
+        return pEnd ? ( uint32 ) ( static_cast<char const*> ( pEnd ) - _pData ) : _size;
+    }
+
+    /**
+     * Helper method for mapping a message type onto one of the type constants.
+     * @param _type the message type, with or without the "xpl-" prefix.
+     * @return Pointer to c_xplCmnd, c_xplTrig or c_xplStat, or NULL if the
+     * type is not valid.
+     */
+    static string const* FindType ( XplStringView const& _type );
 
     /**
      * Helper method for deleting the raw data buffer.
+     * If the body is still held as pairs in the raw data, it is copied
+     * out into XplMsgItems first.
      */
     void InvalidateRawData();
 
-    //handles reading in data from a raw message
-    void ParseFromString ( string );
+    /**
+     * Copies the values of a name into a new XplMsgItem.
+     * @param _nameIndex index of the name in m_names.
+     */
+    AutoPtr<XplMsgItem> MakeMsgItem ( uint32 const _nameIndex ) const;
+
+    /**
+     * Fills in m_names and m_nameIndex from the pairs,
+     * if that has not already been done.
+     */
+    void BuildNameIndex() const;
+
+    /**
+     * Does the work of BuildNameIndex.  Called with m_lazyLock held.
+     */
+    void IndexNames() const;
+
+    /**
+     * Fills in the pairs from the raw data, if that has not already
+     * been done.
+     */
+    void EnsureTokenized() const;
+
+    /**
+     * Adds a pair to the list of pairs with the same name.
+     * @param _pair index of the pair, which must be the last one so far.
+     */
+    void LinkPair ( uint32 const _pair ) const;
+
+    /**
+     * Looks up a name in m_nameIndex.
+     * @param _name the name to look for, in any case.
+     * @param _hash the name's hash, from XplNameIndex::Hash.
+     * @return The index of the name in m_names, or c_noPair.
+     */
+    uint32 FindName ( XplStringView const& _name, uint32 const _hash ) const;
+
+    /**
+     * Finds the pair holding a value.
+     * @param _name the name of the value, in any case.
+     * @param _index which of the name's values is wanted.
+     * @return The index of the pair in m_pairs, or c_noPair.
+     */
+    uint32 FindPair ( XplStringView const& _name, uint32 const _index ) const;
+
+    /**
+     * Adds some text to the end of m_arena.
+     * @return The position of the text in m_arena.
+     */
+    Slice AppendToArena ( XplStringView const& _str );
+
+    /**
+     * Rebuilds m_arena with only the text that is still in use.
+     */
+    void CompactArena();
+
+    /**
+     * Gets a view of a name or value from the body.
+     */
+    XplStringView GetSlice ( Slice const& _slice ) const
+    {
+        char const* pBody = m_bBodyInRaw ? m_raw.data() : m_arena.data();
+        return XplStringView ( pBody + _slice.m_pos, _slice.m_len );
+    }
+
+    /**
+     * Works out the size of the message when formatted from its fields.
+     */
+    uint32 CalcRawSize() const;
+
+    /**
+     * Formats the message from its fields into a buffer that is
+     * at least CalcRawSize() bytes long.
+     */
+    void FormatRawData ( char* _pBuffer ) const;
+
+    //handles reading in data from a raw message held in m_raw
+    void ParseRawData ( bool const _bParseBody );
+
+    /**
+     * Copies a schema class or type into the message in lower case.
+     * @param _str the name, which must be between one and c_maxSchemaLen
+     * characters long.
+     * @param _bIntern true to add the name to XplSymbolTable if it is not
+     * there already.  Received messages only look names up.
+     * @param _pText the buffer to copy the name into.
+     * @param _pLen filled in with the length of the name.
+     * @return the XplSymbolTable ID of the name, or c_none.
+     */
+    static uint32 StoreSchemaName ( XplStringView const& _str, bool const _bIntern, char* _pText, uint8* _pLen );
+
+    /**
+     * Records the positions of the name=value pairs in the body.
+     * @return False if the data ended before the closing brace.
+     */
+    bool TokenizeBody() const;
 
     // Header elements
     int32						m_hop;
     string						m_type;
-    XPLAddress						m_source;
-    XPLAddress						m_target;
+    XplAddress						m_source;
+    XplAddress						m_target;
 
     // Body elements
-    string						m_schemaClass;
-    string						m_schemaType;
-    vector<AutoPtr<XplMsgItem> >			m_msgItems;
+    uint32						m_schemaClassId;		// XplSymbolTable IDs, or c_none
+    uint32						m_schemaTypeId;
+    uint8						m_schemaClassLen;
+    uint8						m_schemaTypeLen;
+    char						m_schemaClass[c_maxSchemaLen];	// Lower case, not terminated
+    char						m_schemaType[c_maxSchemaLen];
+    mutable vector<Pair>		m_pairs;				// The body, as positions within m_raw or m_arena
+    bool						m_bBodyInRaw;			// True while m_pairs refers to m_raw
+    string						m_arena;				// Names and values once the body has been modified
+    uint32						m_arenaWaste;			// Bytes in m_arena that are no longer used
+    mutable vector<Name>		m_names;				// Distinct names, in the order they first appear
+    mutable XplNameIndex		m_nameIndex;			// Hashes of the names, mapped to m_names
+    mutable bool				m_bNamesValid;			// False until m_names has been built from m_pairs
+    mutable bool				m_bBodyParsed;			// False until m_pairs has been filled in
+    uint32						m_bodyStart;			// Position in m_raw just after the body's opening brace
+    mutable XplLineTable		m_lines;				// Lines of the body, kept to reuse the memory
+    mutable FastMutex			m_lazyLock;				// Held while the parts built on first use are filled in
 
     // Raw data
-    string						m_raw;
+    mutable string				m_raw;
+
+    // Pooled buffers
+    Storage*					m_pStorage;				// Holds our empty buffers while we use the pool's
 
     // Reference counting
     uint32						m_refCount;
@@ -131,6 +131,28 @@ string const XplMsgItem::GetValue
     return ( m_values[_index] );
 }
 
+
+/***************************************************************************
+****																	****
+****	XplMsgItem::GetValueView										****
+****																	****
+***************************************************************************/
+
+bool XplMsgItem::GetValueView
+(
+    uint32 const _index,
+    XplStringView* _pValue
+) const
+{
+    if ( _index >= m_values.size() )
+    {
+        return false;
+    }
+
+    *_pValue = XplStringView ( m_values[_index] );
+    return true;
+}
+
 vector<string> const XplMsgItem::GetValues () const
 {
     m_values;
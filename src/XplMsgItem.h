@@ -39,6 +39,7 @@
 #include <string>
 #include <vector>
 #include "XplCore.h"
+#include "XplStringView.h"
 
 #include "Poco/RefCountedObject.h"
 
@@ -98,6 +99,16 @@ public:
      */
     string const GetValue ( const uint32 _index = 0 ) const;
 
+    /**
+     * Gets a specific value without copying it.
+     * @param _index The index of the value to retrieve.
+     * @param _pValue pointer to a view that will be set to the value.  The
+     * view is only valid until this item is modified or destroyed.
+     * @return False if the index was out of range.
+     * @see GetValue
+     */
+    bool GetValueView ( const uint32 _index, XplStringView* _pValue ) const;
+
     vector<string> const GetValues () const;
     
     /**
@@ -0,0 +1,156 @@
+/***************************************************************************
+****																	****
+****	XplMsgTemplate.cpp												****
+****																	****
+****	Pre-rendered xPL messages with patchable fields					****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include "XplCore.h"
+#include "XplMsg.h"
+#include "XplMsgTemplate.h"
+
+using namespace xpl;
+
+// Spare room for values that grow
+static uint32 const c_spareCapacity = 64;
+
+
+/***************************************************************************
+****																	****
+****	XplMsgTemplate Constructor										****
+****																	****
+***************************************************************************/
+
+XplMsgTemplate::XplMsgTemplate
+(
+    XplMsg const& _msg
+) :
+    m_raw ( _msg.GetRawData() )
+{
+    m_raw.reserve ( m_raw.size() + c_spareCapacity );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsgTemplate::AddField										****
+****																	****
+***************************************************************************/
+
+int32 XplMsgTemplate::AddField
+(
+    string const& _name,
+    uint32 const _index /*=0*/
+)
+{
+    // Let the parser find the value.  The parsed copy is laid
+    // out exactly like m_raw, so the offsets carry across.
+    AutoPtr<XplMsg> pMsg = new XplMsg ( m_raw );
+
+    XplStringView value;
+    if ( !pMsg->GetValueView ( _name, &value, _index ) )
+    {
+        return -1;
+    }
+
+    Field field;
+    field.m_pos = ( uint32 ) ( value.data() - pMsg->GetRawData().data() );
+    field.m_len = value.size();
+    m_fields.push_back ( field );
+    return ( int32 ) ( m_fields.size() - 1 );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsgTemplate::SetField										****
+****																	****
+***************************************************************************/
+
+void XplMsgTemplate::SetField
+(
+    uint32 const _field,
+    XplStringView const& _value
+)
+{
+    if ( _field >= m_fields.size() )
+    {
+        // Index out of range
+        assert ( 0 );
+        return;
+    }
+
+    Field& field = m_fields[_field];
+    if ( field.m_len == _value.size() )
+    {
+        // Same length, so just copy over the old value
+        memcpy ( &m_raw[field.m_pos], _value.data(), _value.size() );
+        return;
+    }
+
+    // Make room for the new value, then move along
+    // any fields that come after this one.
+    int32 const delta = ( int32 ) _value.size() - ( int32 ) field.m_len;
+    m_raw.replace ( field.m_pos, field.m_len, _value.data(), _value.size() );
+    for ( vector<Field>::iterator iter = m_fields.begin(); iter != m_fields.end(); ++iter )
+    {
+        if ( iter->m_pos > field.m_pos )
+        {
+            iter->m_pos += delta;
+        }
+    }
+    field.m_len = _value.size();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplMsgTemplate::SetField										****
+****																	****
+***************************************************************************/
+
+void XplMsgTemplate::SetField
+(
+    uint32 const _field,
+    uint32 const _value
+)
+{
+    char digits[12];
+    char* pEnd = digits + sizeof ( digits );
+    char* p = pEnd;
+    uint32 value = _value;
+    do
+    {
+        *--p = ( char ) ( '0' + ( value % 10 ) );
+        value /= 10;
+    }
+    while ( value );
+
+    SetField ( _field, XplStringView ( p, ( uint32 ) ( pEnd - p ) ) );
+}
@@ -0,0 +1,126 @@
+/***************************************************************************
+****																	****
+****	XplMsgTemplate.h												****
+****																	****
+****	Pre-rendered xPL messages with patchable fields					****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplMsgTemplate_H
+#define _XplMsgTemplate_H
+
+#include <string>
+#include <vector>
+#include "XplCore.h"
+#include "XplStringView.h"
+#include "Poco/RefCountedObject.h"
+
+using namespace Poco;
+
+namespace xpl
+{
+
+class XplMsg;
+
+/**
+ * A message that is formatted once and then sent over and over.
+ * Periodic messages such as heartbeats are the same every time apart from
+ * a few values.  An XplMsgTemplate takes the raw data of such a message, and
+ * remembers where the values that change are within it.  Each of those
+ * values can then be replaced directly in the raw data before the message
+ * is sent, with no need to build and format a new XplMsg.
+ * <p>
+ * If a new value is the same length as the old one it is simply copied over
+ * it.  If not, the rest of the message is moved up or down to make room.
+ * Some spare space is reserved when the template is created, so that
+ * normally happens without any memory being allocated either.
+ */
+class XplMsgTemplate: public RefCountedObject
+{
+public:
+    /**
+     * Creates a template from a message.
+     * @param _msg the message.  Its raw data is copied, so the message
+     * is no longer needed once the template has been created.
+     */
+    XplMsgTemplate ( XplMsg const& _msg );
+
+    /**
+     * Marks a value in the message body as one that will be changed.
+     * @param _name name of the name=value pair.
+     * @param _index the value index, for names with more than one value.
+     * For a more detailed description of how the indexing works, @see XplMsg::SetValue.
+     * @return The index to pass to SetField, or -1 if the message has no
+     * such value.
+     */
+    int32 AddField ( string const& _name, uint32 const _index = 0 );
+
+    /**
+     * Replaces the value of a field in the raw data.
+     * @param _field index of the field, as returned by AddField.
+     * @param _value the new value.
+     */
+    void SetField ( uint32 const _field, XplStringView const& _value );
+
+    /**
+     * Replaces the value of a field in the raw data with a number.
+     * @param _field index of the field, as returned by AddField.
+     * @param _value the new value.
+     */
+    void SetField ( uint32 const _field, uint32 const _value );
+
+    /**
+     * Gets the message in it's raw data form, with the current field values.
+     * @return A reference to the raw data.  It is only valid until the
+     * next call to SetField.
+     */
+    string const& GetRawData() const
+    {
+        return m_raw;
+    }
+
+private:
+    /**
+     * Position of a field value within m_raw.
+     */
+    struct Field
+    {
+        uint32	m_pos;
+        uint32	m_len;
+    };
+
+    string			m_raw;
+    vector<Field>	m_fields;
+
+}; // class XplMsgTemplate
+
+} // namespace xpl
+
+#endif // _XplMsgTemplate_H
@@ -0,0 +1,211 @@
+/***************************************************************************
+****																	****
+****	XplNameIndex.cpp												****
+****																	****
+****	Case-insensitive hash index for names							****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include <algorithm>
+#include "XplCore.h"
+#include "XplNameIndex.h"
+
+using namespace xpl;
+
+// Number of slots in a new table.  Must be a power of two.
+static uint32 const c_initialSlots = 16;
+
+
+/***************************************************************************
+****																	****
+****	XplNameIndex Constructor										****
+****																	****
+***************************************************************************/
+
+XplNameIndex::XplNameIndex() :
+    m_mask ( 0 ),
+    m_count ( 0 )
+{
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNameIndex::Hash												****
+****																	****
+****	FNV-1a, with ASCII letters folded to lower case.				****
+****																	****
+***************************************************************************/
+
+uint32 XplNameIndex::Hash
+(
+    XplStringView const& _name
+)
+{
+    uint32 hash = 2166136261u;
+    char const* p = _name.data();
+    char const* pEnd = p + _name.size();
+    for ( ; p != pEnd; ++p )
+    {
+        unsigned char ch = ( unsigned char ) *p;
+        if ( ( ch >= 'A' ) && ( ch <= 'Z' ) )
+        {
+            ch |= 0x20;
+        }
+        hash = ( hash ^ ch ) * 16777619u;
+    }
+    return hash;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNameIndex::Clear												****
+****																	****
+***************************************************************************/
+
+void XplNameIndex::Clear()
+{
+    for ( vector<Slot>::iterator iter = m_slots.begin(); iter != m_slots.end(); ++iter )
+    {
+        iter->m_value = c_empty;
+    }
+    m_count = 0;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNameIndex::Swap												****
+****																	****
+***************************************************************************/
+
+void XplNameIndex::Swap
+(
+    XplNameIndex& _other
+)
+{
+    m_slots.swap ( _other.m_slots );
+    std::swap ( m_mask, _other.m_mask );
+    std::swap ( m_count, _other.m_count );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNameIndex::Insert											****
+****																	****
+***************************************************************************/
+
+void XplNameIndex::Insert
+(
+    uint32 const _hash,
+    uint32 const _value
+)
+{
+    // Keep the table at most half full
+    if ( ( m_count + 1 ) * 2 > m_slots.size() )
+    {
+        Grow();
+    }
+
+    uint32 slot = _hash & m_mask;
+    while ( c_empty != m_slots[slot].m_value )
+    {
+        slot = ( slot + 1 ) & m_mask;
+    }
+
+    m_slots[slot].m_hash = _hash;
+    m_slots[slot].m_value = _value;
+    ++m_count;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNameIndex::Next												****
+****																	****
+***************************************************************************/
+
+bool XplNameIndex::Next
+(
+    uint32 const _hash,
+    uint32* _pSlot,
+    uint32* _pValue
+) const
+{
+    if ( m_slots.empty() )
+    {
+        return false;
+    }
+
+    // Carry on until an empty slot ends the run
+    uint32 slot = *_pSlot;
+    while ( c_empty != m_slots[slot].m_value )
+    {
+        Slot const& entry = m_slots[slot];
+        slot = ( slot + 1 ) & m_mask;
+        if ( entry.m_hash == _hash )
+        {
+            *_pSlot = slot;
+            *_pValue = entry.m_value;
+            return true;
+        }
+    }
+
+    *_pSlot = slot;
+    return false;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNameIndex::Grow												****
+****																	****
+***************************************************************************/
+
+void XplNameIndex::Grow()
+{
+    vector<Slot> oldSlots;
+    oldSlots.swap ( m_slots );
+
+    Slot empty;
+    empty.m_hash = 0;
+    empty.m_value = c_empty;
+    m_slots.resize ( oldSlots.empty() ? c_initialSlots : oldSlots.size() * 2, empty );
+    m_mask = ( uint32 ) m_slots.size() - 1;
+    m_count = 0;
+
+    for ( vector<Slot>::const_iterator iter = oldSlots.begin(); iter != oldSlots.end(); ++iter )
+    {
+        if ( c_empty != iter->m_value )
+        {
+            Insert ( iter->m_hash, iter->m_value );
+        }
+    }
+}
@@ -0,0 +1,141 @@
+/***************************************************************************
+****																	****
+****	XplNameIndex.h													****
+****																	****
+****	Case-insensitive hash index for names							****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplNameIndex_H
+#define _XplNameIndex_H
+
+#include <vector>
+#include "XplCore.h"
+#include "XplStringView.h"
+
+namespace xpl
+{
+
+/**
+ * Hash table for finding things by a name, ignoring case.
+ * The index does not hold the names themselves.  It maps the hash of a name
+ * onto a number chosen by the owner (typically an index into the owner's own
+ * array), and the owner checks the name of each candidate it is given.  The
+ * table uses open addressing with linear probing, and grows to keep itself
+ * no more than half full, so a lookup normally touches a single slot.
+ * <p>
+ * Hash() folds the case of each character as it goes, so no lower case copy
+ * of a name is ever needed.
+ * <p>
+ * Usage:
+ * <pre>
+ *     uint32 hash = XplNameIndex::Hash ( name );
+ *     uint32 slot = index.Begin ( hash );
+ *     uint32 value;
+ *     while ( index.Next ( hash, &slot, &value ) )
+ *     {
+ *         if ( name.equalsNoCase ( GetName ( value ) ) ) ...
+ *     }
+ * </pre>
+ */
+class XplNameIndex
+{
+public:
+    XplNameIndex();
+
+    /**
+     * Works out the hash of a name.  Upper and lower case letters
+     * give the same result.
+     */
+    static uint32 Hash ( XplStringView const& _name );
+
+    /**
+     * Removes everything from the index, but keeps the memory for reuse.
+     */
+    void Clear();
+
+    /**
+     * Exchanges the contents, and memory, of two indexes.
+     */
+    void Swap ( XplNameIndex& _other );
+
+    /**
+     * Adds an entry.  Entries with the same hash, or even the same
+     * name, are all kept.
+     * @param _hash hash of the name, from Hash().
+     * @param _value the number to be returned for this name.
+     */
+    void Insert ( uint32 const _hash, uint32 const _value );
+
+    /**
+     * Gets the slot from which to start looking for a hash.
+     */
+    uint32 Begin ( uint32 const _hash ) const
+    {
+        return _hash & m_mask;
+    }
+
+    /**
+     * Gets the next entry that may match a hash.
+     * @param _hash hash of the name being looked for.
+     * @param _pSlot slot from which to continue.  Start with Begin().
+     * @param _pValue set to the value of the entry.
+     * @return False when there are no more candidates.
+     */
+    bool Next ( uint32 const _hash, uint32* _pSlot, uint32* _pValue ) const;
+
+    uint32 GetCount() const
+    {
+        return m_count;
+    }
+
+private:
+    struct Slot
+    {
+        uint32	m_hash;
+        uint32	m_value;		// c_empty if the slot is free
+    };
+
+    static uint32 const c_empty = 0xffffffff;
+
+    /**
+     * Doubles the size of the table and puts the entries back in.
+     */
+    void Grow();
+
+    vector<Slot>	m_slots;
+    uint32			m_mask;		// Number of slots minus one
+    uint32			m_count;
+
+}; // class XplNameIndex
+
+} // namespace xpl
+
+#endif // _XplNameIndex_H
@@ -0,0 +1,563 @@
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher.cpp									****
+****																	****
+****	Delivers notifications to observers inline or on worker threads	****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include "XplCore.h"
+#include "XplNotificationDispatcher.h"
+#include "Poco/NumberFormatter.h"
+#include "Poco/ErrorHandler.h"
+
+using namespace xpl;
+using Poco::FastMutex;
+using Poco::SharedPtr;
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher Constructor							****
+****																	****
+***************************************************************************/
+
+XplNotificationDispatcher::XplNotificationDispatcher
+(
+    uint32 const _numWorkers
+) :
+    m_pObservers ( new Observers() ),
+    m_numPooled ( 0 ),
+    m_numWorkers ( _numWorkers ? _numWorkers : 1 ),
+    m_queueSize ( kDefaultQueueSize ),
+    m_maxDepth ( 0 )
+{
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher Destructor							****
+****																	****
+***************************************************************************/
+
+XplNotificationDispatcher::~XplNotificationDispatcher()
+{
+    StopWorkers();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::addObserver							****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::addObserver
+(
+    AbstractObserver const& _observer,
+    Mode const _mode
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+
+    Entry entry;
+    entry.m_pObserver = _observer.clone();
+    entry.m_mode = _mode;
+    AddEntry ( entry, NULL );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::addObserver							****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::addObserver
+(
+    AbstractObserver const& _observer,
+    uint32 const _topic,
+    Filter* _pFilter,
+    Mode const _mode
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+
+    Entry entry;
+    entry.m_pObserver = _observer.clone();
+    entry.m_pFilter = Poco::AutoPtr<Filter> ( _pFilter, true );
+    entry.m_mode = _mode;
+    AddEntry ( entry, &_topic );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::AddEntry								****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::AddEntry
+(
+    Entry const& _entry,
+    uint32 const* _pTopic
+)
+{
+    SharedPtr<Observers> pObservers = new Observers ( *m_pObservers );
+    if ( _pTopic )
+    {
+        pObservers->m_byTopic[*_pTopic].push_back ( _entry );
+    }
+    else
+    {
+        pObservers->m_all.push_back ( _entry );
+    }
+    m_pObservers = pObservers;
+
+    if ( kPooled == _entry.m_mode )
+    {
+        ++m_numPooled;
+        if ( m_workers.empty() )
+        {
+            StartWorkers();
+        }
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::removeObserver						****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::removeObserver
+(
+    AbstractObserver const& _observer
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+
+    SharedPtr<Observers> pObservers = new Observers ( *m_pObservers );
+
+    // Look through the observers without a topic first, then each topic
+    ObserverList* pList = &pObservers->m_all;
+    map<uint32, ObserverList>::iterator topicIter = pObservers->m_byTopic.begin();
+    while ( 1 )
+    {
+        for ( ObserverList::iterator iter = pList->begin(); iter != pList->end(); ++iter )
+        {
+            if ( _observer.equals ( *iter->m_pObserver ) )
+            {
+                // Any copies of the list still held by queued tasks
+                // share the observer, so this stops them calling it too.
+                iter->m_pObserver->disable();
+                if ( kPooled == iter->m_mode )
+                {
+                    --m_numPooled;
+                }
+                pList->erase ( iter );
+                if ( pList->empty() && ( pList != &pObservers->m_all ) )
+                {
+                    pObservers->m_byTopic.erase ( topicIter );
+                }
+                m_pObservers = pObservers;
+                return;
+            }
+        }
+
+        if ( pList != &pObservers->m_all )
+        {
+            ++topicIter;
+        }
+        if ( topicIter == pObservers->m_byTopic.end() )
+        {
+            return;
+        }
+        pList = &topicIter->second;
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::postNotification						****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::postNotification
+(
+    Notification::Ptr _pNotification
+)
+{
+    postNotification ( _pNotification, 0 );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::postNotification						****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::postNotification
+(
+    Notification::Ptr _pNotification,
+    uint32 const _key
+)
+{
+    postNotification ( _pNotification, _key, NULL, 0 );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::postNotification						****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::postNotification
+(
+    Notification::Ptr _pNotification,
+    uint32 const _key,
+    uint32 const* _pTopics,
+    uint32 _numTopics
+)
+{
+    if ( _numTopics > kMaxTopics )
+    {
+        _numTopics = kMaxTopics;
+    }
+
+    SharedPtr<Observers> pObservers;
+    bool bPooled;
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        pObservers = m_pObservers;
+        bPooled = ( m_numPooled > 0 );
+    }
+
+    // The inline observers are called first, without the lock,
+    // so they are free to add and remove observers.
+    Notify ( *pObservers, kInline, _pNotification, _pTopics, _numTopics );
+
+    if ( bPooled )
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        if ( !m_workers.empty() )
+        {
+            Poco::NotificationQueue& queue = m_workers[_key % m_workers.size()]->m_queue;
+
+            // Make room by dropping the oldest notifications, so a stuck
+            // observer cannot use up all the memory.
+            while ( m_queueSize && ( queue.size() >= ( int ) m_queueSize ) )
+            {
+                Notification::Ptr pOldest ( queue.dequeueNotification() );
+                if ( pOldest.isNull() )
+                {
+                    break;
+                }
+                ++m_dropped;
+            }
+
+            queue.enqueueNotification ( new Task ( pObservers, _pNotification, _pTopics, _numTopics ) );
+            ++m_queued;
+
+            uint32 const depth = ( uint32 ) queue.size();
+            if ( depth > m_maxDepth )
+            {
+                m_maxDepth = depth;
+            }
+        }
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::hasObservers							****
+****																	****
+***************************************************************************/
+
+bool XplNotificationDispatcher::hasObservers() const
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    return !m_pObservers->m_all.empty() || !m_pObservers->m_byTopic.empty();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::countObservers						****
+****																	****
+***************************************************************************/
+
+size_t XplNotificationDispatcher::countObservers() const
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    size_t count = m_pObservers->m_all.size();
+    for ( map<uint32, ObserverList>::const_iterator iter = m_pObservers->m_byTopic.begin(); iter != m_pObservers->m_byTopic.end(); ++iter )
+    {
+        count += iter->second.size();
+    }
+    return count;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::HasPooledObservers					****
+****																	****
+***************************************************************************/
+
+bool XplNotificationDispatcher::HasPooledObservers() const
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    return ( m_numPooled > 0 );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::SetNumWorkers						****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::SetNumWorkers
+(
+    uint32 const _numWorkers
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    if ( m_workers.empty() )
+    {
+        m_numWorkers = _numWorkers ? _numWorkers : 1;
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::SetQueueSize							****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::SetQueueSize
+(
+    uint32 const _queueSize
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    m_queueSize = _queueSize;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::GetQueueStats						****
+****																	****
+***************************************************************************/
+
+XplNotificationDispatcher::QueueStats XplNotificationDispatcher::GetQueueStats() const
+{
+    FastMutex::ScopedLock lock ( m_lock );
+
+    QueueStats stats;
+    stats.queued = ( uint32 ) m_queued.value();
+    stats.dispatched = ( uint32 ) m_dispatched.value();
+    stats.dropped = ( uint32 ) m_dropped.value();
+    stats.depth = 0;
+    for ( uint32 i=0; i<m_workers.size(); ++i )
+    {
+        stats.depth += ( uint32 ) m_workers[i]->m_queue.size();
+    }
+    stats.maxDepth = m_maxDepth;
+    stats.capacity = m_queueSize;
+    return stats;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::StartWorkers							****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::StartWorkers()
+{
+    for ( uint32 i=0; i<m_numWorkers; ++i )
+    {
+        Worker* pWorker = new Worker ( m_dispatched );
+        pWorker->m_thread.setName ( "notification worker " + Poco::NumberFormatter::format ( i ) );
+        pWorker->m_thread.start ( *pWorker );
+        m_workers.push_back ( pWorker );
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::StopWorkers							****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::StopWorkers()
+{
+    vector<Worker*> workers;
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        workers.swap ( m_workers );
+    }
+
+    // A plain Notification tells a worker to stop, once it
+    // has handled everything queued before it.
+    for ( uint32 i=0; i<workers.size(); ++i )
+    {
+        workers[i]->m_queue.enqueueNotification ( new Notification() );
+    }
+    for ( uint32 i=0; i<workers.size(); ++i )
+    {
+        workers[i]->m_thread.join();
+        delete workers[i];
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::Notify								****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::Notify
+(
+    ObserverList const& _observers,
+    Mode const _mode,
+    Notification* _pNotification
+)
+{
+    for ( ObserverList::const_iterator iter = _observers.begin(); iter != _observers.end(); ++iter )
+    {
+        if ( ( _mode == iter->m_mode ) && ( iter->m_pFilter.isNull() || iter->m_pFilter->Accepts ( _pNotification ) ) )
+        {
+            iter->m_pObserver->notify ( _pNotification );
+        }
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::Notify								****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::Notify
+(
+    Observers const& _observers,
+    Mode const _mode,
+    Notification* _pNotification,
+    uint32 const* _pTopics,
+    uint32 const _numTopics
+)
+{
+    Notify ( _observers.m_all, _mode, _pNotification );
+
+    for ( uint32 i=0; i<_numTopics; ++i )
+    {
+        // Visit each topic once, even if it is listed twice
+        bool bRepeated = false;
+        for ( uint32 j=0; j<i; ++j )
+        {
+            bRepeated |= ( _pTopics[j] == _pTopics[i] );
+        }
+        if ( bRepeated )
+        {
+            continue;
+        }
+
+        map<uint32, ObserverList>::const_iterator iter = _observers.m_byTopic.find ( _pTopics[i] );
+        if ( iter != _observers.m_byTopic.end() )
+        {
+            Notify ( iter->second, _mode, _pNotification );
+        }
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::Task::Run							****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::Task::Run()
+{
+    Notify ( *m_pObservers, kPooled, m_pNotification, m_topics, m_numTopics );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher::Worker::run							****
+****																	****
+***************************************************************************/
+
+void XplNotificationDispatcher::Worker::run()
+{
+    while ( 1 )
+    {
+        Notification::Ptr pNotification ( m_queue.waitDequeueNotification() );
+        Task* pTask = dynamic_cast<Task*> ( pNotification.get() );
+        if ( NULL == pTask )
+        {
+            break;
+        }
+
+        // Keep going if an observer throws, as the other
+        // notifications in the queue still need delivering.
+        try
+        {
+            pTask->Run();
+        }
+        catch ( Poco::Exception& e )
+        {
+            Poco::ErrorHandler::handle ( e );
+        }
+        catch ( std::exception& e )
+        {
+            Poco::ErrorHandler::handle ( e );
+        }
+        catch ( ... )
+        {
+            Poco::ErrorHandler::handle();
+        }
+        ++m_dispatched;
+    }
+}
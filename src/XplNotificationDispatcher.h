@@ -0,0 +1,322 @@
+/***************************************************************************
+****																	****
+****	XplNotificationDispatcher.h										****
+****																	****
+****	Delivers notifications to observers inline or on worker threads	****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplNotificationDispatcher_H
+#define _XplNotificationDispatcher_H
+
+#include <vector>
+#include <map>
+#include "XplCore.h"
+#include "Poco/AbstractObserver.h"
+#include "Poco/Notification.h"
+#include "Poco/NotificationQueue.h"
+#include "Poco/SharedPtr.h"
+#include "Poco/AutoPtr.h"
+#include "Poco/RefCountedObject.h"
+#include "Poco/Mutex.h"
+#include "Poco/Thread.h"
+#include "Poco/Runnable.h"
+#include "Poco/AtomicCounter.h"
+
+using Poco::AbstractObserver;
+using Poco::Notification;
+
+namespace xpl
+{
+
+/**
+ * Replacement for Poco's NotificationCenter that can call observers on
+ * a pool of worker threads.
+ * It has the same addObserver, removeObserver and postNotification
+ * methods, so code written for a NotificationCenter does not need to
+ * change.  Observers added that way are called inline, one after another
+ * on the thread that posts the notification, just as before.
+ * <p>
+ * An observer added with kPooled is instead called on one of the worker
+ * threads, so a slow handler (a database write, say) does not hold up the
+ * thread that posted the notification.  Each notification can be given a
+ * key.  All the notifications with the same key go to the same worker, so
+ * the pooled observers see them in the order they were posted.  Different
+ * keys may be handled at the same time on different workers.
+ * <p>
+ * An observer can also be added for a single topic.  A topic is just a
+ * number, such as a hash of the things the observer is interested in, and
+ * each notification is posted with the topics it belongs to.  Observers are
+ * kept in a map by topic, so posting a notification only visits the
+ * observers of its own topics, however many others there are.  A Filter
+ * can be added with the observer to look more closely at the notification
+ * before it is called.
+ * <p>
+ * The workers are only started when the first pooled observer is added.
+ * Each worker's queue holds at most GetQueueSize() notifications.  If a
+ * worker falls that far behind, the oldest notification in its queue is
+ * thrown away to make room, as XplUDP does with its receive queue.
+ */
+class XplNotificationDispatcher
+{
+public:
+    enum Mode
+    {
+        kInline = 0,		// Called on the posting thread
+        kPooled				// Called on a worker thread
+    };
+
+    /**
+     * Further test applied to a notification before an observer that was
+     * added with it is called.
+     */
+    class Filter: public Poco::RefCountedObject
+    {
+    public:
+        /**
+         * @return true if the observer should be called.
+         */
+        virtual bool Accepts ( Notification* _pNotification ) const = 0;
+    };
+
+    // The most topics a notification can be posted to
+    static uint32 const kMaxTopics = 4;
+
+    // Default for the most notifications waiting for each worker
+    static uint32 const kDefaultQueueSize = 1024;
+
+    /**
+     * Constructor.
+     * @param _numWorkers the number of worker threads to start once a
+     * pooled observer is added.
+     */
+    XplNotificationDispatcher ( uint32 const _numWorkers = 2 );
+
+    /**
+     * Destructor.  Waits for the workers to finish the notifications
+     * they have already been given.
+     */
+    ~XplNotificationDispatcher();
+
+    /**
+     * Adds an observer.  The dispatcher keeps its own copy.
+     * @param _observer the observer.
+     * @param _mode whether to call it inline or on a worker thread.
+     */
+    void addObserver ( AbstractObserver const& _observer, Mode const _mode = kInline );
+
+    /**
+     * Adds an observer for one topic.
+     * @param _observer the observer.
+     * @param _topic the only topic it is called for.
+     * @param _pFilter if not NULL, only notifications accepted by this
+     * filter are passed to the observer.  The dispatcher keeps a reference.
+     * @param _mode whether to call it inline or on a worker thread.
+     */
+    void addObserver ( AbstractObserver const& _observer, uint32 const _topic, Filter* _pFilter, Mode const _mode = kInline );
+
+    /**
+     * Removes an observer.  A pooled observer may still be in the middle
+     * of handling a notification, but will not be called again.
+     * @param _observer an observer equal to the one that was added.
+     */
+    void removeObserver ( AbstractObserver const& _observer );
+
+    /**
+     * Delivers a notification to all the observers, in the order of the
+     * posting thread.  The dispatcher takes ownership of the notification.
+     */
+    void postNotification ( Notification::Ptr _pNotification );
+
+    /**
+     * Delivers a notification to all the observers.
+     * @param _pNotification the notification.  The dispatcher takes ownership.
+     * @param _key notifications with the same key are handled in order by
+     * the pooled observers.
+     */
+    void postNotification ( Notification::Ptr _pNotification, uint32 const _key );
+
+    /**
+     * Delivers a notification to the observers that were added without a
+     * topic, and to those added for any of the given topics.
+     * @param _pNotification the notification.  The dispatcher takes ownership.
+     * @param _key notifications with the same key are handled in order by
+     * the pooled observers.
+     * @param _pTopics the topics of the notification.
+     * @param _numTopics the number of topics, up to kMaxTopics.
+     */
+    void postNotification ( Notification::Ptr _pNotification, uint32 const _key, uint32 const* _pTopics, uint32 _numTopics );
+
+    bool hasObservers() const;
+    size_t countObservers() const;
+
+    /**
+     * Checks whether any observers are called on the worker threads.
+     * Anything shared by the notification must then be safe to read from
+     * more than one thread.
+     */
+    bool HasPooledObservers() const;
+
+    /**
+     * Sets the number of worker threads.  Only has an effect before the
+     * first pooled observer is added.
+     */
+    void SetNumWorkers ( uint32 const _numWorkers );
+
+    /**
+     * Sets how many notifications may wait for each worker thread.
+     * @param _queueSize the most notifications in a worker's queue.  When
+     * a notification is posted to a full queue, the oldest one in it is
+     * dropped.  Zero lets the queues grow without limit.
+     */
+    void SetQueueSize ( uint32 const _queueSize );
+
+    /**
+     * Counters for the worker queues, added up over all the workers.
+     */
+    struct QueueStats
+    {
+        uint32	queued;			// Notifications given to the workers
+        uint32	dispatched;		// Notifications the workers have handled
+        uint32	dropped;		// Notifications thrown away because a queue was full
+        uint32	depth;			// Notifications in the queues right now
+        uint32	maxDepth;		// Most notifications there have been in one queue
+        uint32	capacity;		// Size of each queue, or zero if there is no limit
+    };
+
+    /**
+     * Gets the counters for the worker queues.
+     */
+    QueueStats GetQueueStats() const;
+
+private:
+    // Not copyable
+    XplNotificationDispatcher ( XplNotificationDispatcher const& );
+    XplNotificationDispatcher& operator = ( XplNotificationDispatcher const& );
+
+    struct Entry
+    {
+        Poco::SharedPtr<AbstractObserver>	m_pObserver;
+        Poco::AutoPtr<Filter>				m_pFilter;
+        Mode								m_mode;
+    };
+    typedef vector<Entry> ObserverList;
+
+    struct Observers
+    {
+        ObserverList				m_all;			// Observers added without a topic
+        map<uint32, ObserverList>	m_byTopic;
+    };
+
+    /**
+     * Calls the observers in a list that have the given mode.
+     */
+    static void Notify ( ObserverList const& _observers, Mode const _mode, Notification* _pNotification );
+
+    /**
+     * Calls the observers for a notification that have the given mode.
+     */
+    static void Notify ( Observers const& _observers, Mode const _mode, Notification* _pNotification, uint32 const* _pTopics, uint32 const _numTopics );
+
+    /**
+     * Adds an entry to a copy of the observers.  Called with m_lock held.
+     */
+    void AddEntry ( Entry const& _entry, uint32 const* _pTopic );
+
+    /**
+     * A notification waiting for a worker, with the observers
+     * there were when it was posted.
+     */
+    class Task: public Notification
+    {
+    public:
+        Task ( Poco::SharedPtr<Observers> const& _pObservers, Notification::Ptr const& _pNotification, uint32 const* _pTopics, uint32 const _numTopics ) :
+            m_pObservers ( _pObservers ),
+            m_pNotification ( _pNotification ),
+            m_numTopics ( _numTopics )
+        {
+            for ( uint32 i=0; i<_numTopics; ++i )
+            {
+                m_topics[i] = _pTopics[i];
+            }
+        }
+
+        void Run();
+
+    private:
+        Poco::SharedPtr<Observers>		m_pObservers;
+        Notification::Ptr				m_pNotification;
+        uint32							m_topics[kMaxTopics];
+        uint32							m_numTopics;
+    };
+
+    /**
+     * A worker thread and its queue.
+     */
+    class Worker: public Poco::Runnable
+    {
+    public:
+        Worker ( Poco::AtomicCounter& _dispatched ): m_dispatched ( _dispatched ){}
+
+        virtual void run();
+
+        Poco::NotificationQueue			m_queue;
+        Poco::Thread					m_thread;
+        Poco::AtomicCounter&			m_dispatched;
+    };
+
+    /**
+     * Starts the worker threads.  Called with m_lock held.
+     */
+    void StartWorkers();
+
+    /**
+     * Tells the worker threads to stop, and waits for them.
+     */
+    void StopWorkers();
+
+    // The list is replaced rather than changed, so that posting only
+    // needs the lock long enough to take a reference to it.
+    Poco::SharedPtr<Observers>		m_pObservers;
+    uint32							m_numPooled;
+    vector<Worker*>					m_workers;
+    uint32							m_numWorkers;
+    uint32							m_queueSize;
+    uint32							m_maxDepth;
+    Poco::AtomicCounter				m_queued;
+    Poco::AtomicCounter				m_dispatched;
+    Poco::AtomicCounter				m_dropped;
+    mutable Poco::FastMutex			m_lock;
+
+}; // class XplNotificationDispatcher
+
+} // namespace xpl
+
+#endif // _XplNotificationDispatcher_H
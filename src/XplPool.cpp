@@ -0,0 +1,214 @@
+/***************************************************************************
+****																	****
+****	XplPool.cpp														****
+****																	****
+****	Recycling of memory for frequently created objects				****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include <new>
+#include "XplCore.h"
+#include "XplPool.h"
+
+using namespace xpl;
+
+
+/***************************************************************************
+****																	****
+****	XplBlockPool Constructor										****
+****																	****
+***************************************************************************/
+
+XplBlockPool::XplBlockPool
+(
+    size_t const _blockSize
+) :
+    m_blockSize ( _blockSize < sizeof ( Block ) ? sizeof ( Block ) : _blockSize ),
+    m_pFree ( NULL ),
+    m_maxCached ( 0 )
+{
+    memset ( &m_stats, 0, sizeof ( m_stats ) );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplBlockPool Destructor											****
+****																	****
+***************************************************************************/
+
+XplBlockPool::~XplBlockPool()
+{
+    SetMaxCached ( 0 );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplBlockPool::Allocate											****
+****																	****
+***************************************************************************/
+
+void* XplBlockPool::Allocate
+(
+    size_t const _size
+)
+{
+    if ( _size > m_blockSize )
+    {
+        return ::operator new ( _size );
+    }
+
+    {
+        FastMutex::ScopedLock lock ( m_mutex );
+        if ( 0 == m_maxCached )
+        {
+            return ::operator new ( m_blockSize );
+        }
+
+        if ( ++m_stats.m_inUse > m_stats.m_highWater )
+        {
+            m_stats.m_highWater = m_stats.m_inUse;
+        }
+
+        if ( m_pFree )
+        {
+            ++m_stats.m_hits;
+            --m_stats.m_cached;
+            Block* pBlock = m_pFree;
+            m_pFree = pBlock->m_pNext;
+            return pBlock;
+        }
+        ++m_stats.m_misses;
+    }
+
+    // Every block is the full size, even while pooling is off, so that
+    // any of them can be kept if pooling is turned on before it is freed
+    return ::operator new ( m_blockSize );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplBlockPool::Free												****
+****																	****
+***************************************************************************/
+
+void XplBlockPool::Free
+(
+    void* _p,
+    size_t const _size
+)
+{
+    if ( NULL == _p )
+    {
+        return;
+    }
+
+    if ( _size > m_blockSize )
+    {
+        ::operator delete ( _p );
+        return;
+    }
+
+    {
+        FastMutex::ScopedLock lock ( m_mutex );
+        if ( 0 == m_maxCached )
+        {
+            ::operator delete ( _p );
+            return;
+        }
+
+        if ( m_stats.m_inUse )
+        {
+            --m_stats.m_inUse;
+        }
+
+        if ( m_stats.m_cached < m_maxCached )
+        {
+            Block* pBlock = static_cast<Block*> ( _p );
+            pBlock->m_pNext = m_pFree;
+            m_pFree = pBlock;
+            ++m_stats.m_cached;
+            return;
+        }
+    }
+
+    ::operator delete ( _p );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplBlockPool::SetMaxCached										****
+****																	****
+***************************************************************************/
+
+void XplBlockPool::SetMaxCached
+(
+    uint32 const _maxCached
+)
+{
+    FastMutex::ScopedLock lock ( m_mutex );
+    m_maxCached = _maxCached;
+    Trim();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplBlockPool::Trim												****
+****																	****
+****	Releases free blocks beyond the limit.  Called with the mutex	****
+****	held.															****
+****																	****
+***************************************************************************/
+
+void XplBlockPool::Trim()
+{
+    while ( m_pFree && ( m_stats.m_cached > m_maxCached ) )
+    {
+        Block* pBlock = m_pFree;
+        m_pFree = pBlock->m_pNext;
+        --m_stats.m_cached;
+        ::operator delete ( pBlock );
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplBlockPool::GetStats											****
+****																	****
+***************************************************************************/
+
+XplPoolStats XplBlockPool::GetStats() const
+{
+    FastMutex::ScopedLock lock ( m_mutex );
+    return m_stats;
+}
@@ -0,0 +1,225 @@
+/***************************************************************************
+****																	****
+****	XplPool.h														****
+****																	****
+****	Recycling of memory for frequently created objects				****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplPool_H
+#define _XplPool_H
+
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+#include "XplCore.h"
+#include "Poco/Mutex.h"
+
+using Poco::FastMutex;
+
+namespace xpl
+{
+
+/**
+ * Counters kept by the pools.
+ * They are only updated while pooling is enabled.
+ */
+struct XplPoolStats
+{
+    uint32	m_hits;			// Requests satisfied from the pool
+    uint32	m_misses;		// Requests that had to go to the global allocator
+    uint32	m_inUse;		// Objects currently handed out
+    uint32	m_highWater;	// Largest value m_inUse has reached
+    uint32	m_cached;		// Objects currently held for reuse
+};
+
+
+/**
+ * Pool of fixed size blocks of raw memory.
+ * Intended to back a class's own operator new and delete.  Freed blocks are
+ * kept on a list and handed out again, so once the pool has grown to the
+ * number of objects that are alive at the busiest moment, the global
+ * allocator is no longer called.
+ * <p>
+ * Objects are usually created on one thread and released on another, so
+ * per-thread caches would simply drain on one side and fill on the other.
+ * Instead the list is shared, and protected by a FastMutex that is held
+ * only long enough to push or pop a single block.
+ * <p>
+ * Pooling is off until SetMaxCached is called with a non-zero value.  While
+ * it is off, blocks come straight from the global allocator.  They are still
+ * allocated at the full block size, so pooling can be turned on and off
+ * while objects are alive.
+ */
+class XplBlockPool
+{
+public:
+    /**
+     * Constructor.
+     * @param _blockSize size of the blocks that are pooled.  Requests for
+     * any other size are passed straight to the global allocator.
+     */
+    XplBlockPool ( size_t const _blockSize );
+    ~XplBlockPool();
+
+    void* Allocate ( size_t const _size );
+    void Free ( void* _p, size_t const _size );
+
+    /**
+     * Sets how many free blocks may be kept for reuse.
+     * @param _maxCached the most free blocks to keep.  Zero turns pooling
+     * off and releases any blocks currently kept.
+     */
+    void SetMaxCached ( uint32 const _maxCached );
+
+    XplPoolStats GetStats() const;
+
+private:
+    struct Block
+    {
+        Block*	m_pNext;
+    };
+
+    void Trim();
+
+    mutable FastMutex	m_mutex;
+    size_t				m_blockSize;
+    Block*				m_pFree;
+    uint32				m_maxCached;
+    XplPoolStats		m_stats;
+
+}; // class XplBlockPool
+
+
+/**
+ * Pool of recycled objects.
+ * Unlike XplBlockPool, objects given back to this pool are not destroyed,
+ * so anything they own, such as the capacity of their strings and vectors,
+ * is kept for the next user.  T must have a default constructor.
+ */
+template <class T>
+class XplObjectPool
+{
+public:
+    XplObjectPool() :
+        m_maxCached ( 0 )
+    {
+        memset ( &m_stats, 0, sizeof ( m_stats ) );
+    }
+
+    ~XplObjectPool()
+    {
+        SetMaxCached ( 0 );
+    }
+
+    bool IsEnabled() const
+    {
+        FastMutex::ScopedLock lock ( m_mutex );
+        return ( 0 != m_maxCached );
+    }
+
+    /**
+     * Gets an object from the pool, or a new one if the pool is empty.
+     */
+    T* Take()
+    {
+        FastMutex::ScopedLock lock ( m_mutex );
+        T* pObject;
+        if ( m_free.empty() )
+        {
+            ++m_stats.m_misses;
+            pObject = new T;
+        }
+        else
+        {
+            ++m_stats.m_hits;
+            pObject = m_free.back();
+            m_free.pop_back();
+        }
+
+        if ( ++m_stats.m_inUse > m_stats.m_highWater )
+        {
+            m_stats.m_highWater = m_stats.m_inUse;
+        }
+        return pObject;
+    }
+
+    /**
+     * Returns an object to the pool, or deletes it if the pool is full.
+     */
+    void Give ( T* _pObject )
+    {
+        FastMutex::ScopedLock lock ( m_mutex );
+        --m_stats.m_inUse;
+        if ( m_free.size() < m_maxCached )
+        {
+            // There is always room, as m_free was reserved in SetMaxCached
+            m_free.push_back ( _pObject );
+            return;
+        }
+        delete _pObject;
+    }
+
+    /**
+     * Sets how many objects may be kept for reuse.
+     * @param _maxCached the most objects to keep.  Zero turns pooling
+     * off and deletes any objects currently kept.
+     */
+    void SetMaxCached ( uint32 const _maxCached )
+    {
+        FastMutex::ScopedLock lock ( m_mutex );
+        m_maxCached = _maxCached;
+        while ( m_free.size() > m_maxCached )
+        {
+            delete m_free.back();
+            m_free.pop_back();
+        }
+        m_free.reserve ( m_maxCached );
+    }
+
+    XplPoolStats GetStats() const
+    {
+        FastMutex::ScopedLock lock ( m_mutex );
+        XplPoolStats stats = m_stats;
+        stats.m_cached = ( uint32 ) m_free.size();
+        return stats;
+    }
+
+private:
+    mutable FastMutex	m_mutex;
+    vector<T*>			m_free;
+    uint32				m_maxCached;
+    XplPoolStats		m_stats;
+
+}; // class XplObjectPool
+
+} // namespace xpl
+
+#endif // _XplPool_H
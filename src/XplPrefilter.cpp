@@ -0,0 +1,416 @@
+/***************************************************************************
+****																	****
+****	XplPrefilter.cpp												****
+****																	****
+****	Early rejection of received messages							****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include "XplCore.h"
+#include "XplPrefilter.h"
+#include "XplMsg.h"
+#include "XplStringUtils.h"
+#include "XplSymbol.h"
+
+using namespace xpl;
+
+
+/***************************************************************************
+****																	****
+****	XplPrefilter Constructor										****
+****																	****
+***************************************************************************/
+
+XplPrefilter::XplPrefilter() :
+    m_bEnabled ( false ),
+    m_pRules ( new RuleSet ),
+    m_generation ( 0 )
+{
+}
+
+
+/***************************************************************************
+****																	****
+****	XplPrefilter Destructor											****
+****																	****
+***************************************************************************/
+
+XplPrefilter::~XplPrefilter()
+{
+}
+
+
+/***************************************************************************
+****																	****
+****	XplPrefilter::SetDeviceRules									****
+****																	****
+***************************************************************************/
+
+void XplPrefilter::SetDeviceRules
+(
+    XplDevice const* _pDevice,
+    XplAddress const& _address,
+    vector<string> const& _groups,
+    AutoPtr<xplFilterSet> const& _pFilters,
+    bool const _bFilterMsgs
+)
+{
+    Rule rule;
+    rule.m_pDevice = _pDevice;
+    rule.m_address = _address;
+    rule.m_groups = _groups;
+    rule.m_pFilters = _pFilters;
+    rule.m_bFilterMsgs = _bFilterMsgs;
+
+    Poco::FastMutex::ScopedLock lock ( m_mutex );
+    AutoPtr<RuleSet> pRules = new RuleSet ( *m_pRules );
+    uint32 i;
+    for ( i=0; i<pRules->m_rules.size(); ++i )
+    {
+        if ( pRules->m_rules[i].m_pDevice == _pDevice )
+        {
+            pRules->m_rules[i] = rule;
+            break;
+        }
+    }
+    if ( i == pRules->m_rules.size() )
+    {
+        pRules->m_rules.push_back ( rule );
+    }
+    m_pRules = pRules;
+    ++m_generation;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplPrefilter::RemoveDevice										****
+****																	****
+***************************************************************************/
+
+void XplPrefilter::RemoveDevice
+(
+    XplDevice const* _pDevice
+)
+{
+    Poco::FastMutex::ScopedLock lock ( m_mutex );
+    AutoPtr<RuleSet> pRules = new RuleSet ( *m_pRules );
+    for ( vector<Rule>::iterator iter = pRules->m_rules.begin(); iter != pRules->m_rules.end(); ++iter )
+    {
+        if ( iter->m_pDevice == _pDevice )
+        {
+            pRules->m_rules.erase ( iter );
+            break;
+        }
+    }
+    m_pRules = pRules;
+    ++m_generation;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplPrefilter::Accept											****
+****																	****
+***************************************************************************/
+
+bool XplPrefilter::Accept
+(
+    char const* _pData,
+    uint32 const _size
+)
+{
+    if ( !m_bEnabled )
+    {
+        return true;
+    }
+
+    Header header;
+    if ( ReadHeader ( XplStringView ( _pData, XplMsg::GetTextSize ( _pData, _size ) ), &header ) )
+    {
+        AutoPtr<RuleSet> pRules;
+        {
+            Poco::FastMutex::ScopedLock lock ( m_mutex );
+            pRules = m_pRules;
+        }
+
+        for ( uint32 i=0; i<pRules->m_rules.size(); ++i )
+        {
+            if ( IsAcceptedBy ( pRules->m_rules[i], header ) )
+            {
+                ++m_accepted;
+                return true;
+            }
+        }
+    }
+
+    ++m_rejected;
+    return false;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplPrefilter::GetStats											****
+****																	****
+***************************************************************************/
+
+XplPrefilter::Stats XplPrefilter::GetStats() const
+{
+    Stats stats;
+    stats.m_accepted = ( uint32 ) m_accepted.value();
+    stats.m_rejected = ( uint32 ) m_rejected.value();
+    return stats;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplPrefilter::GetSummary										****
+****																	****
+***************************************************************************/
+
+uint32 XplPrefilter::GetSummary
+(
+    Summary* _pSummary
+) const
+{
+    AutoPtr<RuleSet> pRules;
+    uint32 generation;
+    {
+        Poco::FastMutex::ScopedLock lock ( m_mutex );
+        pRules = m_pRules;
+        generation = m_generation;
+    }
+
+    _pSummary->m_bAcceptAll = false;
+    _pSummary->m_ownVendors.clear();
+    _pSummary->m_targets.clear();
+    _pSummary->m_msgTypes.clear();
+    _pSummary->m_vendors.clear();
+    if ( !pRules->m_rules.empty() )
+    {
+        _pSummary->m_targets.push_back ( "*" );
+    }
+
+    bool bAnyType = false;
+    bool bAnyVendor = false;
+    for ( uint32 i=0; i<pRules->m_rules.size(); ++i )
+    {
+        Rule const& rule = pRules->m_rules[i];
+        if ( !rule.m_bFilterMsgs )
+        {
+            _pSummary->m_bAcceptAll = true;
+        }
+
+        _pSummary->m_ownVendors.push_back ( rule.m_address.GetVendor().toString() );
+        _pSummary->m_targets.push_back ( rule.m_address.ToString() );
+        for ( uint32 j=0; j<rule.m_groups.size(); ++j )
+        {
+            _pSummary->m_targets.push_back ( "xpl-group." + rule.m_groups[j] );
+        }
+
+        // A device without filters takes any type from any vendor
+        if ( rule.m_pFilters.isNull() || !rule.m_pFilters->GetValues ( xplFilterSet::Element_MsgType, &_pSummary->m_msgTypes ) )
+        {
+            bAnyType = true;
+        }
+        if ( rule.m_pFilters.isNull() || !rule.m_pFilters->GetValues ( xplFilterSet::Element_Vendor, &_pSummary->m_vendors ) )
+        {
+            bAnyVendor = true;
+        }
+    }
+
+    if ( bAnyType )
+    {
+        _pSummary->m_msgTypes.clear();
+    }
+    if ( bAnyVendor )
+    {
+        _pSummary->m_vendors.clear();
+    }
+    return generation;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplPrefilter::GetGeneration										****
+****																	****
+***************************************************************************/
+
+uint32 XplPrefilter::GetGeneration() const
+{
+    Poco::FastMutex::ScopedLock lock ( m_mutex );
+    return m_generation;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplPrefilter::ReadHeader										****
+****																	****
+****	Follows XplMsg::ParseRawData, but stops after the schema.		****
+****																	****
+***************************************************************************/
+
+bool XplPrefilter::ReadHeader
+(
+    XplStringView const& _str,
+    Header* _pHeader
+)
+{
+    // Read the message type
+    XplStringView line;
+    uint32 pos = XplMsg::ReadLine ( _str, 0, &line );
+    string const* pType = XplMsg::FindType ( line );
+    if ( NULL == pType )
+    {
+        return false;
+    }
+    _pHeader->m_ids[xplFilterSet::Element_MsgType] = XplSymbolTable::Find ( *pType );
+
+    // Skip the opening brace
+    pos = XplMsg::ReadLine ( _str, pos, &line );
+    if ( line != XplStringView ( XplMsg::c_xplOpenBrace ) )
+    {
+        return false;
+    }
+
+    // Read the name-value pairs from the header.  As in XplMsg, an
+    // address that cannot be read is left as "*-*.*".
+    while ( 1 )
+    {
+        pos = XplMsg::ReadLine ( _str, pos, &line );
+        if ( line.empty() )
+        {
+            // Ran out of data
+            return false;
+        }
+
+        if ( line == XplStringView ( XplMsg::c_xplCloseBrace ) )
+        {
+            break;
+        }
+
+        uint32 equals = line.find ( '=' );
+        XplStringView name = line.substr ( 0, equals ).trim();
+        XplStringView value = line.substr ( equals + 1 ).trim();
+        if ( XplStringView::npos == equals )
+        {
+            value = XplStringView();
+        }
+
+        if ( name == XplStringView ( XplMsg::c_xplSource ) )
+        {
+            _pHeader->m_source.Parse ( value );
+        }
+        else if ( name == XplStringView ( XplMsg::c_xplTarget ) )
+        {
+            if ( value == XplStringView ( XplMsg::c_xplTargetAll ) )
+            {
+                _pHeader->m_target.SetBroadcast();
+            }
+            else
+            {
+                _pHeader->m_target.Parse ( value );
+            }
+        }
+        else if ( name != XplStringView ( XplMsg::c_xplHop ) )
+        {
+            return false;
+        }
+    }
+
+    // Read the schema class and type
+    XplStringView schemaClass;
+    XplStringView schemaType;
+    XplMsg::ReadLine ( _str, pos, &line );
+    StringSplit ( line, '.', &schemaClass, &schemaType );
+    if ( schemaClass.empty() || ( schemaClass.size() > 8 ) || schemaType.empty() || ( schemaType.size() > 8 ) )
+    {
+        return false;
+    }
+
+    // A name that is not in the symbol table cannot be in a filter either,
+    // and gets XplSymbolTable::c_none, which no filter value has.
+    _pHeader->m_ids[xplFilterSet::Element_Vendor] = XplSymbolTable::Find ( _pHeader->m_source.GetVendor() );
+    _pHeader->m_ids[xplFilterSet::Element_Device] = XplSymbolTable::Find ( _pHeader->m_source.GetDevice() );
+    _pHeader->m_ids[xplFilterSet::Element_Instance] = XplSymbolTable::Find ( _pHeader->m_source.GetInstance() );
+    _pHeader->m_ids[xplFilterSet::Element_Class] = XplSymbolTable::FindLower ( schemaClass );
+    _pHeader->m_ids[xplFilterSet::Element_Type] = XplSymbolTable::FindLower ( schemaType );
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplPrefilter::IsAcceptedBy										****
+****																	****
+****	The same checks as XplDevice::IsMsgForThisApp.					****
+****																	****
+***************************************************************************/
+
+bool XplPrefilter::IsAcceptedBy
+(
+    Rule const& _rule,
+    Header const& _header
+)
+{
+    // The device's own messages, and everything for a device that
+    // does no filtering, always get through.
+    if ( ( _header.m_source == _rule.m_address ) || !_rule.m_bFilterMsgs )
+    {
+        return true;
+    }
+
+    XplAddress const& target = _header.m_target;
+    if ( !target.IsBroadcast() && ( target != _rule.m_address ) )
+    {
+        if ( !target.IsGroup() )
+        {
+            return false;
+        }
+
+        uint32 i;
+        for ( i=0; i<_rule.m_groups.size(); ++i )
+        {
+            if ( target.GetInstance() == XplStringView ( _rule.m_groups[i] ) )
+            {
+                break;
+            }
+        }
+
+        if ( i == _rule.m_groups.size() )
+        {
+            return false;
+        }
+    }
+
+    return ( _rule.m_pFilters.isNull() || _rule.m_pFilters->Allow ( _header.m_ids ) );
+}
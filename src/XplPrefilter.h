@@ -0,0 +1,201 @@
+/***************************************************************************
+****																	****
+****	XplPrefilter.h													****
+****																	****
+****	Early rejection of received messages							****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplPrefilter_H
+#define _XplPrefilter_H
+
+#include <vector>
+#include "XplCore.h"
+#include "XplStringView.h"
+#include "XplAddress.h"
+#include "xplFilter.h"
+#include "Poco/AutoPtr.h"
+#include "Poco/AtomicCounter.h"
+#include "Poco/Mutex.h"
+#include "Poco/RefCountedObject.h"
+
+using Poco::AutoPtr;
+
+namespace xpl
+{
+
+class XplDevice;
+
+/**
+ * Rejects received datagrams that none of the devices in the process
+ * would accept, before an XplMsg is made from them.
+ * Only the header block and the schema line are read, without allocating
+ * anything.  The message type, source, target and schema are then checked
+ * against the rules of every registered device: its own address, the
+ * groups it belongs to and its filters.  These are the same checks as
+ * XplDevice::IsMsgForThisApp makes, so a datagram is only thrown away if
+ * every device would have ignored it.  A device's own messages, reflected
+ * back by the hub, are always let through, as they tell the device that
+ * the hub is running.
+ * <p>
+ * The prefilter is off until SetEnabled is called, because it also hides
+ * messages from anything that observes XplComms::rxNotificationCenter
+ * directly rather than through a device.  While it is on and no device is
+ * registered, every datagram is rejected.
+ */
+class XplPrefilter
+{
+public:
+    XplPrefilter();
+    ~XplPrefilter();
+
+    /**
+     * Turns the prefilter on or off.
+     */
+    void SetEnabled ( bool const _bEnabled )
+    {
+        m_bEnabled = _bEnabled;
+    }
+
+    bool IsEnabled() const
+    {
+        return m_bEnabled;
+    }
+
+    /**
+     * Records, or replaces, the rules for a device.
+     * Called by XplDevice whenever its address, groups or filters change.
+     * @param _pDevice the device.
+     * @param _address the device's own address.
+     * @param _groups the groups the device belongs to.
+     * @param _pFilters the device's filters.
+     * @param _bFilterMsgs false if the device takes every message.
+     */
+    void SetDeviceRules ( XplDevice const* _pDevice, XplAddress const& _address, vector<string> const& _groups, AutoPtr<xplFilterSet> const& _pFilters, bool const _bFilterMsgs );
+
+    /**
+     * Forgets the rules for a device.
+     * @param _pDevice the device.
+     */
+    void RemoveDevice ( XplDevice const* _pDevice );
+
+    /**
+     * Checks whether a received datagram could be wanted by any device.
+     * Safe to call from several receive threads at once.
+     * @param _pData the datagram.
+     * @param _size number of bytes in the datagram.
+     * @return True if the datagram should be parsed and dispatched.
+     * Always true while the prefilter is off.
+     */
+    bool Accept ( char const* _pData, uint32 const _size );
+
+    /**
+     * Counters for the datagrams checked while the prefilter is on.
+     */
+    struct Stats
+    {
+        uint32	m_accepted;
+        uint32	m_rejected;
+    };
+
+    Stats GetStats() const;
+
+    /**
+     * A coarser version of the rules, used to build a kernel socket filter.
+     * Anything the rules accept is also accepted by the summary.
+     */
+    struct Summary
+    {
+        bool			m_bAcceptAll;	// True if some device takes every message
+        vector<string>	m_ownVendors;	// Vendor of each device's own address, for reflected messages
+        vector<string>	m_targets;		// Every target that some device accepts, including "*"
+        vector<string>	m_msgTypes;		// Types that some filter wants.  Empty means any type.
+        vector<string>	m_vendors;		// Source vendors that some filter wants.  Empty means any vendor.
+    };
+
+    /**
+     * Fills in a summary of the current rules.
+     * @return the generation of the rules that were summarised.
+     */
+    uint32 GetSummary ( Summary* _pSummary ) const;
+
+    /**
+     * Gets a number that changes whenever the rules do.
+     */
+    uint32 GetGeneration() const;
+
+private:
+    // The parts of a message that the rules look at
+    struct Header
+    {
+        XplAddress	m_source;
+        XplAddress	m_target;
+        uint32		m_ids[xplFilterSet::Element_Count];		// XplSymbolTable IDs, for the filters
+    };
+
+    struct Rule
+    {
+        XplDevice const*		m_pDevice;
+        XplAddress				m_address;
+        vector<string>			m_groups;
+        AutoPtr<xplFilterSet>	m_pFilters;
+        bool					m_bFilterMsgs;
+    };
+
+    // Replaced, never changed, like the device's filter set
+    class RuleSet: public Poco::RefCountedObject
+    {
+    public:
+        vector<Rule>	m_rules;
+    };
+
+    /**
+     * Reads the header block and schema line of a datagram.
+     * @return False if they are not well formed.
+     */
+    static bool ReadHeader ( XplStringView const& _str, Header* _pHeader );
+
+    /**
+     * Checks a header against the rules for one device.
+     */
+    static bool IsAcceptedBy ( Rule const& _rule, Header const& _header );
+
+    bool					m_bEnabled;
+    mutable Poco::FastMutex	m_mutex;		// Held while m_pRules is read or replaced
+    AutoPtr<RuleSet>		m_pRules;
+    uint32					m_generation;	// Incremented each time m_pRules is replaced
+    Poco::AtomicCounter		m_accepted;
+    Poco::AtomicCounter		m_rejected;
+
+}; // class XplPrefilter
+
+} // namespace xpl
+
+#endif // _XplPrefilter_H
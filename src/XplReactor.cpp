@@ -0,0 +1,501 @@
+/***************************************************************************
+****																	****
+****	XplReactor.cpp													****
+****																	****
+****	Waits on sockets, timers and wakeups for one thread				****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "XplCore.h"
+#include "XplReactor.h"
+
+#ifdef XPL_HAVE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#else
+#include <poll.h>
+#endif
+
+using namespace xpl;
+
+
+/***************************************************************************
+****																	****
+****	XplReactor Constructor											****
+****																	****
+***************************************************************************/
+
+XplReactor::XplReactor() :
+    m_nextTimerId ( 1 ),
+    m_bStopping ( false )
+{
+#ifdef XPL_HAVE_EPOLL
+    m_epollFd = -1;
+    m_wakeFd = -1;
+#else
+    m_wakePipe[0] = -1;
+    m_wakePipe[1] = -1;
+#endif
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor Destructor											****
+****																	****
+***************************************************************************/
+
+XplReactor::~XplReactor()
+{
+    Close();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::Open												****
+****																	****
+***************************************************************************/
+
+bool XplReactor::Open()
+{
+    Close();
+    m_bStopping = false;
+
+#ifdef XPL_HAVE_EPOLL
+    m_epollFd = epoll_create1 ( EPOLL_CLOEXEC );
+    m_wakeFd = eventfd ( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    if ( ( m_epollFd < 0 ) || ( m_wakeFd < 0 ) )
+    {
+        Close();
+        return false;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakeFd;
+    if ( epoll_ctl ( m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev ) < 0 )
+    {
+        Close();
+        return false;
+    }
+#else
+    if ( pipe ( m_wakePipe ) < 0 )
+    {
+        m_wakePipe[0] = -1;
+        m_wakePipe[1] = -1;
+        return false;
+    }
+    for ( int i=0; i<2; ++i )
+    {
+        fcntl ( m_wakePipe[i], F_SETFL, fcntl ( m_wakePipe[i], F_GETFL ) | O_NONBLOCK );
+    }
+#endif
+
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::Close												****
+****																	****
+***************************************************************************/
+
+void XplReactor::Close()
+{
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        m_sockets.clear();
+        m_timers.clear();
+    }
+
+#ifdef XPL_HAVE_EPOLL
+    if ( m_epollFd >= 0 )
+    {
+        close ( m_epollFd );
+        m_epollFd = -1;
+    }
+    if ( m_wakeFd >= 0 )
+    {
+        close ( m_wakeFd );
+        m_wakeFd = -1;
+    }
+#else
+    for ( int i=0; i<2; ++i )
+    {
+        if ( m_wakePipe[i] >= 0 )
+        {
+            close ( m_wakePipe[i] );
+            m_wakePipe[i] = -1;
+        }
+    }
+#endif
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::AddSocket											****
+****																	****
+***************************************************************************/
+
+bool XplReactor::AddSocket
+(
+    int _fd,
+    XplReactorHandler* _pHandler
+)
+{
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        m_sockets[_fd] = _pHandler;
+    }
+
+#ifdef XPL_HAVE_EPOLL
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = _fd;
+    if ( ( epoll_ctl ( m_epollFd, EPOLL_CTL_ADD, _fd, &ev ) < 0 ) && ( EEXIST != errno ) )
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        m_sockets.erase ( _fd );
+        return false;
+    }
+#else
+    // The poll list is rebuilt on each pass, so it just needs to restart
+    Wake();
+#endif
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::RemoveSocket										****
+****																	****
+***************************************************************************/
+
+void XplReactor::RemoveSocket
+(
+    int _fd
+)
+{
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        m_sockets.erase ( _fd );
+    }
+
+#ifdef XPL_HAVE_EPOLL
+    struct epoll_event ev;
+    epoll_ctl ( m_epollFd, EPOLL_CTL_DEL, _fd, &ev );
+#else
+    Wake();
+#endif
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::AddTimer											****
+****																	****
+***************************************************************************/
+
+uint32 XplReactor::AddTimer
+(
+    uint32 _intervalMs,
+    XplReactorHandler* _pHandler
+)
+{
+    Timer timer;
+    timer.m_interval = ( Poco::Timestamp::TimeDiff ) _intervalMs * 1000;
+    timer.m_due += timer.m_interval;
+    timer.m_pHandler = _pHandler;
+
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        timer.m_id = m_nextTimerId++;
+        m_timers.push_back ( timer );
+    }
+
+    // The reactor may be asleep with a longer timeout
+    Wake();
+    return timer.m_id;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::RemoveTimer											****
+****																	****
+***************************************************************************/
+
+void XplReactor::RemoveTimer
+(
+    uint32 _timerId
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    for ( vector<Timer>::iterator iter = m_timers.begin(); iter != m_timers.end(); ++iter )
+    {
+        if ( iter->m_id == _timerId )
+        {
+            m_timers.erase ( iter );
+            break;
+        }
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::Run													****
+****																	****
+***************************************************************************/
+
+void XplReactor::Run()
+{
+    vector<int> ready;
+#ifdef XPL_HAVE_EPOLL
+    struct epoll_event events[16];
+#else
+    vector<struct pollfd> fds;
+#endif
+
+    while ( !m_bStopping )
+    {
+        int const timeout = RunTimers();
+        if ( m_bStopping )
+        {
+            break;
+        }
+
+        // Wait for something to happen, and list the sockets it happened to
+        ready.clear();
+#ifdef XPL_HAVE_EPOLL
+        int const count = epoll_wait ( m_epollFd, events, 16, timeout );
+        for ( int i=0; i<count; ++i )
+        {
+            ready.push_back ( events[i].data.fd );
+        }
+#else
+        fds.resize ( 1 );
+        fds[0].fd = m_wakePipe[0];
+        fds[0].events = POLLIN;
+        {
+            FastMutex::ScopedLock lock ( m_lock );
+            for ( map<int, XplReactorHandler*>::const_iterator iter = m_sockets.begin(); iter != m_sockets.end(); ++iter )
+            {
+                struct pollfd pfd;
+                pfd.fd = iter->first;
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                fds.push_back ( pfd );
+            }
+        }
+
+        if ( poll ( &fds[0], fds.size(), timeout ) > 0 )
+        {
+            for ( uint32 i=0; i<fds.size(); ++i )
+            {
+                if ( fds[i].revents )
+                {
+                    ready.push_back ( fds[i].fd );
+                }
+            }
+        }
+#endif
+
+        for ( uint32 i=0; ( i<ready.size() ) && !m_bStopping; ++i )
+        {
+            int const fd = ready[i];
+            if ( IsWakeFd ( fd ) )
+            {
+                ClearWake();
+                continue;
+            }
+
+            XplReactorHandler* pHandler = NULL;
+            {
+                FastMutex::ScopedLock lock ( m_lock );
+                map<int, XplReactorHandler*>::const_iterator iter = m_sockets.find ( fd );
+                if ( iter != m_sockets.end() )
+                {
+                    pHandler = iter->second;
+                }
+            }
+
+            // The lock is not held, so the handler may add or remove sockets
+            if ( pHandler )
+            {
+                pHandler->OnReadable ( fd );
+            }
+        }
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::Stop												****
+****																	****
+***************************************************************************/
+
+void XplReactor::Stop()
+{
+    m_bStopping = true;
+    Wake();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::Wake												****
+****																	****
+***************************************************************************/
+
+void XplReactor::Wake()
+{
+#ifdef XPL_HAVE_EPOLL
+    if ( m_wakeFd >= 0 )
+    {
+        uint64_t const one = 1;
+        ssize_t written = write ( m_wakeFd, &one, sizeof ( one ) );
+        ( void ) written;
+    }
+#else
+    if ( m_wakePipe[1] >= 0 )
+    {
+        char const ch = 0;
+        ssize_t written = write ( m_wakePipe[1], &ch, 1 );
+        ( void ) written;
+    }
+#endif
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::IsWakeFd											****
+****																	****
+***************************************************************************/
+
+bool XplReactor::IsWakeFd
+(
+    int _fd
+) const
+{
+#ifdef XPL_HAVE_EPOLL
+    return ( _fd == m_wakeFd );
+#else
+    return ( _fd == m_wakePipe[0] );
+#endif
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::ClearWake											****
+****																	****
+***************************************************************************/
+
+void XplReactor::ClearWake()
+{
+#ifdef XPL_HAVE_EPOLL
+    uint64_t value;
+    ssize_t bytesRead = read ( m_wakeFd, &value, sizeof ( value ) );
+    ( void ) bytesRead;
+#else
+    char buffer[64];
+    while ( read ( m_wakePipe[0], buffer, sizeof ( buffer ) ) > 0 )
+    {
+    }
+#endif
+}
+
+
+/***************************************************************************
+****																	****
+****	XplReactor::RunTimers											****
+****																	****
+***************************************************************************/
+
+int XplReactor::RunTimers()
+{
+    Poco::Timestamp now;
+    Poco::Timestamp::TimeDiff wait = -1;
+
+    // Handlers are called without the lock held, so the list is scanned
+    // again after each call in case the handler changed it.
+    bool bFired = true;
+    while ( bFired && !m_bStopping )
+    {
+        bFired = false;
+        wait = -1;
+
+        uint32 timerId = 0;
+        XplReactorHandler* pHandler = NULL;
+        {
+            FastMutex::ScopedLock lock ( m_lock );
+            for ( vector<Timer>::iterator iter = m_timers.begin(); iter != m_timers.end(); ++iter )
+            {
+                Poco::Timestamp::TimeDiff const remaining = iter->m_due - now;
+                if ( remaining <= 0 )
+                {
+                    // Schedule from the due time, so the timer does not drift,
+                    // unless it has fallen a whole interval behind.
+                    iter->m_due += iter->m_interval;
+                    if ( iter->m_due < now )
+                    {
+                        iter->m_due = now;
+                        iter->m_due += iter->m_interval;
+                    }
+                    timerId = iter->m_id;
+                    pHandler = iter->m_pHandler;
+                    bFired = true;
+                    break;
+                }
+                if ( ( wait < 0 ) || ( remaining < wait ) )
+                {
+                    wait = remaining;
+                }
+            }
+        }
+
+        if ( bFired )
+        {
+            pHandler->OnTimer ( timerId );
+            now.update();
+        }
+    }
+
+    // Round up, so the wait does not end just before the timer is due
+    return ( wait < 0 ) ? -1 : ( int ) ( ( wait + 999 ) / 1000 );
+}
@@ -0,0 +1,196 @@
+/***************************************************************************
+****																	****
+****	XplReactor.h													****
+****																	****
+****	Waits on sockets, timers and wakeups for one thread				****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplReactor_H
+#define _XplReactor_H
+
+#include <vector>
+#include <map>
+#include "XplCore.h"
+#include "Poco/Mutex.h"
+#include "Poco/Timestamp.h"
+
+#if defined(__linux__)
+#define XPL_HAVE_EPOLL 1
+#endif
+
+using Poco::FastMutex;
+
+namespace xpl
+{
+
+/**
+ * Receives the events from an XplReactor.
+ * Both methods are called on the thread that is running the reactor.
+ */
+class XplReactorHandler
+{
+public:
+    virtual ~XplReactorHandler() {}
+
+    /**
+     * Called when a registered socket has data waiting.
+     * @param _fd the socket's descriptor.
+     */
+    virtual void OnReadable ( int /*_fd*/ ) {}
+
+    /**
+     * Called when a registered timer is due.
+     * @param _timerId the id returned by XplReactor::AddTimer.
+     */
+    virtual void OnTimer ( uint32 /*_timerId*/ ) {}
+};
+
+
+/**
+ * Event loop for a single thread.
+ * Any number of sockets and repeating timers can be registered with the
+ * reactor.  Run() sleeps until one of the sockets is readable or a timer is
+ * due, and calls the handler.  On Linux the waiting is done with epoll, and
+ * an eventfd is used so that Wake() and Stop() take effect at once instead
+ * of at the end of a timeout.  Other systems use poll() and a pipe.
+ * <p>
+ * Sockets and timers can be added and removed from any thread.  A handler
+ * that is being removed from a thread other than the reactor's may still
+ * be called once, so it must not be destroyed until the reactor has been
+ * stopped.
+ */
+class XplReactor
+{
+public:
+    XplReactor();
+    ~XplReactor();
+
+    /**
+     * Creates the wakeup descriptor and, on Linux, the epoll set.
+     * Must be called before anything is registered.
+     * @return true if successful.
+     */
+    bool Open();
+
+    /**
+     * Releases the descriptors and forgets all the sockets and timers.
+     * The reactor must not be running.
+     */
+    void Close();
+
+    /**
+     * Registers a socket to be watched for incoming data.
+     * @param _fd the socket's descriptor.
+     * @param _pHandler object to call when the socket is readable.
+     * @return true if successful.
+     */
+    bool AddSocket ( int _fd, XplReactorHandler* _pHandler );
+
+    /**
+     * Stops watching a socket.
+     * @param _fd the socket's descriptor.
+     */
+    void RemoveSocket ( int _fd );
+
+    /**
+     * Registers a repeating timer.
+     * @param _intervalMs milliseconds between calls to the handler.
+     * @param _pHandler object to call when the timer is due.
+     * @return id of the timer, to pass to RemoveTimer.
+     */
+    uint32 AddTimer ( uint32 _intervalMs, XplReactorHandler* _pHandler );
+
+    /**
+     * Cancels a timer.
+     * @param _timerId the id returned by AddTimer.
+     */
+    void RemoveTimer ( uint32 _timerId );
+
+    /**
+     * Handles events until Stop is called.
+     */
+    void Run();
+
+    /**
+     * Makes Run return as soon as the current handler, if any, is done.
+     * Can be called from any thread, and before Run has started.
+     */
+    void Stop();
+
+    /**
+     * Interrupts the wait in Run, so that changes made from other threads
+     * are picked up straight away.
+     */
+    void Wake();
+
+private:
+    struct Timer
+    {
+        uint32						m_id;
+        Poco::Timestamp::TimeDiff	m_interval;		// Microseconds
+        Poco::Timestamp				m_due;
+        XplReactorHandler*			m_pHandler;
+    };
+
+    /**
+     * Calls the handlers of any timers that are due.
+     * @return milliseconds until the next timer is due, or -1 if there are none.
+     */
+    int RunTimers();
+
+    /**
+     * Checks whether a descriptor is the one used by Wake.
+     */
+    bool IsWakeFd ( int _fd ) const;
+
+    /**
+     * Empties the wakeup descriptor.
+     */
+    void ClearWake();
+
+    map<int, XplReactorHandler*>	m_sockets;
+    vector<Timer>					m_timers;
+    uint32							m_nextTimerId;
+    FastMutex						m_lock;				// Protects m_sockets and m_timers
+    volatile bool					m_bStopping;
+
+#ifdef XPL_HAVE_EPOLL
+    int								m_epollFd;
+    int								m_wakeFd;			// eventfd
+#else
+    int								m_wakePipe[2];		// Written to wake the poll
+#endif
+
+}; // class XplReactor
+
+} // namespace xpl
+
+#endif // _XplReactor_H
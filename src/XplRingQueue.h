@@ -0,0 +1,193 @@
+/***************************************************************************
+****																	****
+****	XplRingQueue.h													****
+****																	****
+****	Bounded lock-free queue for passing work between threads		****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplRingQueue_H
+#define _XplRingQueue_H
+
+#include <vector>
+#include "XplCore.h"
+
+namespace xpl
+{
+
+/**
+ * Bounded first-in first-out queue that needs no locks.
+ * Any number of threads may push and pop at the same time.  Each slot
+ * carries a sequence number that tells a thread whether the slot is ready
+ * to be written or read, so a push or pop is normally one compare and
+ * swap on the shared position, followed by a plain copy of the value.
+ * Neither operation ever waits; when the queue is full or empty they
+ * simply return false, and the caller decides what to do.
+ * <p>
+ * The capacity is rounded up to a power of two.  T should be cheap to
+ * copy, such as a pointer.
+ */
+template <class T>
+class XplRingQueue
+{
+public:
+    /**
+     * Constructor.
+     * @param _capacity the most values the queue can hold.
+     */
+    XplRingQueue ( uint32 const _capacity ) :
+        m_pushPos ( 0 ),
+        m_popPos ( 0 )
+    {
+        uint32 size = 2;
+        while ( size < _capacity )
+        {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+
+        m_cells.resize ( size );
+        for ( uint32 i=0; i<size; ++i )
+        {
+            m_cells[i].m_sequence = i;
+        }
+    }
+
+    /**
+     * Adds a value to the back of the queue.
+     * @param _value the value to add.
+     * @return false if the queue is full.
+     */
+    bool TryPush ( T const& _value )
+    {
+        uint32 pos = __atomic_load_n ( &m_pushPos, __ATOMIC_RELAXED );
+        while ( 1 )
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            int32 const diff = ( int32 ) ( __atomic_load_n ( &cell.m_sequence, __ATOMIC_ACQUIRE ) - pos );
+            if ( 0 == diff )
+            {
+                // The slot is free.  Claim it, unless another thread got there first.
+                if ( __atomic_compare_exchange_n ( &m_pushPos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                {
+                    cell.m_value = _value;
+                    __atomic_store_n ( &cell.m_sequence, pos + 1, __ATOMIC_RELEASE );
+                    return true;
+                }
+            }
+            else if ( diff < 0 )
+            {
+                // The slot still holds a value from the previous lap
+                return false;
+            }
+            else
+            {
+                pos = __atomic_load_n ( &m_pushPos, __ATOMIC_RELAXED );
+            }
+        }
+    }
+
+    /**
+     * Removes the value at the front of the queue.
+     * @param _pValue filled in with the value removed.
+     * @return false if the queue is empty.
+     */
+    bool TryPop ( T* _pValue )
+    {
+        uint32 pos = __atomic_load_n ( &m_popPos, __ATOMIC_RELAXED );
+        while ( 1 )
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            int32 const diff = ( int32 ) ( __atomic_load_n ( &cell.m_sequence, __ATOMIC_ACQUIRE ) - ( pos + 1 ) );
+            if ( 0 == diff )
+            {
+                if ( __atomic_compare_exchange_n ( &m_popPos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                {
+                    *_pValue = cell.m_value;
+                    cell.m_value = T();
+                    __atomic_store_n ( &cell.m_sequence, pos + m_mask + 1, __ATOMIC_RELEASE );
+                    return true;
+                }
+            }
+            else if ( diff < 0 )
+            {
+                // Nothing has been written to this slot yet
+                return false;
+            }
+            else
+            {
+                pos = __atomic_load_n ( &m_popPos, __ATOMIC_RELAXED );
+            }
+        }
+    }
+
+    /**
+     * Gets the number of values in the queue.
+     * Only a snapshot, since other threads may be pushing and popping.
+     */
+    uint32 GetDepth() const
+    {
+        uint32 const popPos = __atomic_load_n ( &m_popPos, __ATOMIC_RELAXED );
+        uint32 const pushPos = __atomic_load_n ( &m_pushPos, __ATOMIC_RELAXED );
+        int32 const depth = ( int32 ) ( pushPos - popPos );
+        return ( depth < 0 ) ? 0 : ( uint32 ) depth;
+    }
+
+    uint32 GetCapacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+    // Not copyable
+    XplRingQueue ( XplRingQueue const& );
+    XplRingQueue& operator = ( XplRingQueue const& );
+
+    struct Cell
+    {
+        uint32	m_sequence;
+        T		m_value;
+    };
+
+    // The two positions are kept on separate cache lines, so that
+    // pushing and popping threads do not keep stealing them from each other.
+    vector<Cell>	m_cells;
+    uint32			m_mask;
+    char			m_pad0[64];
+    uint32			m_pushPos;
+    char			m_pad1[64];
+    uint32			m_popPos;
+    char			m_pad2[64];
+
+}; // class XplRingQueue
+
+} // namespace xpl
+
+#endif // _XplRingQueue_H
@@ -0,0 +1,372 @@
+/***************************************************************************
+****																	****
+****	XplScanner.cpp													****
+****																	****
+****	Fast delimiter scanning for raw xPL messages					****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include "XplCore.h"
+#include "XplScanner.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && ( _M_IX86_FP >= 2 ) )
+#define XPL_SCAN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// AVX2 is chosen at run time, so the library does not need to be built
+// with -mavx2 to use it on processors that have it.
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define XPL_SCAN_AVX2 1
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace xpl;
+
+
+namespace
+{
+
+/***************************************************************************
+****																	****
+****	CountTrailingZeros												****
+****																	****
+***************************************************************************/
+
+inline uint32 CountTrailingZeros ( uint32 _mask )
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward ( &index, _mask );
+    return ( uint32 ) index;
+#else
+    return ( uint32 ) __builtin_ctz ( _mask );
+#endif
+}
+
+
+/***************************************************************************
+****																	****
+****	AddPositions													****
+****																	****
+****	Turns a comparison bit mask into entries in the position list	****
+****																	****
+***************************************************************************/
+
+inline void AddPositions ( uint32 _mask, uint32 const _base, vector<uint32>* _pPositions )
+{
+    while ( _mask )
+    {
+        _pPositions->push_back ( _base + CountTrailingZeros ( _mask ) );
+        _mask &= ( _mask - 1 );
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	ScanTail														****
+****																	****
+***************************************************************************/
+
+inline void ScanTail
+(
+    char const* _pData,
+    uint32 _pos,
+    uint32 const _size,
+    char const _a,
+    char const _b,
+    char const _c,
+    vector<uint32>* _pPositions
+)
+{
+    for ( ; _pos < _size; ++_pos )
+    {
+        char const ch = _pData[_pos];
+        if ( ( ch == _a ) || ( ch == _b ) || ( ch == _c ) )
+        {
+            _pPositions->push_back ( _pos );
+        }
+    }
+}
+
+
+#ifdef XPL_SCAN_SSE2
+/***************************************************************************
+****																	****
+****	ScanSse2														****
+****																	****
+***************************************************************************/
+
+uint32 ScanSse2
+(
+    char const* _pData,
+    uint32 _pos,
+    uint32 const _size,
+    char const _a,
+    char const _b,
+    char const _c,
+    vector<uint32>* _pPositions
+)
+{
+    __m128i const a = _mm_set1_epi8 ( _a );
+    __m128i const b = _mm_set1_epi8 ( _b );
+    __m128i const c = _mm_set1_epi8 ( _c );
+
+    for ( ; _pos + 16 <= _size; _pos += 16 )
+    {
+        __m128i const block = _mm_loadu_si128 ( ( __m128i const* ) ( _pData + _pos ) );
+        __m128i const hits = _mm_or_si128 ( _mm_or_si128 ( _mm_cmpeq_epi8 ( block, a ), _mm_cmpeq_epi8 ( block, b ) ), _mm_cmpeq_epi8 ( block, c ) );
+        AddPositions ( ( uint32 ) _mm_movemask_epi8 ( hits ), _pos, _pPositions );
+    }
+    return _pos;
+}
+#endif
+
+
+#ifdef XPL_SCAN_AVX2
+/***************************************************************************
+****																	****
+****	ScanAvx2														****
+****																	****
+***************************************************************************/
+
+__attribute__ ( ( target ( "avx2" ) ) )
+uint32 ScanAvx2
+(
+    char const* _pData,
+    uint32 _pos,
+    uint32 const _size,
+    char const _a,
+    char const _b,
+    char const _c,
+    vector<uint32>* _pPositions
+)
+{
+    __m256i const a = _mm256_set1_epi8 ( _a );
+    __m256i const b = _mm256_set1_epi8 ( _b );
+    __m256i const c = _mm256_set1_epi8 ( _c );
+
+    for ( ; _pos + 32 <= _size; _pos += 32 )
+    {
+        __m256i const block = _mm256_loadu_si256 ( ( __m256i const* ) ( _pData + _pos ) );
+        __m256i const hits = _mm256_or_si256 ( _mm256_or_si256 ( _mm256_cmpeq_epi8 ( block, a ), _mm256_cmpeq_epi8 ( block, b ) ), _mm256_cmpeq_epi8 ( block, c ) );
+        AddPositions ( ( uint32 ) _mm256_movemask_epi8 ( hits ), _pos, _pPositions );
+    }
+    return _pos;
+}
+
+bool HasAvx2()
+{
+    return __builtin_cpu_supports ( "avx2" );
+}
+#endif
+
+} // namespace
+
+
+/***************************************************************************
+****																	****
+****	ScanForChars													****
+****																	****
+***************************************************************************/
+
+void xpl::ScanForChars
+(
+    char const* _pData,
+    uint32 const _size,
+    char const _a,
+    char const _b,
+    char const _c,
+    vector<uint32>* _pPositions
+)
+{
+    _pPositions->clear();
+
+    // Each stage carries on from where the wider one left off
+    uint32 pos = 0;
+#if defined(XPL_SCAN_AVX2)
+    static bool const s_bAvx2 = HasAvx2();
+    if ( s_bAvx2 )
+    {
+        pos = ScanAvx2 ( _pData, pos, _size, _a, _b, _c, _pPositions );
+    }
+#endif
+#if defined(XPL_SCAN_SSE2)
+    pos = ScanSse2 ( _pData, pos, _size, _a, _b, _c, _pPositions );
+#endif
+
+    ScanTail ( _pData, pos, _size, _a, _b, _c, _pPositions );
+}
+
+
+/***************************************************************************
+****																	****
+****	ScanForCharsScalar												****
+****																	****
+***************************************************************************/
+
+void xpl::ScanForCharsScalar
+(
+    char const* _pData,
+    uint32 const _size,
+    char const _a,
+    char const _b,
+    char const _c,
+    vector<uint32>* _pPositions
+)
+{
+    _pPositions->clear();
+    ScanTail ( _pData, 0, _size, _a, _b, _c, _pPositions );
+}
+
+
+/***************************************************************************
+****																	****
+****	IsScanMethodAvailable											****
+****																	****
+***************************************************************************/
+
+bool xpl::IsScanMethodAvailable
+(
+    ScanMethod const _method
+)
+{
+    switch ( _method )
+    {
+    case kScanScalar:
+        return true;
+#if defined(XPL_SCAN_SSE2)
+    case kScanSse2:
+        return true;
+#endif
+#if defined(XPL_SCAN_AVX2)
+    case kScanAvx2:
+        return HasAvx2();
+#endif
+    default:
+        return false;
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	ScanForCharsUsing												****
+****																	****
+***************************************************************************/
+
+bool xpl::ScanForCharsUsing
+(
+    ScanMethod const _method,
+    char const* _pData,
+    uint32 const _size,
+    char const _a,
+    char const _b,
+    char const _c,
+    vector<uint32>* _pPositions
+)
+{
+    _pPositions->clear();
+    if ( !IsScanMethodAvailable ( _method ) )
+    {
+        return false;
+    }
+
+    uint32 pos = 0;
+#if defined(XPL_SCAN_AVX2)
+    if ( kScanAvx2 == _method )
+    {
+        pos = ScanAvx2 ( _pData, pos, _size, _a, _b, _c, _pPositions );
+    }
+#endif
+#if defined(XPL_SCAN_SSE2)
+    if ( kScanSse2 == _method )
+    {
+        pos = ScanSse2 ( _pData, pos, _size, _a, _b, _c, _pPositions );
+    }
+#endif
+
+    ScanTail ( _pData, pos, _size, _a, _b, _c, _pPositions );
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplLineTable::Build												****
+****																	****
+***************************************************************************/
+
+void XplLineTable::Build
+(
+    char const* _pData,
+    uint32 const _size
+)
+{
+    m_lines.clear();
+    ScanForChars ( _pData, _size, '\n', '\r', '=', &m_positions );
+
+    Line line;
+    line.m_start = 0;
+    line.m_equals = XplStringView::npos;
+
+    // Walk the delimiters in order, closing a line at each
+    // line terminator and noting the first '=' in each line.
+    for ( vector<uint32>::const_iterator iter = m_positions.begin(); iter != m_positions.end(); ++iter )
+    {
+        uint32 const pos = *iter;
+        if ( '=' == _pData[pos] )
+        {
+            if ( XplStringView::npos == line.m_equals )
+            {
+                line.m_equals = pos;
+            }
+            continue;
+        }
+
+        if ( pos > line.m_start )
+        {
+            line.m_end = pos;
+            m_lines.push_back ( line );
+        }
+        line.m_start = pos + 1;
+        line.m_equals = XplStringView::npos;
+    }
+
+    // The last line may not have a terminator
+    if ( _size > line.m_start )
+    {
+        line.m_end = _size;
+        m_lines.push_back ( line );
+    }
+}
@@ -0,0 +1,154 @@
+/***************************************************************************
+****																	****
+****	XplScanner.h													****
+****																	****
+****	Fast delimiter scanning for raw xPL messages					****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplScanner_H
+#define _XplScanner_H
+
+#include <vector>
+#include "XplCore.h"
+#include "XplStringView.h"
+
+namespace xpl
+{
+
+/**
+ * Finds every occurrence of up to three characters in a buffer.
+ * The buffer is examined in a single pass.  Where the processor allows it,
+ * 32 bytes (AVX2) or 16 bytes (SSE2) are compared at a time, with a plain
+ * byte loop used for the remainder and on other processors.  To look for
+ * fewer than three characters, simply repeat one of them.
+ * @param _pData the buffer to scan.
+ * @param _size number of bytes in the buffer.
+ * @param _a first character to look for.
+ * @param _b second character to look for.
+ * @param _c third character to look for.
+ * @param _pPositions vector that will be filled with the positions of the
+ * characters, in ascending order.  Any previous contents are discarded,
+ * but its capacity is kept, so a vector can be reused without allocating.
+ */
+void ScanForChars ( char const* _pData, uint32 const _size, char const _a, char const _b, char const _c, vector<uint32>* _pPositions );
+
+/**
+ * The same as ScanForChars, but always uses the plain byte loop.
+ * Provided for comparison and for checking the vectorised versions.
+ */
+void ScanForCharsScalar ( char const* _pData, uint32 const _size, char const _a, char const _b, char const _c, vector<uint32>* _pPositions );
+
+/**
+ * The ways of examining a buffer that ScanForChars chooses between.
+ */
+enum ScanMethod
+{
+    kScanScalar,		// One byte at a time
+    kScanSse2,			// 16 bytes at a time
+    kScanAvx2			// 32 bytes at a time
+};
+
+/**
+ * Tests whether a scanning method can be used with this build on this
+ * processor.
+ */
+bool IsScanMethodAvailable ( ScanMethod const _method );
+
+/**
+ * The same as ScanForChars, but always uses the given method, with the
+ * plain byte loop for the remainder.  Provided so that the methods can be
+ * checked against each other and timed.
+ * @return false, with _pPositions left empty, if the method cannot be used.
+ * @see IsScanMethodAvailable
+ */
+bool ScanForCharsUsing ( ScanMethod const _method, char const* _pData, uint32 const _size, char const _a, char const _b, char const _c, vector<uint32>* _pPositions );
+
+/**
+ * Table of the lines in a raw xPL message.
+ * Build() scans the message once for line feeds, carriage returns and '='
+ * signs, and records where each line starts and ends, and where its first
+ * '=' is.  The message parser works from this table instead of searching
+ * the text line by line.  Empty lines are left out of the table.
+ */
+class XplLineTable
+{
+public:
+    struct Line
+    {
+        uint32	m_start;		// Index of the first character of the line
+        uint32	m_end;			// Index one past the last character, excluding the line terminator
+        uint32	m_equals;		// Index of the first '=' in the line, or XplStringView::npos
+    };
+
+    /**
+     * Scans a buffer and fills in the table.
+     * @param _pData the raw message.
+     * @param _size number of bytes in the message.
+     */
+    void Build ( char const* _pData, uint32 const _size );
+
+    /**
+     * Removes all the lines, but keeps the memory for reuse.
+     */
+    void Clear()
+    {
+        m_lines.clear();
+        m_positions.clear();
+    }
+
+    /**
+     * Exchanges the contents, and memory, of two tables.
+     */
+    void Swap ( XplLineTable& _other )
+    {
+        m_lines.swap ( _other.m_lines );
+        m_positions.swap ( _other.m_positions );
+    }
+
+    uint32 GetNumLines() const
+    {
+        return ( uint32 ) m_lines.size();
+    }
+
+    Line const& GetLine ( uint32 const _index ) const
+    {
+        return m_lines[_index];
+    }
+
+private:
+    vector<Line>	m_lines;
+    vector<uint32>	m_positions;	// Scratch space for ScanForChars
+
+}; // class XplLineTable
+
+} // namespace xpl
+
+#endif // _XplScanner_H
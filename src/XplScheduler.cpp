@@ -0,0 +1,692 @@
+/***************************************************************************
+****																	****
+****	XplScheduler.cpp												****
+****																	****
+****	Shared timer thread for many XplDevices							****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include <string.h>
+#include "XplCore.h"
+#include "XplScheduler.h"
+#include "Poco/NumberFormatter.h"
+#include "Poco/Timestamp.h"
+#include "Poco/ErrorHandler.h"
+
+using namespace xpl;
+using Poco::FastMutex;
+
+static uint64_t const c_never = ~( uint64_t ) 0;
+
+
+/***************************************************************************
+****																	****
+****	Mix																****
+****																	****
+****	Scrambles the bits of a key, so that similar keys give very		****
+****	different results.  The finaliser from MurmurHash3.				****
+****																	****
+***************************************************************************/
+
+static uint32 Mix
+(
+    uint32 _key
+)
+{
+    _key ^= _key >> 16;
+    _key *= 0x85ebca6b;
+    _key ^= _key >> 13;
+    _key *= 0xc2b2ae35;
+    _key ^= _key >> 16;
+    return _key;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::Task Constructor									****
+****																	****
+***************************************************************************/
+
+XplScheduler::Task::Task() :
+    m_pNext ( NULL ),
+    m_ppPrev ( NULL ),
+    m_tick ( 0 ),
+    m_runningTid ( 0 ),
+    m_bReady ( false ),
+    m_bRequeue ( false )
+{
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler Constructor										****
+****																	****
+***************************************************************************/
+
+XplScheduler::XplScheduler
+(
+    uint32 const _numThreads
+) :
+    m_pReady ( NULL ),
+    m_ppReadyTail ( &m_pReady ),
+    m_tick ( 0 ),
+    m_numScheduled ( 0 ),
+    m_numInWheel ( 0 ),
+    m_wakeTick ( c_never ),
+    m_numThreads ( _numThreads ? _numThreads : 1 ),
+    m_bStopping ( false ),
+    m_jitterPercent ( 10 ),
+    m_bPhaseSpreading ( true ),
+    m_burstSecond ( 0 )
+{
+    memset ( m_slots, 0, sizeof ( m_slots ) );
+    memset ( &m_stats, 0, sizeof ( m_stats ) );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler Destructor											****
+****																	****
+***************************************************************************/
+
+XplScheduler::~XplScheduler()
+{
+    vector<Worker*> workers;
+    {
+        FastMutex::ScopedLock lock ( m_lock );
+        m_bStopping = true;
+        workers.swap ( m_workers );
+    }
+
+    // Each worker that stops passes the wakeup on to the next
+    m_wake.set();
+    for ( uint32 i=0; i<workers.size(); ++i )
+    {
+        workers[i]->m_thread.join();
+        delete workers[i];
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::Get												****
+****																	****
+***************************************************************************/
+
+XplScheduler& XplScheduler::Get()
+{
+    static XplScheduler s_scheduler;
+    return s_scheduler;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::SetNumThreads										****
+****																	****
+***************************************************************************/
+
+void XplScheduler::SetNumThreads
+(
+    uint32 const _numThreads
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    if ( m_workers.empty() )
+    {
+        m_numThreads = _numThreads ? _numThreads : 1;
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::Schedule											****
+****																	****
+***************************************************************************/
+
+void XplScheduler::Schedule
+(
+    Task* _pTask,
+    int64_t const _due
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    if ( m_bStopping )
+    {
+        return;
+    }
+
+    if ( m_workers.empty() )
+    {
+        for ( uint32 i=0; i<m_numThreads; ++i )
+        {
+            Worker* pWorker = new Worker ( *this );
+            pWorker->m_thread.setName ( "scheduler thread " + Poco::NumberFormatter::format ( i ) );
+            pWorker->m_thread.start ( *pWorker );
+            m_workers.push_back ( pWorker );
+        }
+    }
+
+    _pTask->m_tick = ( _due > 0 ) ? ( ( uint64_t ) _due + c_tickUs - 1 ) / c_tickUs : 0;
+    if ( _pTask->m_runningTid )
+    {
+        // RunTasks puts it back when it has finished
+        _pTask->m_bRequeue = true;
+        return;
+    }
+
+    if ( _pTask->m_ppPrev )
+    {
+        Remove ( _pTask );
+    }
+
+    // An empty wheel can skip straight to the present, rather than
+    // stepping through every tick since it was last used.
+    if ( 0 == m_numInWheel )
+    {
+        uint64_t const now = ( uint64_t ) Poco::Timestamp().epochMicroseconds() / c_tickUs;
+        if ( m_tick < now )
+        {
+            m_tick = now;
+        }
+    }
+
+    Insert ( _pTask );
+
+    // Wake a thread if it is sleeping for too long
+    if ( _pTask->m_bReady || ( _pTask->m_tick < m_wakeTick ) )
+    {
+        m_wakeTick = _pTask->m_tick;
+        m_wake.set();
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::Cancel											****
+****																	****
+***************************************************************************/
+
+void XplScheduler::Cancel
+(
+    Task* _pTask
+)
+{
+    long const tid = Poco::Thread::currentTid();
+    while ( 1 )
+    {
+        {
+            FastMutex::ScopedLock lock ( m_lock );
+            if ( _pTask->m_ppPrev )
+            {
+                Remove ( _pTask );
+            }
+            _pTask->m_bRequeue = false;
+
+            // A task may cancel itself from OnScheduled
+            if ( ( 0 == _pTask->m_runningTid ) || ( tid == _pTask->m_runningTid ) )
+            {
+                return;
+            }
+        }
+
+        // Still running on another thread.  This is rare enough that
+        // it is not worth a condition variable.
+        Poco::Thread::sleep ( 1 );
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::GetNumScheduled									****
+****																	****
+***************************************************************************/
+
+uint32 XplScheduler::GetNumScheduled() const
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    return m_numScheduled;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::SetJitter											****
+****																	****
+***************************************************************************/
+
+void XplScheduler::SetJitter
+(
+    uint32 const _percent
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    m_jitterPercent = ( _percent > 100 ) ? 100 : _percent;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::SetPhaseSpreading									****
+****																	****
+***************************************************************************/
+
+void XplScheduler::SetPhaseSpreading
+(
+    bool const _bEnable
+)
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    m_bPhaseSpreading = _bEnable;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::GetPhase											****
+****																	****
+***************************************************************************/
+
+int64_t XplScheduler::GetPhase
+(
+    uint32 const _key,
+    int64_t const _period
+) const
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    if ( !m_bPhaseSpreading || ( _period <= 0 ) )
+    {
+        return 0;
+    }
+    return ( int64_t ) ( Mix ( _key ) % ( uint64_t ) _period );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::GetJitter											****
+****																	****
+***************************************************************************/
+
+int64_t XplScheduler::GetJitter
+(
+    uint32 const _key,
+    uint32 const _count,
+    int64_t const _period
+) const
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    if ( _period <= 0 )
+    {
+        return 0;
+    }
+
+    // A hash in the range -limit to +limit
+    int64_t const limit = _period * m_jitterPercent / 100;
+    uint32 const hash = Mix ( Mix ( _key ) + _count );
+    return ( int64_t ) ( hash % ( uint64_t ) ( 2*limit + 1 ) ) - limit;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::GetStats											****
+****																	****
+***************************************************************************/
+
+XplScheduler::Stats XplScheduler::GetStats() const
+{
+    FastMutex::ScopedLock lock ( m_lock );
+    return m_stats;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::Worker::run										****
+****																	****
+***************************************************************************/
+
+void XplScheduler::Worker::run()
+{
+    m_scheduler.RunTasks();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::RunTasks											****
+****																	****
+***************************************************************************/
+
+void XplScheduler::RunTasks()
+{
+    long const tid = Poco::Thread::currentTid();
+    m_lock.lock();
+    while ( !m_bStopping )
+    {
+        if ( m_pReady )
+        {
+            Task* pTask = m_pReady;
+            Remove ( pTask );
+            pTask->m_runningTid = tid;
+            ++m_stats.m_numRun;
+
+            // Let another thread help with the rest of the batch
+            if ( m_pReady && ( m_workers.size() > 1 ) )
+            {
+                m_wake.set();
+            }
+
+            // Run it without the lock, so other tasks can be scheduled
+            m_lock.unlock();
+            try
+            {
+                pTask->OnScheduled();
+            }
+            catch ( Poco::Exception& e )
+            {
+                Poco::ErrorHandler::handle ( e );
+            }
+            catch ( std::exception& e )
+            {
+                Poco::ErrorHandler::handle ( e );
+            }
+            catch ( ... )
+            {
+                Poco::ErrorHandler::handle();
+            }
+            m_lock.lock();
+
+            pTask->m_runningTid = 0;
+            if ( pTask->m_bRequeue && !m_bStopping )
+            {
+                pTask->m_bRequeue = false;
+                Insert ( pTask );
+            }
+            continue;
+        }
+
+        // Collect everything that has fallen due since the last look
+        int64_t const now = Poco::Timestamp().epochMicroseconds();
+        Advance ( ( uint64_t ) now / c_tickUs );
+        if ( m_pReady )
+        {
+            continue;
+        }
+
+        long timeout = 60*1000;
+        m_wakeTick = GetNextTick();
+        if ( c_never != m_wakeTick )
+        {
+            // Round up, so as not to wake just before the tick starts
+            int64_t const wait = ( ( int64_t ) m_wakeTick * c_tickUs - now + 999 ) / 1000;
+            if ( wait < timeout )
+            {
+                timeout = ( long ) wait;
+            }
+        }
+
+        m_lock.unlock();
+        m_wake.tryWait ( timeout );
+        m_lock.lock();
+    }
+    m_lock.unlock();
+
+    // Wake the next worker so that it sees m_bStopping too
+    m_wake.set();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::Insert											****
+****																	****
+***************************************************************************/
+
+void XplScheduler::Insert
+(
+    Task* _pTask
+)
+{
+    ++m_numScheduled;
+    if ( _pTask->m_tick < m_tick )
+    {
+        // Its tick has already been processed
+        _pTask->m_bReady = true;
+        _pTask->m_pNext = NULL;
+        _pTask->m_ppPrev = m_ppReadyTail;
+        *m_ppReadyTail = _pTask;
+        m_ppReadyTail = &_pTask->m_pNext;
+        return;
+    }
+
+    // The level is chosen by how far away the tick is.  Anything too far
+    // away for the top level goes in the last slot it can reach, and is
+    // looked at again when that slot moves down.
+    _pTask->m_bReady = false;
+    ++m_numInWheel;
+    uint64_t tick = _pTask->m_tick;
+    uint64_t const delta = tick - m_tick;
+    uint32 level = 0;
+    while ( ( level < c_levels-1 ) && ( delta >> ( ( level+1 ) * c_slotBits ) ) )
+    {
+        ++level;
+    }
+    if ( delta >> ( c_levels * c_slotBits ) )
+    {
+        tick = m_tick + ( ( ( uint64_t ) 1 << ( c_levels * c_slotBits ) ) - 1 );
+    }
+
+    uint32 const index = ( uint32 ) ( tick >> ( level * c_slotBits ) ) & ( c_slots-1 );
+    Link ( &m_slots[level][index], _pTask );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::Remove											****
+****																	****
+***************************************************************************/
+
+void XplScheduler::Remove
+(
+    Task* _pTask
+)
+{
+    --m_numScheduled;
+    if ( _pTask->m_bReady )
+    {
+        if ( m_ppReadyTail == &_pTask->m_pNext )
+        {
+            m_ppReadyTail = _pTask->m_ppPrev;
+        }
+        _pTask->m_bReady = false;
+    }
+    else
+    {
+        --m_numInWheel;
+    }
+    Unlink ( _pTask );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::Advance											****
+****																	****
+***************************************************************************/
+
+void XplScheduler::Advance
+(
+    uint64_t const _tick
+)
+{
+    while ( m_tick <= _tick )
+    {
+        // Skip the ticks in which nothing happens
+        uint64_t const next = GetNextTick();
+        if ( next > _tick )
+        {
+            m_tick = _tick + 1;
+            break;
+        }
+        m_tick = next;
+
+        // At the start of each turn of a level, the next slot of the level
+        // above is shared out among the slots below.
+        uint32 level = 0;
+        while ( level < c_levels-1 )
+        {
+            uint32 const index = ( uint32 ) ( m_tick >> ( level * c_slotBits ) ) & ( c_slots-1 );
+            if ( index )
+            {
+                break;
+            }
+            ++level;
+            Cascade ( level, ( uint32 ) ( m_tick >> ( level * c_slotBits ) ) & ( c_slots-1 ) );
+        }
+
+        // Everything in this tick's slot is due
+        Task** ppSlot = &m_slots[0][m_tick & ( c_slots-1 )];
+        uint64_t const second = m_tick / ( 1000000 / c_tickUs );
+        ++m_tick;
+        uint32 count = 0;
+        while ( *ppSlot )
+        {
+            Task* pTask = *ppSlot;
+            Remove ( pTask );
+            Insert ( pTask );
+            ++count;
+        }
+
+        if ( count )
+        {
+            ++m_stats.m_numBatches;
+            if ( count > m_stats.m_maxPerTick )
+            {
+                m_stats.m_maxPerTick = count;
+            }
+            if ( second != m_burstSecond )
+            {
+                m_burstSecond = second;
+                m_stats.m_lastPerSecond = 0;
+            }
+            m_stats.m_lastPerSecond += count;
+            if ( m_stats.m_lastPerSecond > m_stats.m_maxPerSecond )
+            {
+                m_stats.m_maxPerSecond = m_stats.m_lastPerSecond;
+            }
+        }
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::Cascade											****
+****																	****
+***************************************************************************/
+
+void XplScheduler::Cascade
+(
+    uint32 const _level,
+    uint32 const _index
+)
+{
+    Task** ppSlot = &m_slots[_level][_index];
+    Task* pTask = *ppSlot;
+    if ( NULL == pTask )
+    {
+        return;
+    }
+
+    // Detach the whole list first, since tasks that are still far away
+    // can land back in the same slot.
+    *ppSlot = NULL;
+    while ( pTask )
+    {
+        Task* pNext = pTask->m_pNext;
+        pTask->m_pNext = NULL;
+        pTask->m_ppPrev = NULL;
+        --m_numScheduled;
+        --m_numInWheel;
+        Insert ( pTask );
+        pTask = pNext;
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplScheduler::GetNextTick										****
+****																	****
+***************************************************************************/
+
+uint64_t XplScheduler::GetNextTick() const
+{
+    if ( 0 == m_numInWheel )
+    {
+        return c_never;
+    }
+
+    // The first level holds the next turn of ticks, one per slot
+    uint64_t next = c_never;
+    for ( uint32 i=0; i<c_slots; ++i )
+    {
+        if ( m_slots[0][( m_tick + i ) & ( c_slots-1 )] )
+        {
+            next = m_tick + i;
+            break;
+        }
+    }
+
+    // A slot in a higher level has to be woken for when it cascades
+    for ( uint32 level=1; level<c_levels; ++level )
+    {
+        uint32 const shift = level * c_slotBits;
+        uint64_t const span = ( uint64_t ) 1 << shift;
+        uint64_t tick = ( ( m_tick + span - 1 ) >> shift ) << shift;
+        for ( uint32 i=0; ( i<c_slots ) && ( tick < next ); ++i, tick += span )
+        {
+            if ( m_slots[level][( tick >> shift ) & ( c_slots-1 )] )
+            {
+                next = tick;
+                break;
+            }
+        }
+    }
+    return next;
+}
@@ -0,0 +1,314 @@
+/***************************************************************************
+****																	****
+****	XplScheduler.h													****
+****																	****
+****	Shared timer thread for many XplDevices							****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplScheduler_H
+#define _XplScheduler_H
+
+#include <vector>
+#include "XplCore.h"
+#include "Poco/Mutex.h"
+#include "Poco/Event.h"
+#include "Poco/Thread.h"
+#include "Poco/Runnable.h"
+
+namespace xpl
+{
+
+/**
+ * Runs timed work, such as heartbeats, for any number of objects on one
+ * thread or a small pool of them.
+ * Each object derives from XplScheduler::Task and is given a time to run.
+ * The tasks are kept in a hierarchical timing wheel: four levels of 256
+ * slots, each slot a linked list of the tasks due in it.  The first level
+ * has a slot for each 10ms tick, and each level above covers 256 times as
+ * much time as the one below, up to well over a year.  Tasks in the upper
+ * levels are moved down a level as their time gets closer.  Scheduling,
+ * moving and cancelling a task are all O(1), however many there are.
+ * <p>
+ * A thread with nothing to do sleeps until the next tick that has work in
+ * it.  It then moves every task that has fallen due onto a ready list in
+ * one go, and the tasks are run one after the other, so heartbeats that
+ * fall in the same tick are sent together.
+ * <p>
+ * A task is never run by two threads at once.  If it is scheduled while it
+ * is running, from OnScheduled or from another thread, it goes back into
+ * the wheel when it has finished.
+ * <p>
+ * Devices that start together would otherwise send their heartbeats
+ * together for as long as they run.  GetPhase and GetJitter give each
+ * device its own offsets, worked out from a hash of its name, so the same
+ * device always gets the same ones while different devices are spread
+ * out.  GetStats reports the largest bursts of tasks that fell due at
+ * the same time.
+ * <p>
+ * Get() returns a scheduler shared by the whole process, which is what
+ * XplDevice uses unless it is given another one.  The threads are only
+ * started when the first task is scheduled.
+ */
+class XplScheduler
+{
+public:
+    /**
+     * Something that can be scheduled.  It must be cancelled before it
+     * is destroyed.
+     */
+    class Task
+    {
+    public:
+        Task();
+        virtual ~Task() {}
+
+        /**
+         * Called on one of the scheduler's threads when the task is due.
+         */
+        virtual void OnScheduled() = 0;
+
+    private:
+        friend class XplScheduler;
+
+        Task*		m_pNext;			// Next task in the same slot or the ready list
+        Task**		m_ppPrev;			// Pointer that points at this task, or NULL if it is in no list
+        uint64_t	m_tick;				// Tick in which the task is due
+        long		m_runningTid;		// Thread running OnScheduled, or zero
+        bool		m_bReady;			// True if it is on the ready list rather than in the wheel
+        bool		m_bRequeue;			// Scheduled again while running
+    };
+
+    /**
+     * Constructor.
+     * @param _numThreads the number of threads to start once the first
+     * task is scheduled.
+     */
+    XplScheduler ( uint32 const _numThreads = 1 );
+
+    /**
+     * Destructor.  Stops the threads.  Any tasks still scheduled are
+     * not run.
+     */
+    ~XplScheduler();
+
+    /**
+     * Gets the scheduler shared by the whole process.
+     */
+    static XplScheduler& Get();
+
+    /**
+     * Sets the number of threads.  Only has an effect before the first
+     * task is scheduled.
+     */
+    void SetNumThreads ( uint32 const _numThreads );
+
+    /**
+     * Schedules a task, or moves it if it is already scheduled.
+     * @param _pTask the task.  The scheduler does not take ownership.
+     * @param _due when to run it, as a Poco::Timestamp epoch time in
+     * microseconds.  It is rounded up to the next tick.  Times in the
+     * past run as soon as possible.
+     */
+    void Schedule ( Task* _pTask, int64_t const _due );
+
+    /**
+     * Cancels a task.  If it is running on another thread, waits until
+     * it has finished, so the task can safely be destroyed afterwards.
+     * Does nothing if the task is not scheduled.
+     */
+    void Cancel ( Task* _pTask );
+
+    /**
+     * Gets the number of tasks waiting to run.
+     */
+    uint32 GetNumScheduled() const;
+
+    /**
+     * Sets how much GetJitter may move a task.
+     * @param _percent the most a period can be lengthened or shortened,
+     * as a percentage of it.  Zero turns jitter off.  The default is 10.
+     */
+    void SetJitter ( uint32 const _percent );
+
+    /**
+     * Turns phase spreading on or off.  It is on by default.
+     * @see GetPhase
+     */
+    void SetPhaseSpreading ( bool const _bEnable );
+
+    /**
+     * Gets how long a task should wait before the first of a series of
+     * runs at a regular period, so that tasks that start the series
+     * together are spread over the whole period.
+     * @param _key identifies the task, such as a hash of a device's name.
+     * @param _period the period in microseconds.
+     * @return an offset from zero up to, but not including, the period,
+     * or zero if phase spreading is off.
+     */
+    int64_t GetPhase ( uint32 const _key, int64_t const _period ) const;
+
+    /**
+     * Gets a small adjustment to a period, so that tasks with the same
+     * period drift apart rather than staying in step.
+     * @param _key identifies the task, such as a hash of a device's name.
+     * @param _count changes the result for each run, such as the number
+     * of times the task has run.
+     * @param _period the period in microseconds.
+     * @return an offset of up to the jitter percentage of the period
+     * either way.
+     */
+    int64_t GetJitter ( uint32 const _key, uint32 const _count, int64_t const _period ) const;
+
+    /**
+     * Counters for the tasks that have been run.
+     */
+    struct Stats
+    {
+        uint32	m_numRun;			// Tasks run
+        uint32	m_numBatches;		// Ticks in which at least one task fell due
+        uint32	m_maxPerTick;		// Most tasks due in a single tick
+        uint32	m_maxPerSecond;		// Most tasks due in a single second
+        uint32	m_lastPerSecond;	// Tasks due in the most recent second that had any
+    };
+
+    /**
+     * Gets the counters.
+     */
+    Stats GetStats() const;
+
+    static int64_t const	c_tickUs = 10000;		// Length of a tick in microseconds
+
+private:
+    // Not copyable
+    XplScheduler ( XplScheduler const& );
+    XplScheduler& operator = ( XplScheduler const& );
+
+    static uint32 const		c_levels = 4;
+    static uint32 const		c_slotBits = 8;
+    static uint32 const		c_slots = 1 << c_slotBits;
+
+    class Worker: public Poco::Runnable
+    {
+    public:
+        Worker ( XplScheduler& _scheduler ): m_scheduler ( _scheduler ) {}
+        virtual void run();
+
+        XplScheduler&	m_scheduler;
+        Poco::Thread	m_thread;
+    };
+    friend class Worker;
+
+    /**
+     * Runs the tasks as they fall due, until the scheduler is destroyed.
+     */
+    void RunTasks();
+
+    /**
+     * Puts a task in the slot for its tick, or on the ready list if that
+     * tick has already gone.  Called with m_lock held.
+     */
+    void Insert ( Task* _pTask );
+
+    /**
+     * Takes a task out of the wheel or the ready list.  Called with
+     * m_lock held.
+     */
+    void Remove ( Task* _pTask );
+
+    /**
+     * Moves the wheel on to a tick, putting every task that has become due
+     * on the ready list.  Called with m_lock held.
+     */
+    void Advance ( uint64_t const _tick );
+
+    /**
+     * Takes the tasks out of a slot and puts them back in, one level
+     * lower down.  Called with m_lock held.
+     */
+    void Cascade ( uint32 const _level, uint32 const _index );
+
+    /**
+     * Works out the first tick that might have tasks to run or move down
+     * a level.  Called with m_lock held.
+     * @return the tick, or zero if the wheel is empty.
+     */
+    uint64_t GetNextTick() const;
+
+    /**
+     * Links a task into a list.
+     */
+    static void Link ( Task** _ppHead, Task* _pTask )
+    {
+        _pTask->m_pNext = *_ppHead;
+        if ( _pTask->m_pNext )
+        {
+            _pTask->m_pNext->m_ppPrev = &_pTask->m_pNext;
+        }
+        _pTask->m_ppPrev = _ppHead;
+        *_ppHead = _pTask;
+    }
+
+    /**
+     * Takes a task out of whichever list it is in.
+     */
+    static void Unlink ( Task* _pTask )
+    {
+        *_pTask->m_ppPrev = _pTask->m_pNext;
+        if ( _pTask->m_pNext )
+        {
+            _pTask->m_pNext->m_ppPrev = _pTask->m_ppPrev;
+        }
+        _pTask->m_pNext = NULL;
+        _pTask->m_ppPrev = NULL;
+    }
+
+    Task*						m_slots[c_levels][c_slots];	// Each slot is a list of tasks
+    Task*						m_pReady;		// Tasks that are due, waiting for a thread
+    Task**						m_ppReadyTail;	// Where to link the next ready task, so they run in order
+    uint64_t					m_tick;			// The next tick to be processed
+    uint32						m_numScheduled;	// Tasks in the wheel or the ready list
+    uint32						m_numInWheel;
+    uint64_t					m_wakeTick;		// Tick at which the sleeping threads will next look at the wheel
+    vector<Worker*>				m_workers;
+    uint32						m_numThreads;
+    bool						m_bStopping;
+    uint32						m_jitterPercent;
+    bool						m_bPhaseSpreading;
+    Stats						m_stats;
+    uint64_t					m_burstSecond;	// Second that m_stats.m_lastPerSecond counts
+    Poco::Event					m_wake;			// Set when there are tasks earlier than m_wakeTick
+    mutable Poco::FastMutex		m_lock;
+
+}; // class XplScheduler
+
+} // namespace xpl
+
+#endif // _XplScheduler_H
@@ -128,3 +128,82 @@ bool xpl::StringSplit
 
 
 
+
+
+/***************************************************************************
+****																	****
+****	StringReadLine (view)											****
+****																	****
+****	As above, but returns a view into the source buffer instead		****
+****	of allocating a new string for the line							****
+****																	****
+***************************************************************************/
+
+uint32 xpl::StringReadLine
+(
+    XplStringView const& _str,
+    uint32 const _start,
+    XplStringView* _pLine
+)
+{
+    uint32 pos = _start;
+    uint32 const end = _str.size();
+
+    while ( pos < end )
+    {
+        // Look for the next linefeed or end of data
+        uint32 lineStart = pos;
+        while ( ( pos < end ) && ( _str[pos] != '\n' ) && ( _str[pos] != '\r' ) )
+        {
+            ++pos;
+        }
+
+        *_pLine = _str.substr ( lineStart, pos - lineStart ).trim();
+
+        if ( pos < end )
+        {
+            // Step over the line terminator
+            ++pos;
+        }
+
+        if ( !_pLine->empty() )
+        {
+            // We have a line
+            return ( pos );
+        }
+
+        // Line was empty, so we carry on.
+    }
+
+    // We have reached the end of the data
+    *_pLine = XplStringView ( _str.data() + end, 0 );
+    return ( end );
+}
+
+
+/***************************************************************************
+****																	****
+****	StringSplit (view)												****
+****																	****
+***************************************************************************/
+
+bool xpl::StringSplit
+(
+    XplStringView const& _source,
+    char const _delim,
+    XplStringView* _pLeftStr,
+    XplStringView* _pRightStr
+)
+{
+    uint32 pos = _source.find ( _delim );
+    if ( XplStringView::npos != pos )
+    {
+        // Character found
+        *_pLeftStr = _source.substr ( 0, pos ).trim();
+        *_pRightStr = _source.substr ( pos+1 ).trim();
+        return true;
+    }
+
+    // Character not found
+    return false;
+}
@@ -41,6 +41,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "XplCore.h"
+#include "XplStringView.h"
 
 namespace xpl
 {
@@ -74,6 +75,32 @@ uint32 StringReadLine ( string const& _str, uint32 const _start, string* _pLine
  */
 bool StringSplit ( string const& _source, char const _delim, string* _pLeftStr, string* _pRightStr );
 
+/**
+ * Reads a line of text from a buffer without copying it.
+ * Behaves exactly like the string version, except that the line is
+ * returned as a view into _str rather than as a new string.
+ * @param _str view of the buffer containing all the text.
+ * @param _start the index into the buffer where the line of text starts.
+ * @param _pLine pointer to a view that will be set to the trimmed line of text.
+ * @return A new start position to use in subsequent calls.
+ */
+uint32 StringReadLine ( XplStringView const& _str, uint32 const _start, XplStringView* _pLine );
+
+/**
+ * Splits a view into two pieces without copying it.
+ * Behaves exactly like the string version, except that the two pieces are
+ * returned as views into _source.
+ * @param _source view of the text to be split.
+ * @param _delim the delimiting character.
+ * @param _pLeftStr pointer to a view that will be set to the trimmed text to
+ * the left of the delimiting character.
+ * @param _pRightStr pointer to a view that will be set to the trimmed text to
+ * the right of the delimiting character.
+ * @return True if the delimiting character was found and the view split in two.
+ * Otherwise returns false.
+ */
+bool StringSplit ( XplStringView const& _source, char const _delim, XplStringView* _pLeftStr, XplStringView* _pRightStr );
+
 
 } // namespace xpl
 
@@ -0,0 +1,225 @@
+/***************************************************************************
+****																	****
+****	XplStringView.h													****
+****																	****
+****	Non-owning view of a range of characters						****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplStringView_H
+#define _XplStringView_H
+
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <ostream>
+#include "XplCore.h"
+
+namespace xpl
+{
+
+/**
+ * A read-only slice of characters owned by somebody else.
+ * An XplStringView is nothing more than a pointer and a length.  It is used
+ * when parsing received messages, so that the header fields and name=value
+ * pairs can be examined where they sit in the receive buffer instead of
+ * being copied into a new string for every line.  A view is only valid for
+ * as long as the buffer it points into is left alone.  Call toString() to
+ * get a copy that can be kept.
+ */
+class XplStringView
+{
+public:
+    static uint32 const npos = 0xffffffff;
+
+    XplStringView() :
+        m_pData ( "" ),
+        m_size ( 0 )
+    {
+    }
+
+    XplStringView ( char const* _pData, uint32 const _size ) :
+        m_pData ( _pData ),
+        m_size ( _size )
+    {
+    }
+
+    XplStringView ( char const* _pStr ) :
+        m_pData ( _pStr ),
+        m_size ( ( uint32 ) strlen ( _pStr ) )
+    {
+    }
+
+    XplStringView ( string const& _str ) :
+        m_pData ( _str.data() ),
+        m_size ( ( uint32 ) _str.size() )
+    {
+    }
+
+    char const* data() const
+    {
+        return m_pData;
+    }
+
+    uint32 size() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return ( 0 == m_size );
+    }
+
+    char operator[] ( uint32 const _index ) const
+    {
+        return m_pData[_index];
+    }
+
+    /**
+     * Gets part of the view.
+     * @param _pos index of the first character.
+     * @param _len maximum number of characters.  Defaults to the rest of the view.
+     * @return A view of the requested characters, clipped to this view.
+     */
+    XplStringView substr ( uint32 const _pos, uint32 const _len = npos ) const
+    {
+        if ( _pos >= m_size )
+        {
+            return XplStringView ( m_pData + m_size, 0 );
+        }
+        uint32 len = m_size - _pos;
+        if ( _len < len )
+        {
+            len = _len;
+        }
+        return XplStringView ( m_pData + _pos, len );
+    }
+
+    /**
+     * Finds the first occurence of a character.
+     * @return The index of the character, or npos if it is not present.
+     */
+    uint32 find ( char const _ch, uint32 const _start = 0 ) const
+    {
+        if ( _start >= m_size )
+        {
+            return npos;
+        }
+        void const* pFound = memchr ( m_pData + _start, _ch, m_size - _start );
+        return pFound ? ( uint32 ) ( ( char const* ) pFound - m_pData ) : npos;
+    }
+
+    /**
+     * Removes whitespace from both ends of the view.
+     * @return A view without leading or trailing whitespace.
+     */
+    XplStringView trim() const
+    {
+        uint32 first = 0;
+        uint32 last = m_size;
+        while ( ( first < last ) && isspace ( ( unsigned char ) m_pData[first] ) )
+        {
+            ++first;
+        }
+        while ( ( last > first ) && isspace ( ( unsigned char ) m_pData[last-1] ) )
+        {
+            --last;
+        }
+        return XplStringView ( m_pData + first, last - first );
+    }
+
+    /**
+     * Compares the view with another, ignoring the case of the characters.
+     */
+    bool equalsNoCase ( XplStringView const& _rhs ) const
+    {
+        if ( m_size != _rhs.m_size )
+        {
+            return false;
+        }
+        for ( uint32 i=0; i<m_size; ++i )
+        {
+            if ( tolower ( ( unsigned char ) m_pData[i] ) != tolower ( ( unsigned char ) _rhs.m_pData[i] ) )
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Copies the characters into a new string.
+     */
+    string toString() const
+    {
+        return string ( m_pData, m_size );
+    }
+
+    /**
+     * Copies the characters into a new string, converting them to lower case.
+     */
+    string toLowerString() const
+    {
+        string str ( m_pData, m_size );
+        for ( string::iterator iter = str.begin(); iter != str.end(); ++iter )
+        {
+            *iter = ( char ) tolower ( ( unsigned char ) *iter );
+        }
+        return str;
+    }
+
+    bool operator == ( XplStringView const& _rhs ) const
+    {
+        return ( m_size == _rhs.m_size ) && ( 0 == memcmp ( m_pData, _rhs.m_pData, m_size ) );
+    }
+
+    bool operator != ( XplStringView const& _rhs ) const
+    {
+        return !( *this == _rhs );
+    }
+
+private:
+    char const*	m_pData;
+    uint32		m_size;
+
+}; // class XplStringView
+
+/**
+ * Writes the characters of a view to a stream.
+ */
+inline std::ostream& operator << ( std::ostream& _stream, XplStringView const& _str )
+{
+    return _stream.write ( _str.data(), _str.size() );
+}
+
+} // namespace xpl
+
+#endif // _XplStringView_H
@@ -0,0 +1,322 @@
+/***************************************************************************
+****																	****
+****	XplSymbol.cpp													****
+****																	****
+****	Interned identifiers											****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include <string.h>
+#include <ctype.h>
+#include "XplCore.h"
+#include "XplSymbol.h"
+#include "XplNameIndex.h"
+
+using namespace xpl;
+
+// Number of slots in the first hash table.  Must be a power of two.
+static uint32 const c_initialSlots = 64;
+
+
+/***************************************************************************
+****																	****
+****	Equals															****
+****																	****
+****	Compares a name in the table with a name being looked up,		****
+****	optionally folding the second one to lower case.				****
+****																	****
+***************************************************************************/
+
+static inline bool Equals
+(
+    string const& _entry,
+    XplStringView const& _str,
+    bool const _bLower
+)
+{
+    if ( _entry.size() != _str.size() )
+    {
+        return false;
+    }
+
+    if ( !_bLower )
+    {
+        return ( 0 == memcmp ( _entry.data(), _str.data(), _str.size() ) );
+    }
+
+    for ( uint32 i=0; i<_str.size(); ++i )
+    {
+        if ( _entry[i] != ( char ) tolower ( ( unsigned char ) _str[i] ) )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplSymbolTable Constructor										****
+****																	****
+***************************************************************************/
+
+XplSymbolTable::XplSymbolTable() :
+    m_numSymbols ( 0 )
+{
+    memset ( m_pChunks, 0, sizeof ( m_pChunks ) );
+
+    m_pTable = new Table;
+    m_pTable->m_mask = c_initialSlots - 1;
+    m_pTable->m_pSlots = new uint32[c_initialSlots];
+    memset ( m_pTable->m_pSlots, 0, c_initialSlots * sizeof ( uint32 ) );
+
+    // These two must get the IDs given by c_empty and c_wildcard
+    Add ( XplStringView() );
+    Add ( XplStringView ( "*" ) );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplSymbolTable::Get												****
+****																	****
+***************************************************************************/
+
+XplSymbolTable& XplSymbolTable::Get()
+{
+    // Created on first use, so the table can be used while other
+    // statics are being initialised.  Like the message pools, it is
+    // never destroyed, as threads that are still running and strings
+    // returned by GetString may use it while statics are torn down.
+    static XplSymbolTable* s_pTable = new XplSymbolTable;
+    return *s_pTable;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplSymbolTable::Intern											****
+****																	****
+***************************************************************************/
+
+uint32 XplSymbolTable::Intern
+(
+    XplStringView const& _str
+)
+{
+    XplSymbolTable& table = Get();
+    uint32 const id = table.Lookup ( _str, XplNameIndex::Hash ( _str ), false );
+    if ( c_none != id )
+    {
+        return id;
+    }
+    return table.Add ( _str );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplSymbolTable::Find											****
+****																	****
+***************************************************************************/
+
+uint32 XplSymbolTable::Find
+(
+    XplStringView const& _str
+)
+{
+    return Get().Lookup ( _str, XplNameIndex::Hash ( _str ), false );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplSymbolTable::FindLower										****
+****																	****
+***************************************************************************/
+
+uint32 XplSymbolTable::FindLower
+(
+    XplStringView const& _str
+)
+{
+    return Get().Lookup ( _str, XplNameIndex::Hash ( _str ), true );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplSymbolTable::GetString										****
+****																	****
+***************************************************************************/
+
+string const& XplSymbolTable::GetString
+(
+    uint32 const _id
+)
+{
+    XplSymbolTable const& table = Get();
+    assert ( _id < __atomic_load_n ( &table.m_numSymbols, __ATOMIC_ACQUIRE ) );
+    return table.GetEntry ( _id ).m_str;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplSymbolTable::GetNumSymbols									****
+****																	****
+***************************************************************************/
+
+uint32 XplSymbolTable::GetNumSymbols()
+{
+    return __atomic_load_n ( &Get().m_numSymbols, __ATOMIC_ACQUIRE );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplSymbolTable::Lookup											****
+****																	****
+****	Runs without a lock.  A name added after the table was read		****
+****	may be missed, so Add looks again under the lock.				****
+****																	****
+***************************************************************************/
+
+uint32 XplSymbolTable::Lookup
+(
+    XplStringView const& _str,
+    uint32 const _hash,
+    bool const _bLower
+) const
+{
+    Table const* pTable = __atomic_load_n ( &m_pTable, __ATOMIC_ACQUIRE );
+    uint32 i = _hash & pTable->m_mask;
+    while ( true )
+    {
+        // The release store of a slot happens after its entry is
+        // filled in, so the entry can be read as soon as the slot is seen.
+        uint32 const slot = __atomic_load_n ( &pTable->m_pSlots[i], __ATOMIC_ACQUIRE );
+        if ( 0 == slot )
+        {
+            return c_none;
+        }
+
+        Entry const& entry = GetEntry ( slot - 1 );
+        if ( ( entry.m_hash == _hash ) && Equals ( entry.m_str, _str, _bLower ) )
+        {
+            return ( slot - 1 );
+        }
+        i = ( i + 1 ) & pTable->m_mask;
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplSymbolTable::Add												****
+****																	****
+***************************************************************************/
+
+uint32 XplSymbolTable::Add
+(
+    XplStringView const& _str
+)
+{
+    Poco::FastMutex::ScopedLock lock ( m_mutex );
+
+    // Another thread may have added the name since we last looked
+    uint32 const hash = XplNameIndex::Hash ( _str );
+    uint32 id = Lookup ( _str, hash, false );
+    if ( c_none != id )
+    {
+        return id;
+    }
+
+    if ( m_numSymbols == c_maxSymbols )
+    {
+        return c_none;
+    }
+
+    // Fill in the entry
+    id = m_numSymbols;
+    Entry*& pChunk = m_pChunks[id >> c_chunkShift];
+    if ( NULL == pChunk )
+    {
+        pChunk = new Entry[c_chunkSize];
+    }
+    Entry& entry = pChunk[id & ( c_chunkSize - 1 )];
+    entry.m_str = _str.toString();
+    entry.m_hash = hash;
+
+    // Keep the hash table no more than half full.  The new table is
+    // complete before it is published, and the old one is kept, as
+    // other threads may still be searching it.
+    uint32 const numSlots = m_pTable->m_mask + 1;
+    if ( ( id + 1 ) * 2 > numSlots )
+    {
+        Table* pTable = new Table;
+        pTable->m_mask = ( numSlots * 2 ) - 1;
+        pTable->m_pSlots = new uint32[numSlots * 2];
+        memset ( pTable->m_pSlots, 0, numSlots * 2 * sizeof ( uint32 ) );
+        for ( uint32 i=0; i<id; ++i )
+        {
+            Insert ( pTable, i );
+        }
+
+        m_oldTables.push_back ( m_pTable );
+        __atomic_store_n ( &m_pTable, pTable, __ATOMIC_RELEASE );
+    }
+
+    // Count the name before it can be found, so that any ID
+    // a reader gets back is always below GetNumSymbols.
+    __atomic_store_n ( &m_numSymbols, id + 1, __ATOMIC_RELEASE );
+    Insert ( m_pTable, id );
+    return id;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplSymbolTable::Insert											****
+****																	****
+***************************************************************************/
+
+void XplSymbolTable::Insert
+(
+    Table* _pTable,
+    uint32 const _id
+)
+{
+    uint32 i = GetEntry ( _id ).m_hash & _pTable->m_mask;
+    while ( 0 != _pTable->m_pSlots[i] )
+    {
+        i = ( i + 1 ) & _pTable->m_mask;
+    }
+    __atomic_store_n ( &_pTable->m_pSlots[i], _id + 1, __ATOMIC_RELEASE );
+}
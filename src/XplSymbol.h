@@ -0,0 +1,146 @@
+/***************************************************************************
+****																	****
+****	XplSymbol.h														****
+****																	****
+****	Interned identifiers											****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplSymbol_H
+#define _XplSymbol_H
+
+#include <string>
+#include <vector>
+#include "XplCore.h"
+#include "XplStringView.h"
+#include "Poco/Mutex.h"
+
+namespace xpl
+{
+
+/**
+ * Global table that gives each identifier a small integer ID.
+ * Vendor, device and instance IDs and the schema class and type are drawn
+ * from a small set of names that repeat in every message.  Storing them as
+ * IDs means two of them can be compared with a single integer compare, and
+ * copying an address or a message header does not copy any strings.
+ * <p>
+ * The table is append-only.  Once a name has been given an ID it keeps it,
+ * and the string returned by GetString stays at the same address, until
+ * the program exits.  Looking up a name that is already in the table takes
+ * no lock; only adding a new name does.
+ * <p>
+ * As nothing is ever removed, the table is capped at c_maxSymbols names so
+ * that a stream of made-up addresses cannot grow it without limit.  Once it
+ * is full, Intern returns c_none for any new name.  Names are only added by
+ * configured filters and by messages built by this program.  Received
+ * messages use Find, and keep the text of any name that is not there.
+ */
+class XplSymbolTable
+{
+public:
+    static uint32 const c_empty = 0;			// ID of the empty string
+    static uint32 const c_wildcard = 1;		// ID of "*"
+    static uint32 const c_none = 0xffffffff;	// Returned when a name is not, or cannot be, in the table
+    static uint32 const c_maxSymbols = 1 << 20;
+
+    /**
+     * Gets the ID of a name, adding the name to the table if needed.
+     * @param _str the name.  Case is significant.
+     * @return the ID, or c_none if the table is full.
+     */
+    static uint32 Intern ( XplStringView const& _str );
+
+    /**
+     * Gets the ID of a name without adding it.
+     * @param _str the name.  Case is significant.
+     * @return the ID, or c_none if the name is not in the table.
+     */
+    static uint32 Find ( XplStringView const& _str );
+
+    /**
+     * The same as Find, but for the lower case version of the name.
+     */
+    static uint32 FindLower ( XplStringView const& _str );
+
+    /**
+     * Gets the name that an ID stands for.
+     * @param _id an ID returned by Intern.
+     */
+    static string const& GetString ( uint32 const _id );
+
+    /**
+     * Gets the number of names in the table.
+     */
+    static uint32 GetNumSymbols();
+
+private:
+    static uint32 const c_chunkShift = 8;
+    static uint32 const c_chunkSize = 1 << c_chunkShift;
+
+    struct Entry
+    {
+        string	m_str;
+        uint32	m_hash;
+    };
+
+    // Open addressing hash table of IDs.  Each slot holds an ID plus one,
+    // so that zero can mark an empty slot.
+    struct Table
+    {
+        uint32	m_mask;
+        uint32*	m_pSlots;
+    };
+
+    XplSymbolTable();
+    ~XplSymbolTable();		// Not defined.  The table is never destroyed.
+
+    static XplSymbolTable& Get();
+
+    uint32 Lookup ( XplStringView const& _str, uint32 const _hash, bool const _bLower ) const;
+    uint32 Add ( XplStringView const& _str );
+    void Insert ( Table* _pTable, uint32 const _id );
+
+    Entry const& GetEntry ( uint32 const _id ) const
+    {
+        return m_pChunks[_id >> c_chunkShift][_id & ( c_chunkSize - 1 )];
+    }
+
+    Poco::FastMutex		m_mutex;		// Held while a name is added
+    Entry*				m_pChunks[c_maxSymbols / c_chunkSize];
+    uint32				m_numSymbols;
+    Table*				m_pTable;		// Current hash table
+    vector<Table*>		m_oldTables;	// Replaced tables, which readers may still be using
+
+}; // class XplSymbolTable
+
+} // namespace xpl
+
+#endif // _XplSymbol_H
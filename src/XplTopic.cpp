@@ -0,0 +1,176 @@
+/***************************************************************************
+****																	****
+****	XplTopic.cpp													****
+****																	****
+****	Describes the messages an observer subscribes to				****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include "XplCore.h"
+#include "XplTopic.h"
+#include "XplMsg.h"
+#include "XplComms.h"
+#include "XplNameIndex.h"
+
+using namespace xpl;
+
+
+/***************************************************************************
+****																	****
+****	XplTopic Constructor											****
+****																	****
+***************************************************************************/
+
+XplTopic::XplTopic
+(
+    string const& _msgType,
+    string const& _schemaClass,
+    string const& _schemaType,
+    string const& _source
+) :
+    m_msgType ( _msgType ),
+    m_schemaClass ( _schemaClass ),
+    m_schemaType ( _schemaType ),
+    m_vendor ( "*" ),
+    m_device ( "*" ),
+    m_instance ( "*" )
+{
+    // Split the source into vendor, device and instance.
+    // Any part that is left out matches anything.
+    XplStringView const source ( _source );
+    if ( source != XplStringView ( "*" ) )
+    {
+        uint32 const dash = source.find ( '-' );
+        uint32 const dot = source.find ( '.', ( XplStringView::npos == dash ) ? 0 : dash + 1 );
+        m_vendor = source.substr ( 0, ( XplStringView::npos == dash ) ? dot : dash ).toString();
+        if ( XplStringView::npos != dash )
+        {
+            m_device = source.substr ( dash + 1, ( XplStringView::npos == dot ) ? XplStringView::npos : dot - dash - 1 ).toString();
+        }
+        if ( XplStringView::npos != dot )
+        {
+            m_instance = source.substr ( dot + 1 ).toString();
+        }
+    }
+
+    m_topic = MakeTopic ( m_schemaClass, m_schemaType );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplTopic::GetMsgTopics											****
+****																	****
+***************************************************************************/
+
+uint32 XplTopic::GetMsgTopics
+(
+    XplMsg const& _msg,
+    uint32* _pTopics
+)
+{
+    XplStringView const schemaClass ( _msg.GetSchemaClass() );
+    XplStringView const schemaType ( _msg.GetSchemaType() );
+    XplStringView const any ( "*" );
+
+    _pTopics[0] = MakeTopic ( schemaClass, schemaType );
+    _pTopics[1] = MakeTopic ( schemaClass, any );
+    _pTopics[2] = MakeTopic ( any, schemaType );
+    _pTopics[3] = MakeTopic ( any, any );
+    return kNumMsgTopics;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplTopic::Matches												****
+****																	****
+***************************************************************************/
+
+bool XplTopic::Matches
+(
+    XplMsg const& _msg
+) const
+{
+    XplAddress const& source = _msg.GetSource();
+    return ( MatchPart ( m_schemaClass, _msg.GetSchemaClass() )
+             && MatchPart ( m_schemaType, _msg.GetSchemaType() )
+             && MatchPart ( m_msgType, _msg.GetType() )
+             && MatchPart ( m_vendor, source.GetVendor() )
+             && MatchPart ( m_device, source.GetDevice() )
+             && MatchPart ( m_instance, source.GetInstance() ) );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplTopic::Accepts												****
+****																	****
+***************************************************************************/
+
+bool XplTopic::Accepts
+(
+    Notification* _pNotification
+) const
+{
+    MessageRxNotification* pRx = dynamic_cast<MessageRxNotification*> ( _pNotification );
+    return ( pRx && !pRx->message.isNull() && Matches ( *pRx->message ) );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplTopic::MakeTopic												****
+****																	****
+***************************************************************************/
+
+uint32 XplTopic::MakeTopic
+(
+    XplStringView const& _schemaClass,
+    XplStringView const& _schemaType
+)
+{
+    return ( XplNameIndex::Hash ( _schemaClass ) * 31 ) ^ XplNameIndex::Hash ( _schemaType );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplTopic::MatchPart												****
+****																	****
+***************************************************************************/
+
+bool XplTopic::MatchPart
+(
+    string const& _pattern,
+    XplStringView const& _value
+)
+{
+    XplStringView const pattern ( _pattern );
+    return ( ( pattern == XplStringView ( "*" ) ) || pattern.equalsNoCase ( _value ) );
+}
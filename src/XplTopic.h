@@ -0,0 +1,128 @@
+/***************************************************************************
+****																	****
+****	XplTopic.h														****
+****																	****
+****	Describes the messages an observer subscribes to				****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#pragma once
+
+#ifndef _XplTopic_H
+#define _XplTopic_H
+
+#include <string>
+#include "XplCore.h"
+#include "XplStringView.h"
+#include "XplNotificationDispatcher.h"
+
+namespace xpl
+{
+
+class XplMsg;
+
+/**
+ * A set of messages that an observer wants to be told about.
+ * A topic picks out messages by type, schema class, schema type and
+ * source.  Any of them can be "*" to match anything, and so can any part
+ * of the source.  For example XplTopic( "xpl-trig", "sensor", "*",
+ * "acme-*.*" ) matches every sensor trigger from any of acme's devices.
+ * <p>
+ * Each topic is filed under a number made from its schema class and type.
+ * A message can only match the topics filed under one of the four numbers
+ * that GetMsgTopics makes from it, so when a message arrives only those
+ * topics need to be looked at.  Accepts then checks the rest.
+ * <p>
+ * Names are compared without regard to case.
+ */
+class XplTopic: public XplNotificationDispatcher::Filter
+{
+public:
+    /**
+     * Constructor.
+     * @param _msgType the message type, such as "xpl-cmnd", or "*".
+     * @param _schemaClass the schema class, such as "sensor", or "*".
+     * @param _schemaType the schema type, such as "basic", or "*".
+     * @param _source the sender, as vendor-device.instance.  Any of the
+     * three parts can be "*", and a source of just "*" matches any sender.
+     */
+    XplTopic ( string const& _msgType, string const& _schemaClass, string const& _schemaType, string const& _source = "*" );
+
+    /**
+     * Gets the number that this topic is filed under.
+     */
+    uint32 GetTopic() const
+    {
+        return m_topic;
+    }
+
+    /**
+     * Works out the numbers of the topics that a message might match.
+     * @param _msg the message.
+     * @param _pTopics array of at least kNumMsgTopics entries to be filled in.
+     * @return The number of entries filled in.
+     */
+    static uint32 GetMsgTopics ( XplMsg const& _msg, uint32* _pTopics );
+
+    /**
+     * Checks a message against every part of the topic.
+     */
+    bool Matches ( XplMsg const& _msg ) const;
+
+    /**
+     * Checks the message in a MessageRxNotification.
+     * @see Matches
+     */
+    virtual bool Accepts ( Notification* _pNotification ) const;
+
+    static uint32 const kNumMsgTopics = 4;
+
+private:
+    /**
+     * Makes a topic number from a schema class and type.
+     */
+    static uint32 MakeTopic ( XplStringView const& _schemaClass, XplStringView const& _schemaType );
+
+    /**
+     * Compares one part of a topic with a message, allowing for "*".
+     */
+    static bool MatchPart ( string const& _pattern, XplStringView const& _value );
+
+    string		m_msgType;
+    string		m_schemaClass;
+    string		m_schemaType;
+    string		m_vendor;		// Parts of the source.  These are kept as text, rather
+    string		m_device;		// than as an XplAddress, as topics ignore case.
+    string		m_instance;
+    uint32		m_topic;
+
+}; // class XplTopic
+
+} // namespace xpl
+
+#endif // _XplTopic_H
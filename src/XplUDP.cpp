@@ -38,14 +38,21 @@
 #include "XplCore.h"
 #include "XplStringUtils.h"
 #include "XplMsg.h"
+#include "XplMsgTemplate.h"
 #include "XplComms.h"
 #include "XplUDP.h"
 // #include "EventLog.h"
 // #include "RegUtils.h"
 
 #include "Poco/SingletonHolder.h"
+#include "Poco/String.h"
 
 #include <iostream>
+#ifdef XPL_HAVE_SOCKET_FILTER
+#include <errno.h>
+#include <linux/filter.h>
+#include <linux/sock_diag.h>
+#endif
 
 using namespace xpl;
 using namespace Poco::Net;
@@ -75,11 +82,33 @@ XplUDP::XplUDP
 (
     const bool viaHub
 ) :
-    commsLog ( Logger::get ( "xplsdk.comms" ) ),
-    viaHub_ ( viaHub ),
     txPort_ ( kXplHubPort ),
-    listenToFilter_ ( false )
+    viaHub_ ( viaHub ),
+    rxShardCount_ ( 1 ),
+    rxShardBySender_ ( false ),
+    txAdapter_ ( NULL ),
+    txQueueSize_ ( kDefaultTxQueueSize ),
+    txQueueHead_ ( 0 ),
+    txQueueCount_ ( 0 ),
+    rxQueue_ ( NULL ),
+    rxQueueSize_ ( kDefaultRxQueueSize ),
+    rxOverflowPolicy_ ( kRxDropOldest ),
+    rxMaxDepth_ ( 0 ),
+    rxDispatchWaiting_ ( 0 ),
+    rxDispatchAdapter_ ( NULL ),
+#ifdef XPL_HAVE_RECVMMSG
+    rxBatchSize_ ( kDefaultRxBatchSize ),
+#else
+    rxBatchSize_ ( 1 ),
+#endif
+    kernelFilter_ ( false ),
+    socketFilterAttached_ ( false ),
+    socketFilterGeneration_ ( 0 ),
+    listenToFilter_ ( false ),
+    commsLog ( Logger::get ( "xplsdk.comms" ) )
 {
+    memset ( &txStats_, 0, sizeof ( txStats_ ) );
+    rxShards_.push_back ( new RxShard ( *this, 0 ) );
 
     Logger::setLevel("xplsdk", Message::PRIO_DEBUG  );
     
@@ -98,7 +127,8 @@ XplUDP::XplUDP
             break;
         }
     }
-    poco_information ( commsLog, "Our heartbeat address is " + interface_.address().toString() );
+    heartbeatIP_ = interface_.address().toString();
+    poco_information ( commsLog, "Our heartbeat address is " + heartbeatIP_ );
 
     Connect();
 }
@@ -121,6 +151,10 @@ XplUDP::~XplUDP()
 
     assert ( !IsConnected() );
 
+    for ( uint32 i=0; i<rxShards_.size(); ++i )
+    {
+        delete rxShards_[i];
+    }
 }
 
 
@@ -135,24 +169,223 @@ bool XplUDP::TxMsg
     XplMsg& pMsg
 )
 {
-    bool retVal = false;
+    poco_trace ( commsLog, "_pMsg.GetRawData()" );
 
-    if ( IsConnected() )
+    string const& rawData = pMsg.GetRawData();
+    return TxRawData ( rawData.data(), ( uint32 ) rawData.size() );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::TxRawData												****
+****																	****
+****	Copies the message into the transmit queue.  The sending is		****
+****	done by the transmit thread, so the caller never waits on		****
+****	the socket.														****
+****																	****
+***************************************************************************/
+
+bool XplUDP::TxRawData
+(
+    char const* pData,
+    uint32 const size
+)
+{
+    if ( !IsConnected() )
+    {
+        return false;
+    }
+
+    {
+        Mutex::ScopedLock lock ( txQueueLock_ );
+        if ( txQueueCount_ == txQueue_.size() )
+        {
+            // Queue full.  Drop the new message rather than block the caller.
+            ++txStats_.dropped;
+            return false;
+        }
+
+        // Each slot keeps its capacity, so this does not allocate once warmed up
+        uint32 const slot = ( txQueueHead_ + txQueueCount_ ) % txQueue_.size();
+        txQueue_[slot].assign ( pData, size );
+        ++txQueueCount_;
+        ++txStats_.queued;
+        if ( txQueueCount_ > txStats_.maxDepth )
+        {
+            txStats_.maxDepth = txQueueCount_;
+        }
+    }
+
+    txEvent_.set();
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::SendQueuedPackets										****
+****																	****
+****	Target of the transmit thread.  Takes the queued messages		****
+****	in batches and sends each batch with as few calls as possible.	****
+****																	****
+***************************************************************************/
+
+void XplUDP::SendQueuedPackets()
+{
+    // The batch swaps its strings with the queue slots, so memory
+    // just moves back and forth between the two.
+    vector<string> batch ( kTxBatchSize );
+
+    while ( 1 )
+    {
+        txEvent_.tryWait ( 1000 );
+
+        while ( 1 )
+        {
+            uint32 count = 0;
+            {
+                Mutex::ScopedLock lock ( txQueueLock_ );
+                while ( ( count < kTxBatchSize ) && txQueueCount_ )
+                {
+                    batch[count++].swap ( txQueue_[txQueueHead_] );
+                    txQueueHead_ = ( txQueueHead_ + 1 ) % txQueue_.size();
+                    --txQueueCount_;
+                }
+            }
+
+            if ( 0 == count )
+            {
+                break;
+            }
+            SendBatch ( batch, count );
+        }
+
+        // Anything queued before the disconnect has now been sent
+        if ( !IsConnected() )
+        {
+            break;
+        }
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::SendBatch												****
+****																	****
+***************************************************************************/
+
+void XplUDP::SendBatch
+(
+    vector<string>& batch,
+    uint32 const count
+)
+{
+    uint32 sent = 0;
+    uint32 failed = 0;
+    uint32 retries = 0;
+    uint32 backoff = 0;
+
+#ifdef XPL_HAVE_SENDMMSG
+    struct mmsghdr headers[kTxBatchSize];
+    struct iovec iovecs[kTxBatchSize];
+    memset ( headers, 0, sizeof ( headers ) );
+    for ( uint32 i=0; i<count; ++i )
     {
+        iovecs[i].iov_base = &batch[i][0];
+        iovecs[i].iov_len = batch[i].size();
+        headers[i].msg_hdr.msg_iov = &iovecs[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+        headers[i].msg_hdr.msg_name = &txDestAddr_;
+        headers[i].msg_hdr.msg_namelen = sizeof ( txDestAddr_ );
+    }
+
+    int const fd = socket_.impl()->sockfd();
+    while ( sent + failed < count )
+    {
+        int const result = sendmmsg ( fd, &headers[sent + failed], count - sent - failed, 0 );
+        if ( result > 0 )
+        {
+            sent += result;
+            backoff = 0;
+            continue;
+        }
 
-        IPAddress lbcast = interface_.broadcastAddress();
-         Poco::Net::SocketAddress destAddress ( lbcast, 3865 );
-        poco_trace ( commsLog, "_pMsg.GetRawData()" );
+        int const error = ( result < 0 ) ? errno : EAGAIN;
+        if ( EINTR == error )
+        {
+            continue;
+        }
 
-        int sentBytes = socket_.sendTo ( pMsg.GetRawData().c_str() , pMsg.GetRawData().size(), destAddress );
-        retVal = (sentBytes == pMsg.GetRawData().size());
+        if ( ( ( EAGAIN == error ) || ( EWOULDBLOCK == error ) || ( ENOBUFS == error ) ) && ( backoff < kTxMaxRetries ) )
+        {
+            // The socket buffer is full.  Give the kernel time to drain it.
+            Poco::Thread::sleep ( 1 << backoff );
+            ++backoff;
+            ++retries;
+            continue;
+        }
 
+        // Skip the message that could not be sent, and carry on with the rest
+        ++failed;
+        backoff = 0;
     }
+#else
+    // Poco retries sendto itself when it is interrupted
+    for ( uint32 i=0; i<count; ++i )
+    {
+        try
+        {
+            int const sentBytes = socket_.sendTo ( batch[i].data(), ( int ) batch[i].size(), txDestSocketAddr_ );
+            ( sentBytes == ( int ) batch[i].size() ) ? ++sent : ++failed;
+            backoff = 0;
+        }
+        catch ( Poco::Exception& e )
+        {
+            bool const bFull = ( NULL != dynamic_cast<Poco::TimeoutException*> ( &e ) ) || ( POCO_ENOBUFS == e.code() );
+            if ( bFull && ( backoff < kTxMaxRetries ) )
+            {
+                // The socket buffer is full.  Give it time to drain and
+                // try the same message again.
+                Poco::Thread::sleep ( 1 << backoff );
+                ++backoff;
+                ++retries;
+                --i;
+                continue;
+            }
+            ++failed;
+            backoff = 0;
+        }
+    }
+#endif
 
-    return retVal;
+    Mutex::ScopedLock lock ( txQueueLock_ );
+    txStats_.sent += sent;
+    txStats_.failed += failed;
+    txStats_.retries += retries;
+    ++txStats_.batches;
+    if ( count > txStats_.maxBatch )
+    {
+        txStats_.maxBatch = count;
+    }
 }
 
 
+/***************************************************************************
+****																	****
+****	XplUDP::GetTxStats												****
+****																	****
+***************************************************************************/
+
+XplUDP::TxStats XplUDP::GetTxStats() const
+{
+    Mutex::ScopedLock lock ( txQueueLock_ );
+    TxStats stats = txStats_;
+    stats.depth = txQueueCount_;
+    return stats;
+}
+
 
 /***************************************************************************
 ****																	****
@@ -168,6 +401,14 @@ bool XplUDP::Connect()
     }
     rxPort_ = kXplHubPort;
 
+#ifdef XPL_HAVE_REUSEPORT
+    // Extra shards are removed again by Disconnect
+    while ( rxShards_.size() < rxShardCount_ )
+    {
+        rxShards_.push_back ( new RxShard ( *this, ( uint32 ) rxShards_.size() ) );
+    }
+#endif
+
     Poco::Net::SocketAddress sa ( interface_.broadcastAddress(), rxPort_ );
     poco_information ( commsLog, "Trying port " + NumberFormatter::format ( rxPort_ ) + " on IP " + sa.toString() );
 
@@ -177,9 +418,12 @@ bool XplUDP::Connect()
     bool bound = false;
     try
     {
-        socket_ = DatagramSocket ( sa,false );
-        socket_.setBroadcast ( true );
+        BindRxSockets ( sa );
         bound = true;
+
+        // Broadcasts are delivered to every socket bound to the port,
+        // so the shards have to divide them up between themselves.
+        rxShardBySender_ = true;
     }
     catch ( NetException & e )
     {
@@ -198,9 +442,11 @@ bool XplUDP::Connect()
             sa = SocketAddress ( interface_.address(), rxPort_ );
             try
             {
-                socket_ = DatagramSocket ( sa,false );
-                socket_.setBroadcast ( true );
+                BindRxSockets ( sa );
                 bound = true;
+
+                // Unicasts are shared out between the sockets by the kernel
+                rxShardBySender_ = false;
             }
             catch ( NetException & e )
             {
@@ -225,10 +471,57 @@ bool XplUDP::Connect()
 //     }
 //
     
-    XplComms::Connect();
-    listenAdapter_ = new RunnableAdapter<XplUDP> ( *this,&XplUDP::ListenForPackets );
-    listenThread_.setName ( "packet listen thread" );
-    listenThread_.start ( *listenAdapter_ );
+    // Work out where messages are sent just once
+    txDestSocketAddr_ = SocketAddress ( interface_.broadcastAddress(), kXplHubPort );
+#ifdef XPL_HAVE_SENDMMSG
+    memset ( &txDestAddr_, 0, sizeof ( txDestAddr_ ) );
+    memcpy ( &txDestAddr_, txDestSocketAddr_.addr(), txDestSocketAddr_.length() < ( int ) sizeof ( txDestAddr_ ) ? txDestSocketAddr_.length() : sizeof ( txDestAddr_ ) );
+#endif
+    {
+        Mutex::ScopedLock lock ( txQueueLock_ );
+        txQueue_.resize ( txQueueSize_ );
+        txQueueHead_ = 0;
+        txQueueCount_ = 0;
+    }
+
+    for ( uint32 i=0; i<rxShards_.size(); ++i )
+    {
+        if ( !rxShards_[i]->reactor_.Open() )
+        {
+            poco_error ( commsLog, "Unable to create the receive event loop" );
+            for ( uint32 j=0; j<rxShards_.size(); ++j )
+            {
+                rxShards_[j]->reactor_.Close();
+                rxShards_[j]->socket_.close();
+            }
+            return false;
+        }
+    }
+
+    {
+        // The sockets are new, so they have no filter yet
+        Mutex::ScopedLock lock ( socketFilterLock_ );
+        XplComms::Connect();
+        socketFilterAttached_ = false;
+    }
+    UpdateSocketFilter();
+
+    if ( rxQueueSize_ )
+    {
+        rxQueue_ = new XplRingQueue<XplMsg*> ( rxQueueSize_ );
+        rxDispatchWaiting_ = 0;
+        rxDispatchAdapter_ = new RunnableAdapter<XplUDP> ( *this,&XplUDP::DispatchReceivedMessages );
+        rxDispatchThread_.setName ( "packet dispatch thread" );
+        rxDispatchThread_.start ( *rxDispatchAdapter_ );
+    }
+    for ( uint32 i=0; i<rxShards_.size(); ++i )
+    {
+        rxShards_[i]->thread_.setName ( "packet listen thread " + NumberFormatter::format ( i ) );
+        rxShards_[i]->thread_.start ( *rxShards_[i] );
+    }
+    txAdapter_ = new RunnableAdapter<XplUDP> ( *this,&XplUDP::SendQueuedPackets );
+    txThread_.setName ( "packet send thread" );
+    txThread_.start ( *txAdapter_ );
 
     return true;
 }
@@ -244,11 +537,50 @@ void XplUDP::Disconnect()
 {
     if ( IsConnected() )
     {
-        XplComms::Disconnect();
-        listenThread_.join();
+        {
+            Mutex::ScopedLock lock ( socketFilterLock_ );
+            XplComms::Disconnect();
+            socketFilterAttached_ = false;
+        }
+        for ( uint32 i=0; i<rxShards_.size(); ++i )
+        {
+            rxShards_[i]->reactor_.Stop();
+        }
+        txEvent_.set();
+        txThread_.join();
+        for ( uint32 i=0; i<rxShards_.size(); ++i )
+        {
+            rxShards_[i]->thread_.join();
+            rxShards_[i]->reactor_.Close();
+        }
+
+        if ( rxQueue_ )
+        {
+            rxEvent_.set();
+            rxDispatchThread_.join();
+
+            // Release anything that arrived after the dispatch thread finished
+            XplMsg* pMsg;
+            while ( rxQueue_->TryPop ( &pMsg ) )
+            {
+                pMsg->release();
+            }
+            delete rxQueue_;
+            rxQueue_ = NULL;
+        }
+
+        // Keep just the first shard, whose socket is also socket_
+        while ( rxShards_.size() > 1 )
+        {
+            delete rxShards_.back();
+            rxShards_.pop_back();
+        }
     }
 
-    delete listenAdapter_;
+    delete txAdapter_;
+    txAdapter_ = NULL;
+    delete rxDispatchAdapter_;
+    rxDispatchAdapter_ = NULL;
 }
 
 
@@ -304,16 +636,7 @@ void XplUDP::SendHeartbeat
     string const& version
 )
 {
-    AutoPtr<XplMsg> pMsg = new XplMsg ( XplMsg::c_xplStat, source, "*", "hbeat", "app" );
-    if ( pMsg )
-    {
-        pMsg->AddValue ( "interval", NumberFormatter::format(interval) );
-        pMsg->AddValue ( "port", NumberFormatter::format(rxPort_) );
-        pMsg->AddValue ( "remote-ip", interface_.address().toString() );
-        pMsg->AddValue ( "version", version );
-        
-        TxMsg ( *pMsg );
-    }
+    SendAppHeartbeat ( "hbeat", &hbeatTemplates_, source, interval, version );
 }
 
 
@@ -345,76 +668,893 @@ void XplUDP::SendConfigHeartbeat
     string const& version
 )
 {
-    AutoPtr<XplMsg> pMsg = new XplMsg ( XplMsg::c_xplStat, source, "*", "config", "app" );
-    if ( pMsg )
+    SendAppHeartbeat ( "config", &configTemplates_, source, interval, version );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::SendAppHeartbeat										****
+****																	****
+****	Each source gets its message built once.  After that only		****
+****	the values are patched into the raw data before sending.		****
+****																	****
+***************************************************************************/
+
+void XplUDP::SendAppHeartbeat
+(
+    string const& schemaClass,
+    TemplateMap* pTemplates,
+    string const& source,
+    uint32 const interval,
+    string const& version
+)
+{
+    AutoPtr<HeartbeatTemplate> pEntry;
+    {
+        FastMutex::ScopedLock lock ( templateLock_ );
+        TemplateMap::iterator iter = pTemplates->find ( source );
+        if ( iter != pTemplates->end() )
+        {
+            pEntry = iter->second;
+        }
+    }
+
+    if ( pEntry.isNull() )
     {
-        pMsg->AddValue ( "interval", NumberFormatter::format(interval) );
-        pMsg->AddValue ( "port", NumberFormatter::format(rxPort_) );
-        pMsg->AddValue ( "remote-ip", interface_.address().toString() );
+        // Built without the lock.  If another thread gets there first,
+        // its template is used and this one is thrown away.
+        AutoPtr<XplMsg> pMsg = new XplMsg ( XplMsg::c_xplStat, source, "*", schemaClass, "app" );
+        pMsg->AddValue ( "interval", interval );
+        pMsg->AddValue ( "port", rxPort_ );
+        pMsg->AddValue ( "remote-ip", heartbeatIP_ );
         pMsg->AddValue ( "version", version );
 
-        TxMsg ( *pMsg );
+        pEntry = new HeartbeatTemplate();
+        pEntry->m_pTemplate = new XplMsgTemplate ( *pMsg );
+        pEntry->m_pTemplate->AddField ( "interval" );
+        pEntry->m_pTemplate->AddField ( "port" );
+        pEntry->m_pTemplate->AddField ( "remote-ip" );
+        pEntry->m_pTemplate->AddField ( "version" );
+
+        FastMutex::ScopedLock lock ( templateLock_ );
+        pEntry = pTemplates->insert ( TemplateMap::value_type ( source, pEntry ) ).first->second;
     }
+
+    // TxRawData copies the raw data into the transmit queue, so the
+    // template only needs to stay unchanged until it returns
+    FastMutex::ScopedLock lock ( pEntry->m_lock );
+    XplMsgTemplate* pTemplate = pEntry->m_pTemplate;
+    pTemplate->SetField ( kHeartbeatInterval, interval );
+    pTemplate->SetField ( kHeartbeatPort, rxPort_ );
+    pTemplate->SetField ( kHeartbeatRemoteIp, heartbeatIP_ );
+    pTemplate->SetField ( kHeartbeatVersion, version );
+
+    string const& rawData = pTemplate->GetRawData();
+    TxRawData ( rawData.data(), ( uint32 ) rawData.size() );
 }
 
 
-void XplUDP::ListenForPackets()
+/***************************************************************************
+****																	****
+****	XplUDP::OnSourceRemoved											****
+****																	****
+***************************************************************************/
+
+void XplUDP::OnSourceRemoved
+(
+    string const& source
+)
 {
+    FastMutex::ScopedLock lock ( templateLock_ );
+    hbeatTemplates_.erase ( source );
+    configTemplates_.erase ( source );
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::BindRxSockets											****
+****																	****
+***************************************************************************/
 
-    poco_debug ( commsLog, "started listening" );
-    Poco::Timespan timeout = Poco::Timespan ( 0,0,0,1,0 );    
-    socket_.setReceiveTimeout ( timeout );
-    while ( this->IsConnected() ) //we don't need locking here - connected is just a boolean
+void XplUDP::BindRxSockets
+(
+    Poco::Net::SocketAddress const& sa
+)
+{
+    if ( 1 == rxShards_.size() )
     {
-        char buffer[2024];
-        Poco::Net::SocketAddress sender;
-        //int bytesRead = m_sock.receiveFrom(buffer, sizeof(buffer)-1, sender);
-        bool ready = socket_.poll ( timeout, Socket::SELECT_READ );
-        if ( ! ready )
-        {
-            continue;
-        }
-        int bytesRead = socket_.receiveFrom ( buffer, sizeof ( buffer )-1, sender );
-//         cout << "got " << bytesRead << " bytes\n";
-        if ( bytesRead == 0 )
-        {
-//             cout << "no bytes\n";
-            continue;
-        }
-        buffer[bytesRead] = '\0';
-        //std::cout << sender.toString() << ": " << buffer << std::endl;
+        socket_ = DatagramSocket ( sa,false );
+        socket_.setBroadcast ( true );
+        rxShards_[0]->socket_ = socket_;
+        return;
+    }
 
-        // Filter out messages from unwanted IPs
-        if ( listenToFilter_ )
-        {
-            uint32 i;
-            for ( i=0; i<listenToAddresses_.size(); ++i )
-            {
-                if ( listenToAddresses_[i] == sender.host() )
-                {
-                    // Found a match.
-                    break;
-                }
-            }
+    // Make sure nobody else has the port.  With SO_REUSEPORT set we
+    // would otherwise join any other program that had also set it.
+    {
+        DatagramSocket probe ( sa,false );
+        probe.close();
+    }
 
-            if ( i == listenToAddresses_.size() )
-            {
-                // We didn't find a match
-                continue;
-            }
-        }
+    for ( uint32 i=0; i<rxShards_.size(); ++i )
+    {
+        DatagramSocket socket ( sa.family() );
+        socket.setReusePort ( true );
+        socket.bind ( sa,false );
+        socket.setBroadcast ( true );
+        rxShards_[i]->socket_ = socket;
+    }
+    socket_ = rxShards_[0]->socket_;
+}
 
-        // Create an XplMsg object from the received data
-        try {
-            AutoPtr<XplMsg> pMsg = new XplMsg ( buffer );
 
-            rxNotificationCenter.postNotification ( new MessageRxNotification ( pMsg ) );
-        } catch (XplMsgParseException e) {
-            poco_warning ( commsLog, "cannot parse message: " + string(e.what()) );
-        }    
+/***************************************************************************
+****																	****
+****	XplUDP::RxShard Constructor										****
+****																	****
+***************************************************************************/
+
+XplUDP::RxShard::RxShard
+(
+    XplUDP& owner,
+    uint32 const index
+) :
+    owner_ ( owner ),
+    index_ ( index )
+{
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::RxShard::run											****
+****																	****
+****	Runs the reactor on the receive thread until Disconnect stops	****
+****	it.  The socket is read in OnReadable.							****
+****																	****
+***************************************************************************/
+
+void XplUDP::RxShard::run()
+{
+    poco_debug ( owner_.commsLog, "started listening" );
 
+#ifdef XPL_HAVE_RECVMMSG
+    // Buffers for recvmmsg are allocated once, on the thread that uses them
+    uint32 const batchSize = owner_.rxBatchSize_;
+    rxBuffers_.resize ( batchSize * kMaxDatagramSize );
+    rxHeaders_.resize ( batchSize );
+    rxIovecs_.resize ( batchSize );
+    rxSenders_.resize ( batchSize );
+    for ( uint32 i=0; i<batchSize; ++i )
+    {
+        rxIovecs_[i].iov_base = &rxBuffers_[i * kMaxDatagramSize];
+        rxIovecs_[i].iov_len = kMaxDatagramSize;
     }
+#endif
+
+    reactor_.AddSocket ( socket_.impl()->sockfd(), this );
+    reactor_.Run();
     //can't log here - the log may already have been taken down.
 //     poco_information(commsLog, "UDP rx thread stopped");
 }
 
+
+/***************************************************************************
+****																	****
+****	XplUDP::RxShard::OnReadable										****
+****																	****
+***************************************************************************/
+
+void XplUDP::RxShard::OnReadable
+(
+    int /*fd*/
+)
+{
+#ifdef XPL_HAVE_RECVMMSG
+    if ( rxHeaders_.size() > 1 )
+    {
+        ReadPacketBatches();
+        return;
+    }
+#endif
+
+    char buffer[kMaxDatagramSize];
+    Poco::Net::SocketAddress sender;
+    int bytesRead = socket_.receiveFrom ( buffer, sizeof ( buffer ), sender );
+    if ( bytesRead <= 0 )
+    {
+        return;
+    }
+
+    // Leave messages from other senders to the other shards
+    if ( !IsOwnSender ( sender.addr() ) )
+    {
+        return;
+    }
+
+    // Filter out messages from unwanted IPs
+    if ( owner_.listenToFilter_ && !owner_.IsListenedTo ( sender.host() ) )
+    {
+        return;
+    }
+
+    owner_.HandleDatagram ( buffer, ( uint32 ) bytesRead );
+}
+
+
+#ifdef XPL_HAVE_RECVMMSG
+/***************************************************************************
+****																	****
+****	XplUDP::RxShard::ReadPacketBatches								****
+****																	****
+****	Linux only.  Drains as many datagrams as are waiting, up to		****
+****	rxBatchSize_ per recvmmsg call, into buffers that are			****
+****	allocated once.  Each batch is parsed and dispatched before		****
+****	the socket is read again.										****
+****																	****
+***************************************************************************/
+
+void XplUDP::RxShard::ReadPacketBatches()
+{
+    uint32 const batchSize = ( uint32 ) rxHeaders_.size();
+    int const fd = socket_.impl()->sockfd();
+
+    // Keep reading until a batch comes back less than full
+    int count = batchSize;
+    while ( ( count == ( int ) batchSize ) && owner_.IsConnected() )
+    {
+        // recvmmsg overwrites the lengths, so they are reset each time
+        for ( uint32 i=0; i<batchSize; ++i )
+        {
+            struct msghdr& hdr = rxHeaders_[i].msg_hdr;
+            memset ( &hdr, 0, sizeof ( hdr ) );
+            hdr.msg_iov = &rxIovecs_[i];
+            hdr.msg_iovlen = 1;
+            hdr.msg_name = &rxSenders_[i];
+            hdr.msg_namelen = sizeof ( rxSenders_[i] );
+        }
+
+        count = recvmmsg ( fd, &rxHeaders_[0], batchSize, MSG_DONTWAIT, NULL );
+        if ( count <= 0 )
+        {
+            break;
+        }
+
+        for ( int i=0; i<count; ++i )
+        {
+            struct msghdr const& hdr = rxHeaders_[i].msg_hdr;
+            if ( ( 0 == rxHeaders_[i].msg_len ) || ( hdr.msg_flags & MSG_TRUNC ) )
+            {
+                // Empty, or too big to be an xPL message
+                continue;
+            }
+
+            // Leave messages from other senders to the other shards
+            if ( !IsOwnSender ( ( struct sockaddr const* ) &rxSenders_[i] ) )
+            {
+                continue;
+            }
+
+            // Filter out messages from unwanted IPs
+            if ( owner_.listenToFilter_ && !owner_.IsListenedTo ( IPAddress ( &rxSenders_[i].sin_addr, sizeof ( rxSenders_[i].sin_addr ) ) ) )
+            {
+                continue;
+            }
+
+            owner_.HandleDatagram ( &rxBuffers_[i * kMaxDatagramSize], rxHeaders_[i].msg_len );
+        }
+    }
+}
+#endif
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::RxShard::IsOwnSender									****
+****																	****
+****	Each sender's address and port is hashed to pick the one		****
+****	shard that handles its messages, which keeps them in order.		****
+****																	****
+***************************************************************************/
+
+bool XplUDP::RxShard::IsOwnSender
+(
+    struct sockaddr const* pSender
+) const
+{
+#ifdef XPL_HAVE_REUSEPORT
+    uint32 const count = ( uint32 ) owner_.rxShards_.size();
+    if ( !owner_.rxShardBySender_ || ( count < 2 ) )
+    {
+        return true;
+    }
+
+    if ( AF_INET != pSender->sa_family )
+    {
+        return ( 0 == index_ );
+    }
+
+    struct sockaddr_in const* pIn = ( struct sockaddr_in const* ) pSender;
+    uint32 hash = ( ( uint32 ) ntohl ( pIn->sin_addr.s_addr ) * 2654435761u ) ^ ntohs ( pIn->sin_port );
+    hash ^= ( hash >> 16 );
+    return ( ( hash % count ) == index_ );
+#else
+    return true;
+#endif
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::IsListenedTo											****
+****																	****
+***************************************************************************/
+
+bool XplUDP::IsListenedTo
+(
+    IPAddress const& host
+) const
+{
+    for ( uint32 i=0; i<listenToAddresses_.size(); ++i )
+    {
+        if ( listenToAddresses_[i] == host )
+        {
+            // Found a match.
+            return true;
+        }
+    }
+
+    // We didn't find a match
+    return false;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::HandleDatagram											****
+****																	****
+***************************************************************************/
+
+void XplUDP::HandleDatagram
+(
+    char const* pData,
+    uint32 const size
+)
+{
+    // Drop anything that no device wants before doing any work on it
+    if ( !rxPrefilter.Accept ( pData, size ) )
+    {
+        return;
+    }
+
+    // Create an XplMsg object from the received data
+    try {
+        AutoPtr<XplMsg> pMsg = new XplMsg ( pData, size );
+
+        if ( rxQueue_ )
+        {
+            QueueReceivedMessage ( pMsg );
+            return;
+        }
+        rxNotificationCenter.postNotification ( new MessageRxNotification ( pMsg ) );
+    } catch (XplMsgParseException& e) {
+        poco_warning ( commsLog, "cannot parse message: " + string(e.what()) );
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::QueueReceivedMessage									****
+****																	****
+***************************************************************************/
+
+void XplUDP::QueueReceivedMessage
+(
+    AutoPtr<XplMsg>& pMsg
+)
+{
+    // The queue holds a reference of its own to each message
+    XplMsg* pQueued = pMsg.duplicate();
+
+    uint32 attempts = 0;
+    while ( !rxQueue_->TryPush ( pQueued ) )
+    {
+        if ( ( kRxDropNewest == rxOverflowPolicy_ ) || !IsConnected() )
+        {
+            pQueued->release();
+            ++rxDropped_;
+            return;
+        }
+
+        if ( kRxDropOldest == rxOverflowPolicy_ )
+        {
+            XplMsg* pOldest;
+            if ( rxQueue_->TryPop ( &pOldest ) )
+            {
+                pOldest->release();
+                ++rxDropped_;
+            }
+            continue;
+        }
+
+        // kRxBlock.  Give the dispatch thread a chance to make room.
+        if ( ++attempts < 16 )
+        {
+            Thread::yield();
+        }
+        else
+        {
+            Thread::sleep ( 1 );
+        }
+    }
+    ++rxQueued_;
+
+    uint32 const depth = rxQueue_->GetDepth();
+    if ( depth > __atomic_load_n ( &rxMaxDepth_, __ATOMIC_RELAXED ) )
+    {
+        __atomic_store_n ( &rxMaxDepth_, depth, __ATOMIC_RELAXED );
+    }
+
+    // Only pay for the event if the dispatch thread has gone to sleep
+    __atomic_thread_fence ( __ATOMIC_SEQ_CST );
+    if ( __atomic_exchange_n ( &rxDispatchWaiting_, 0, __ATOMIC_SEQ_CST ) )
+    {
+        rxEvent_.set();
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::DispatchReceivedMessages								****
+****																	****
+***************************************************************************/
+
+void XplUDP::DispatchReceivedMessages()
+{
+    while ( 1 )
+    {
+        XplMsg* pQueued;
+        while ( rxQueue_->TryPop ( &pQueued ) )
+        {
+            // Take over the queue's reference
+            AutoPtr<XplMsg> pMsg ( pQueued );
+            ++rxDispatched_;
+            rxNotificationCenter.postNotification ( new MessageRxNotification ( pMsg ) );
+        }
+
+        if ( !IsConnected() )
+        {
+            break;
+        }
+
+        // Say we are going to sleep, then look again in case a message
+        // was queued before the receive thread could have seen that.
+        __atomic_store_n ( &rxDispatchWaiting_, 1, __ATOMIC_SEQ_CST );
+        __atomic_thread_fence ( __ATOMIC_SEQ_CST );
+        if ( rxQueue_->GetDepth() )
+        {
+            __atomic_store_n ( &rxDispatchWaiting_, 0, __ATOMIC_SEQ_CST );
+            continue;
+        }
+        rxEvent_.wait();
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::GetRxQueueStats											****
+****																	****
+***************************************************************************/
+
+XplUDP::RxQueueStats XplUDP::GetRxQueueStats() const
+{
+    RxQueueStats stats;
+    stats.queued = ( uint32 ) rxQueued_.value();
+    stats.dispatched = ( uint32 ) rxDispatched_.value();
+    stats.dropped = ( uint32 ) rxDropped_.value();
+    stats.depth = rxQueue_ ? rxQueue_->GetDepth() : 0;
+    stats.maxDepth = __atomic_load_n ( &rxMaxDepth_, __ATOMIC_RELAXED );
+    stats.capacity = rxQueue_ ? rxQueue_->GetCapacity() : 0;
+    return stats;
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::OnPrefilterChanged										****
+****																	****
+***************************************************************************/
+
+void XplUDP::OnPrefilterChanged()
+{
+    UpdateSocketFilter();
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::SetKernelFilter											****
+****																	****
+***************************************************************************/
+
+void XplUDP::SetKernelFilter
+(
+    bool const enable
+)
+{
+    {
+        Mutex::ScopedLock lock ( socketFilterLock_ );
+        kernelFilter_ = enable;
+    }
+    UpdateSocketFilter();
+}
+
+
+#ifdef XPL_HAVE_SOCKET_FILTER
+namespace
+{
+
+/**
+ * Builds a classic BPF program, with labels for forward jumps.
+ */
+class BpfBuilder
+{
+public:
+    uint32 NewLabel()
+    {
+        labels_.push_back ( 0xffffffff );
+        return ( uint32 ) labels_.size() - 1;
+    }
+
+    void Place ( uint32 const label )
+    {
+        labels_[label] = ( uint32 ) insns_.size();
+    }
+
+    void Stmt ( uint16 const code, uint32 const k )
+    {
+        struct sock_filter insn = BPF_STMT ( code, k );
+        insns_.push_back ( insn );
+    }
+
+    void Jump ( uint32 const label )
+    {
+        fixups_.push_back ( ( uint32 ) insns_.size() );
+        Stmt ( BPF_JMP | BPF_JA, label );
+    }
+
+    // Conditional jumps can only go 255 instructions, so they skip over
+    // an unconditional one instead of jumping to the label themselves.
+    void JumpIf ( uint16 const op, uint32 const k, uint32 const label )
+    {
+        struct sock_filter insn = BPF_JUMP ( BPF_JMP | op | BPF_K, k, 0, 1 );
+        insns_.push_back ( insn );
+        Jump ( label );
+    }
+
+    void JumpUnless ( uint16 const op, uint32 const k, uint32 const label )
+    {
+        struct sock_filter insn = BPF_JUMP ( BPF_JMP | op | BPF_K, k, 1, 0 );
+        insns_.push_back ( insn );
+        Jump ( label );
+    }
+
+    /**
+     * Compares part of the packet with a string, ignoring the case of
+     * letters, and jumps to a label if they differ.  The caller must
+     * already have checked that the packet is long enough.
+     * @param offset where the string should start.  With indexed set, this
+     * is relative to the X register.
+     */
+    void CompareText ( uint32 const offset, bool const indexed, string const& text, uint32 const failLabel )
+    {
+        uint32 pos = 0;
+        while ( pos < text.size() )
+        {
+            uint32 width = text.size() - pos;
+            uint16 size = BPF_W;
+            if ( width >= 4 )
+            {
+                width = 4;
+            }
+            else if ( width >= 2 )
+            {
+                width = 2;
+                size = BPF_H;
+            }
+            else
+            {
+                size = BPF_B;
+            }
+
+            // Loads are big-endian
+            uint32 value = 0;
+            uint32 mask = 0;
+            for ( uint32 i=0; i<width; ++i )
+            {
+                uint8 c = ( uint8 ) text[pos+i];
+                uint8 fold = ( ( ( c|0x20 ) >= 'a' ) && ( ( c|0x20 ) <= 'z' ) ) ? 0x20 : 0;
+                value = ( value << 8 ) | ( c | fold );
+                mask = ( mask << 8 ) | fold;
+            }
+
+            Stmt ( BPF_LD | size | ( indexed ? BPF_IND : BPF_ABS ), offset + pos );
+            if ( mask )
+            {
+                Stmt ( BPF_ALU | BPF_OR | BPF_K, mask );
+            }
+            JumpUnless ( BPF_JEQ, value, failLabel );
+            pos += width;
+        }
+    }
+
+    /**
+     * Resolves the labels.
+     * @return the finished program.
+     */
+    vector<struct sock_filter>& Finish()
+    {
+        for ( uint32 i=0; i<fixups_.size(); ++i )
+        {
+            struct sock_filter& insn = insns_[fixups_[i]];
+            insn.k = labels_[insn.k] - ( fixups_[i] + 1 );
+        }
+        fixups_.clear();
+        return insns_;
+    }
+
+private:
+    vector<struct sock_filter>	insns_;
+    vector<uint32>				labels_;	// Instruction index of each label
+    vector<uint32>				fixups_;	// Jumps whose k is still a label
+};
+
+uint32 const kUdpHeaderSize = 8;				// The filter sees the UDP header before the message
+uint32 const kSourceOffset = kUdpHeaderSize + 24;	// Vendor of the source, in the canonical layout
+uint32 const kMaxVendorLength = 8;
+uint32 const kMaxSourceLength = 34;			// vendor-device.instance is 8+1+8+1+16
+
+/**
+ * Builds the socket filter for a summary of the receive rules.
+ * Only messages in the layout that XplMsg writes, starting
+ * "xpl-xxxx\n{\nhop=n\nsource=...\ntarget=...\n", are ever rejected.
+ * @return false if the rules cannot be turned into a filter.
+ */
+bool BuildSocketFilter
+(
+    XplPrefilter::Summary const& summary,
+    vector<struct sock_filter>* pProgram
+)
+{
+    if ( summary.m_bAcceptAll || summary.m_ownVendors.empty() )
+    {
+        return false;
+    }
+
+    // A filter value that no well formed message can have is treated as a
+    // wildcard, to keep the program simple.
+    vector<string> types;
+    for ( uint32 i=0; i<summary.m_msgTypes.size(); ++i )
+    {
+        string const& type = summary.m_msgTypes[i];
+        if ( ( type.size() != 8 ) || ( Poco::toLower ( type.substr ( 0, 4 ) ) != "xpl-" ) )
+        {
+            types.clear();
+            break;
+        }
+        types.push_back ( type.substr ( 4 ) );
+    }
+    vector<string> vendors;
+    for ( uint32 i=0; i<summary.m_vendors.size(); ++i )
+    {
+        string const& vendor = summary.m_vendors[i];
+        if ( vendor.empty() || ( vendor.size() > kMaxVendorLength ) )
+        {
+            vendors.clear();
+            break;
+        }
+        vendors.push_back ( vendor + "-" );
+    }
+
+    BpfBuilder bpf;
+    uint32 const accept = bpf.NewLabel();
+    uint32 const reject = bpf.NewLabel();
+
+    // Check the fixed part of the header
+    bpf.Stmt ( BPF_LD | BPF_W | BPF_LEN, 0 );
+    bpf.JumpUnless ( BPF_JGE, kSourceOffset + kMaxVendorLength + 1, accept );
+    bpf.CompareText ( kUdpHeaderSize, false, "xpl-", accept );
+    bpf.CompareText ( kUdpHeaderSize + 8, false, "\n{\nhop=", accept );
+    bpf.CompareText ( kUdpHeaderSize + 16, false, "\nsource=", accept );
+
+    // Echoes of our own messages
+    for ( uint32 i=0; i<summary.m_ownVendors.size(); ++i )
+    {
+        uint32 const next = bpf.NewLabel();
+        bpf.CompareText ( kSourceOffset, false, summary.m_ownVendors[i] + "-", next );
+        bpf.Jump ( accept );
+        bpf.Place ( next );
+    }
+
+    // Message types and source vendors that some filter wants
+    if ( !types.empty() )
+    {
+        uint32 const found = bpf.NewLabel();
+        for ( uint32 i=0; i<types.size(); ++i )
+        {
+            uint32 const next = bpf.NewLabel();
+            bpf.CompareText ( kUdpHeaderSize + 4, false, types[i], next );
+            bpf.Jump ( found );
+            bpf.Place ( next );
+        }
+        bpf.Jump ( reject );
+        bpf.Place ( found );
+    }
+    if ( !vendors.empty() )
+    {
+        uint32 const found = bpf.NewLabel();
+        for ( uint32 i=0; i<vendors.size(); ++i )
+        {
+            uint32 const next = bpf.NewLabel();
+            bpf.CompareText ( kSourceOffset, false, vendors[i], next );
+            bpf.Jump ( found );
+            bpf.Place ( next );
+        }
+        bpf.Jump ( reject );
+        bpf.Place ( found );
+    }
+
+    // Find the end of the source line, which is where the target starts.
+    // BPF cannot loop, so every possible position is tried in turn.
+    uint32 const target = bpf.NewLabel();
+    for ( uint32 i=5; i<=kMaxSourceLength; ++i )
+    {
+        uint32 const offset = kSourceOffset + i;
+        uint32 const next = bpf.NewLabel();
+        bpf.Stmt ( BPF_LD | BPF_W | BPF_LEN, 0 );
+        bpf.JumpUnless ( BPF_JGT, offset, accept );
+        bpf.Stmt ( BPF_LD | BPF_B | BPF_ABS, offset );
+        bpf.JumpUnless ( BPF_JEQ, '\n', next );
+        bpf.Stmt ( BPF_LDX | BPF_W | BPF_IMM, offset + 1 );
+        bpf.Jump ( target );
+        bpf.Place ( next );
+    }
+    bpf.Jump ( accept );
+
+    // Compare the target with each one that a device accepts.  A target
+    // must be followed by the end of the line to match.
+    bpf.Place ( target );
+    bpf.Stmt ( BPF_LD | BPF_W | BPF_LEN, 0 );
+    bpf.Stmt ( BPF_ALU | BPF_SUB | BPF_X, 0 );
+    bpf.JumpUnless ( BPF_JGE, 9, accept );
+    bpf.CompareText ( 0, true, "target=", accept );
+    for ( uint32 i=0; i<summary.m_targets.size(); ++i )
+    {
+        string const& text = summary.m_targets[i];
+        uint32 const next = bpf.NewLabel();
+        bpf.Stmt ( BPF_LD | BPF_W | BPF_LEN, 0 );
+        bpf.Stmt ( BPF_ALU | BPF_SUB | BPF_X, 0 );
+        bpf.JumpUnless ( BPF_JGE, 7 + text.size() + 1, next );
+        bpf.CompareText ( 7, true, text, next );
+        bpf.Stmt ( BPF_LD | BPF_B | BPF_IND, 7 + text.size() );
+        bpf.JumpIf ( BPF_JEQ, '\n', accept );
+        bpf.JumpIf ( BPF_JEQ, '\r', accept );
+        bpf.JumpIf ( BPF_JEQ, ' ', accept );
+        bpf.JumpIf ( BPF_JEQ, '\t', accept );
+        bpf.Place ( next );
+    }
+
+    bpf.Place ( reject );
+    bpf.Stmt ( BPF_RET | BPF_K, 0 );
+    bpf.Place ( accept );
+    bpf.Stmt ( BPF_RET | BPF_K, 0xffffffff );
+
+    pProgram->swap ( bpf.Finish() );
+    return ( pProgram->size() <= BPF_MAXINSNS );
+}
+
+} // namespace
+#endif
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::UpdateSocketFilter										****
+****																	****
+***************************************************************************/
+
+void XplUDP::UpdateSocketFilter()
+{
+    Mutex::ScopedLock lock ( socketFilterLock_ );
+    if ( !IsConnected() )
+    {
+        return;
+    }
+
+#ifdef XPL_HAVE_SOCKET_FILTER
+    vector<struct sock_filter> program;
+    if ( kernelFilter_ && rxPrefilter.IsEnabled() )
+    {
+        if ( socketFilterAttached_ && ( socketFilterGeneration_ == rxPrefilter.GetGeneration() ) )
+        {
+            return;
+        }
+
+        XplPrefilter::Summary summary;
+        socketFilterGeneration_ = rxPrefilter.GetSummary ( &summary );
+        if ( BuildSocketFilter ( summary, &program ) )
+        {
+            struct sock_fprog fprog;
+            fprog.len = ( unsigned short ) program.size();
+            fprog.filter = &program[0];
+
+            bool attached = true;
+            for ( uint32 i=0; i<rxShards_.size(); ++i )
+            {
+                if ( setsockopt ( rxShards_[i]->socket_.impl()->sockfd(), SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof ( fprog ) ) )
+                {
+                    poco_warning ( commsLog, "Unable to attach the socket filter: error " + NumberFormatter::format ( errno ) );
+                    attached = false;
+                    break;
+                }
+            }
+            if ( attached )
+            {
+                socketFilterAttached_ = true;
+                return;
+            }
+        }
+    }
+
+    // Either the filter isn't wanted, or it couldn't be built
+    if ( socketFilterAttached_ )
+    {
+        for ( uint32 i=0; i<rxShards_.size(); ++i )
+        {
+            int unused = 0;
+            setsockopt ( rxShards_[i]->socket_.impl()->sockfd(), SOL_SOCKET, SO_DETACH_FILTER, &unused, sizeof ( unused ) );
+        }
+        socketFilterAttached_ = false;
+    }
+#endif
+}
+
+
+/***************************************************************************
+****																	****
+****	XplUDP::GetRxFilterStats										****
+****																	****
+***************************************************************************/
+
+XplUDP::RxFilterStats XplUDP::GetRxFilterStats() const
+{
+    XplPrefilter::Stats prefilterStats = rxPrefilter.GetStats();
+
+    RxFilterStats stats;
+    stats.kernelDropped = 0;
+    stats.prefilterAccepted = prefilterStats.m_accepted;
+    stats.prefilterRejected = prefilterStats.m_rejected;
+
+    Mutex::ScopedLock lock ( socketFilterLock_ );
+    stats.kernelFilter = socketFilterAttached_;
+#if defined(XPL_HAVE_SOCKET_FILTER) && defined(SO_MEMINFO)
+    if ( IsConnected() )
+    {
+        for ( uint32 i=0; i<rxShards_.size(); ++i )
+        {
+            uint32 meminfo[SK_MEMINFO_VARS];
+            socklen_t size = sizeof ( meminfo );
+            if ( 0 == getsockopt ( rxShards_[i]->socket_.impl()->sockfd(), SOL_SOCKET, SO_MEMINFO, meminfo, &size ) )
+            {
+                stats.kernelDropped += meminfo[SK_MEMINFO_DROPS];
+            }
+        }
+    }
+#endif
+    return stats;
+}
@@ -40,6 +40,7 @@
 #include <vector>
 #include <string>
 #include "Poco/Event.h"
+#include "Poco/AtomicCounter.h"
 #include "Poco/Net/IPAddress.h"
 #include "Poco/Net/DatagramSocket.h"
 #include "Poco/Net/NetworkInterface.h"
@@ -51,11 +52,29 @@
 
 
 #include <queue>
+#include <map>
+
+#if defined(__linux__)
+#define XPL_HAVE_RECVMMSG 1
+#define XPL_HAVE_SENDMMSG 1
+#include <sys/socket.h>
+#include <netinet/in.h>
+#ifdef SO_REUSEPORT
+#define XPL_HAVE_REUSEPORT 1
+#endif
+#ifdef SO_ATTACH_FILTER
+#define XPL_HAVE_SOCKET_FILTER 1
+#endif
+#endif
 
 #include "XplCore.h"
 #include "XplComms.h"
+#include "XplMsgTemplate.h"
+#include "XplReactor.h"
+#include "XplRingQueue.h"
 
 using Poco::Mutex;
+using Poco::FastMutex;
 using Poco::Net::DatagramSocket;
 using Poco::RunnableAdapter;
 using Poco::Thread;
@@ -137,9 +156,163 @@ public:
         return interface_.address().toString();
     }
 
+    /**
+     * Gets the event loop that runs on the (first) receive thread.
+     * Other sockets and timers can be registered with it while connected,
+     * and their handlers will be called on the receive thread.  Disconnect
+     * stops the loop straight away, and forgets everything registered.
+     */
+    XplReactor& GetReactor()
+    {
+        return rxShards_[0]->reactor_;
+    }
+
+    /**
+     * Sets how many sockets and threads receive messages.
+     * On Linux, values above one open that many sockets on the xPL port
+     * with SO_REUSEPORT, each read and parsed by its own thread, so that a
+     * hub that sees every packet on the segment can use more than one core.
+     * Messages from any one sender (address and port) are always handled
+     * by the same thread, so they are passed on in the order they arrived.
+     * Messages from different senders may be passed to the devices from
+     * different threads at the same time.  Other platforms always use a
+     * single socket.  Only takes effect when the connection is next opened.
+     * @param shardCount the number of receive sockets and threads.
+     */
+    void SetRxShards ( uint32 const shardCount )
+    {
+        rxShardCount_ = shardCount ? shardCount : 1;
+    }
+
+    /**
+     * Sets how many datagrams may be read from the socket at once.
+     * On Linux, the receive thread uses recvmmsg to read up to this many
+     * waiting datagrams in a single call, which keeps up far better with
+     * bursts of broadcasts.  A value of one reads them one at a time, which
+     * is also what happens on other platforms.  Only takes effect when the
+     * receive thread is next started.
+     * @param batchSize the most datagrams to read in one call.
+     */
+    void SetRxBatchSize ( uint32 const batchSize )
+    {
+        rxBatchSize_ = batchSize ? batchSize : 1;
+    }
+
+    /**
+     * What to do with a received message when the receive queue is full.
+     */
+    enum RxOverflowPolicy
+    {
+        kRxDropOldest = 0,		// Throw away the oldest queued message to make room
+        kRxDropNewest,			// Throw away the message just received
+        kRxBlock				// Stop reading the socket until there is room
+    };
+
+    /**
+     * Sets up the queue between the receive threads and the devices.
+     * Received messages are put in a lock-free queue, and a separate
+     * dispatch thread passes them on to the devices, so a slow device does
+     * not hold up reading the socket.  Only takes effect when the
+     * connection is next opened.
+     * @param queueSize the most messages that can wait to be dispatched.
+     * Zero removes the queue, and messages are passed on by the receive
+     * threads themselves.
+     * @param policy what to do when a message arrives and the queue is full.
+     */
+    void SetRxQueue ( uint32 const queueSize, RxOverflowPolicy const policy )
+    {
+        rxQueueSize_ = queueSize;
+        rxOverflowPolicy_ = policy;
+    }
+
+    /**
+     * Counters for the receive queue.
+     */
+    struct RxQueueStats
+    {
+        uint32	queued;			// Messages put in the queue
+        uint32	dispatched;		// Messages passed on to the devices
+        uint32	dropped;		// Messages thrown away because the queue was full
+        uint32	depth;			// Messages in the queue right now
+        uint32	maxDepth;		// Most messages there have been in the queue
+        uint32	capacity;		// Size of the queue, or zero if there isn't one
+    };
+
+    /**
+     * Gets the counters for the receive queue.
+     */
+    RxQueueStats GetRxQueueStats() const;
+
+    /**
+     * Sets how many messages may wait in the transmit queue.
+     * Only takes effect when the connection is next opened.
+     * @param queueSize the most messages that can be queued.  Messages
+     * sent while the queue is full are dropped.
+     */
+    void SetTxQueueSize ( uint32 const queueSize )
+    {
+        txQueueSize_ = queueSize ? queueSize : 1;
+    }
+
+    /**
+     * Counters for the transmit queue.
+     */
+    struct TxStats
+    {
+        uint32	queued;			// Messages accepted into the queue
+        uint32	sent;			// Messages sent
+        uint32	dropped;		// Messages refused because the queue was full
+        uint32	failed;			// Messages the socket would not send
+        uint32	retries;		// Times a send was tried again because the socket buffer was full
+        uint32	batches;		// Number of batches sent
+        uint32	maxBatch;		// Largest batch sent
+        uint32	depth;			// Messages in the queue right now
+        uint32	maxDepth;		// Most messages there have been in the queue
+    };
+
+    /**
+     * Gets the counters for the transmit queue.
+     */
+    TxStats GetTxStats() const;
+
+    /**
+     * Turns the kernel socket filter on or off.
+     * On Linux, while rxPrefilter is enabled, a classic BPF program built
+     * from the devices' rules is attached to the receive sockets, so that
+     * most unwanted broadcasts are thrown away by the kernel without ever
+     * waking a receive thread.  The program only looks at the message type,
+     * the source vendor and the target, and passes anything it is not sure
+     * about, so rxPrefilter and the devices still make the final decision.
+     * It is rebuilt whenever a device's rules change.  Enable rxPrefilter
+     * before calling this.  Off by default, and ignored on other platforms.
+     * @param enable true to use the kernel filter.
+     */
+    void SetKernelFilter ( bool const enable );
+
+    /**
+     * Counters for messages thrown away before they were parsed.
+     */
+    struct RxFilterStats
+    {
+        uint32	kernelDropped;		// Datagrams dropped by the receive sockets.  Includes any lost because a socket's buffer was full.
+        uint32	prefilterAccepted;	// Messages passed by rxPrefilter
+        uint32	prefilterRejected;	// Messages thrown away by rxPrefilter
+        bool	kernelFilter;		// True if the kernel filter is attached right now
+    };
+
+    /**
+     * Gets the counters for the kernel filter and rxPrefilter.
+     */
+    RxFilterStats GetRxFilterStats() const;
+
     // Overrides of XplComms' methods.  See XplComms.h for documentation.
+    // TxMsg only queues the message, and returns false if the queue is full.
     virtual bool TxMsg ( XplMsg& pMsg );
 
+    virtual void OnPrefilterChanged();
+
+    virtual void OnSourceRemoved ( string const& source );
+
     virtual void SendHeartbeat ( string const& source, uint32 const interval, string const& version );
 
     /**
@@ -163,33 +336,210 @@ private:
     bool GetLocalIPs();
 
     /**
-     * target for the the listenAdapter thread to sit and listen for packets.
+     * One receive socket, with the thread and event loop that read it.
+     * Normally there is just one.  See SetRxShards.
+     */
+    class RxShard: public Poco::Runnable, public XplReactorHandler
+    {
+    public:
+        RxShard ( XplUDP& owner, uint32 const index );
+
+        /**
+         * target for the thread to sit and listen for packets.
+         */
+        virtual void run();
+
+        /**
+         * Called by the reactor when the socket has data waiting.
+         */
+        virtual void OnReadable ( int fd );
+
+        DatagramSocket				socket_;
+        XplReactor					reactor_;
+        Thread						thread_;
+
+    private:
+#ifdef XPL_HAVE_RECVMMSG
+        /**
+         * Version of OnReadable that reads datagrams in batches.
+         */
+        void ReadPacketBatches();
+#endif
+
+        /**
+         * Checks whether a message from this sender is handled by this shard.
+         */
+        bool IsOwnSender ( struct sockaddr const* pSender ) const;
+
+        XplUDP&						owner_;
+        uint32 const				index_;
+#ifdef XPL_HAVE_RECVMMSG
+        vector<char>				rxBuffers_;				// rxBatchSize_ datagrams of kMaxDatagramSize
+        vector<struct mmsghdr>		rxHeaders_;
+        vector<struct iovec>		rxIovecs_;
+        vector<struct sockaddr_in>	rxSenders_;
+#endif
+    };
+    friend class RxShard;
+
+    /**
+     * Opens the receive sockets for every shard.
+     * When there is more than one shard, the address is first bound
+     * without SO_REUSEPORT, so that a port already used by somebody
+     * else is still seen as taken.
+     * @param sa the address to bind to.
+     * @throws NetException if the address cannot be bound.
+     */
+    void BindRxSockets ( Poco::Net::SocketAddress const& sa );
+
+    /**
+     * Attaches a new kernel filter to the receive sockets if the rules have
+     * changed, or removes it if it is no longer wanted.
+     * @see SetKernelFilter
+     */
+    void UpdateSocketFilter();
+
+    /**
+     * Checks a sender against the list of addresses we accept messages from.
+     * @param host the sender's address.
+     * @return true if messages from this address should be handled.
+     */
+    bool IsListenedTo ( Poco::Net::IPAddress const& host ) const;
+
+    /**
+     * Puts a received message in the receive queue, applying the
+     * overflow policy if it is full.
+     * @param pMsg the message.
+     */
+    void QueueReceivedMessage ( AutoPtr<XplMsg>& pMsg );
+
+    /**
+     * target for the rxDispatchAdapter thread to pass queued messages on
+     * to the devices.
      */
-    void ListenForPackets();
+    void DispatchReceivedMessages();
+
+    /**
+     * Parses a received datagram and passes it on to the devices.
+     * @param pData the datagram.
+     * @param size the number of bytes in the datagram.
+     */
+    void HandleDatagram ( char const* pData, uint32 const size );
+
+    /**
+     * Queues a message that has already been formatted.
+     * @param pData the raw message data.
+     * @param size the number of bytes of message data.
+     * @return true if the message was queued.
+     */
+    bool TxRawData ( char const* pData, uint32 const size );
+
+    /**
+     * target for the txAdapter thread to send the queued messages.
+     */
+    void SendQueuedPackets();
+
+    /**
+     * Sends a batch of messages taken from the queue.
+     * @param batch the messages.
+     * @param count the number of messages at the start of batch to send.
+     */
+    void SendBatch ( vector<string>& batch, uint32 const count );
+
+    /**
+     * A cached heartbeat message, and the lock held while its fields are
+     * patched and it is queued.  Each source has its own, so devices do
+     * not wait for each other's heartbeats.
+     */
+    struct HeartbeatTemplate: public RefCountedObject
+    {
+        AutoPtr<XplMsgTemplate>	m_pTemplate;
+        FastMutex				m_lock;
+    };
+
+    typedef map<string, AutoPtr<HeartbeatTemplate> > TemplateMap;
+
+    /**
+     * Sends an hbeat.app or config.app message from a cached template.
+     * @param schemaClass "hbeat" or "config".
+     * @param pTemplates the templates for that schema, one per source.
+     * @see SendHeartbeat, SendConfigHeartbeat
+     */
+    void SendAppHeartbeat ( string const& schemaClass, TemplateMap* pTemplates, string const& source, uint32 const interval, string const& version );
+
+    // Fields of the heartbeat templates, in the order they are added
+    enum
+    {
+        kHeartbeatInterval = 0,
+        kHeartbeatPort,
+        kHeartbeatRemoteIp,
+        kHeartbeatVersion
+    };
 
     uint16						rxPort_;				// Port on which we are listening for messages
     uint16						txPort_;				// Port on which we are sending messages
     Poco::Net::NetworkInterface						interface_;					// Local IP address to use in xPL heartbeats
+    string						heartbeatIP_;			// interface_'s address as text
     bool						viaHub_;				// If false, bind directly to port 3865
 
     //SOCKET						m_sock;					// Socket used to send and receive xpl Messages
     DatagramSocket socket_;
-    RunnableAdapter<XplUDP>* listenAdapter_;
-    Thread  listenThread_;
-    queue<XplMsg*> incommingQueue_;
-    Mutex incommingQueueLock_;
+    vector<RxShard*>			rxShards_;				// Always at least one.  socket_ is the first one's socket.
+    uint32						rxShardCount_;			// Number of shards to use when next connected
+    bool						rxShardBySender_;		// True when every shard receives every message
+    RunnableAdapter<XplUDP>* txAdapter_;
+    Thread  txThread_;
+
+    // Transmit queue.  A ring of txQueueSize_ strings.
+    vector<string>				txQueue_;
+    uint32						txQueueSize_;
+    uint32						txQueueHead_;			// Index of the oldest queued message
+    uint32						txQueueCount_;			// Number of queued messages
+    mutable Mutex				txQueueLock_;
+    Poco::Event					txEvent_;				// Set when messages are queued
+    TxStats						txStats_;
+    Poco::Net::SocketAddress	txDestSocketAddr_;		// Where messages are sent
+#ifdef XPL_HAVE_SENDMMSG
+    struct sockaddr_storage		txDestAddr_;			// txDestSocketAddr_ for sendmmsg
+#endif
+    // Receive queue, emptied by rxDispatchThread_
+    XplRingQueue<XplMsg*>*		rxQueue_;				// NULL when messages are dispatched by the receive threads
+    uint32						rxQueueSize_;			// Size of the queue to create when next connected
+    RxOverflowPolicy			rxOverflowPolicy_;
+    Poco::AtomicCounter			rxQueued_;
+    Poco::AtomicCounter			rxDispatched_;
+    Poco::AtomicCounter			rxDropped_;
+    uint32						rxMaxDepth_;
+    uint32						rxDispatchWaiting_;		// Non-zero while the dispatch thread is waiting on rxEvent_
+    RunnableAdapter<XplUDP>*	rxDispatchAdapter_;
+    Thread						rxDispatchThread_;
     //WSAEVENT					m_rxEvent;				// Event used to wait for received data
-    Poco::Event   rxEvent_;
+    Poco::Event					rxEvent_;				// Set when a message is queued for a waiting dispatch thread
 
 
     uint32						txAddr_;				// IP address to which we send our messages.  Defaults to the broadcast address.
     uint32						listenOnAddress_;		// IP address on which we listen for incoming messages
 
+    uint32						rxBatchSize_;			// Most datagrams to read with each recvmmsg call
+    bool						kernelFilter_;			// True to attach a BPF filter to the receive sockets
+    bool						socketFilterAttached_;	// True while the receive sockets have a filter
+    uint32						socketFilterGeneration_;	// rxPrefilter generation the attached filter was built from
+    mutable Mutex				socketFilterLock_;		// Held while the filter or the receive sockets are changed
     bool						listenToFilter_;		// True to enable filtering of IP addresses from which we can receive messages.
     vector<Poco::Net::IPAddress>				listenToAddresses_;	// List of IP addresses that we accept messages from when m_bListenToFilter is true.
     vector<Poco::Net::IPAddress>				localIPs_;				// List of all local IP addresses for this machine
 
+    TemplateMap					hbeatTemplates_;		// hbeat.app messages, by source
+    TemplateMap					configTemplates_;		// config.app messages, by source
+    FastMutex					templateLock_;			// Held only while the template maps are searched or changed
+
     static uint16 const			kXplHubPort;			// Standard port assigned to xPL traffic
+    static uint32 const			kMaxDatagramSize = 2048;	// Larger than any xPL message
+    static uint32 const			kDefaultRxBatchSize = 32;
+    static uint32 const			kDefaultTxQueueSize = 256;
+    static uint32 const			kDefaultRxQueueSize = 1024;
+    static uint32 const			kTxBatchSize = 32;
+    static uint32 const			kTxMaxRetries = 8;		// Waits of 1, 2, 4 ... 128ms for the socket buffer to drain
     Logger& commsLog;
 };
 
@@ -0,0 +1,193 @@
+/***************************************************************************
+****																	****
+****	FilterTest.cpp													****
+****																	****
+****	Checks the filter set against the filters one by one			****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include "XplCore.h"
+#include "XplMsg.h"
+#include "xplFilter.h"
+#include "XplSymbol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace xpl;
+
+// Values the random filters and messages are made from.  The last entry
+// of each is only used in filters.
+static char const* const c_msgTypes[] = { "xpl-cmnd", "xpl-stat", "xpl-trig", "*" };
+static char const* const c_vendors[] = { "acme", "foo", "bar", "*" };
+static char const* const c_devices[] = { "temp", "lamp", "*" };
+static char const* const c_instances[] = { "a", "b", "*" };
+static char const* const c_classes[] = { "sensor", "control", "x10", "*" };
+static char const* const c_types[] = { "basic", "request", "*" };
+
+#define NUM_VALUES(a) ( sizeof(a) / sizeof(a[0]) )
+#define PICK_FILTER(a) a[rand() % NUM_VALUES(a)]
+#define PICK_MSG(a) a[rand() % ( NUM_VALUES(a) - 1 )]
+
+static uint32 const c_numRounds = 300;
+static uint32 const c_msgsPerRound = 50;
+static uint32 const c_maxFilters = 80;
+
+
+/***************************************************************************
+****																	****
+****	MakeFilter														****
+****																	****
+***************************************************************************/
+
+static string MakeFilter()
+{
+    char buffer[256];
+    snprintf ( buffer, sizeof(buffer), "%s.%s.%s.%s.%s.%s", PICK_FILTER(c_msgTypes), PICK_FILTER(c_vendors), PICK_FILTER(c_devices), PICK_FILTER(c_instances), PICK_FILTER(c_classes), PICK_FILTER(c_types) );
+    return buffer;
+}
+
+
+/***************************************************************************
+****																	****
+****	MakeMsg															****
+****																	****
+***************************************************************************/
+
+static AutoPtr<XplMsg> MakeMsg()
+{
+    char buffer[512];
+    snprintf ( buffer, sizeof(buffer), "%s\n{\nhop=1\nsource=%s-%s.%s\ntarget=*\n}\n%s.%s\n{\ncommand=on\n}\n", PICK_MSG(c_msgTypes), PICK_MSG(c_vendors), PICK_MSG(c_devices), PICK_MSG(c_instances), PICK_MSG(c_classes), PICK_MSG(c_types) );
+    return new XplMsg ( buffer, ( uint32 ) strlen ( buffer ) );
+}
+
+
+/***************************************************************************
+****																	****
+****	CheckMadeUpSchemas												****
+****																	****
+****	Receives messages with schemas nobody has used, and checks that	****
+****	they are not added to XplSymbolTable but still filter correctly	****
+****																	****
+***************************************************************************/
+
+static bool CheckMadeUpSchemas()
+{
+    vector<string> filterStrs;
+    filterStrs.push_back ( "xpl-cmnd.*.*.*.sensor.*" );
+    filterStrs.push_back ( "xpl-trig.*.*.*.*.*" );
+    AutoPtr<xplFilterSet> pFilterSet = new xplFilterSet ( filterStrs );
+
+    uint32 const numSymbols = XplSymbolTable::GetNumSymbols();
+    uint32 numWrong = 0;
+    for ( uint32 i=0; i<1000; ++i )
+    {
+        char buffer[512];
+        snprintf ( buffer, sizeof(buffer), "%s\n{\nhop=1\nsource=acme-temp.a\ntarget=*\n}\nCL%06u.TY%06u\n{\ncommand=on\n}\n", ( i & 1 ) ? "xpl-trig" : "xpl-cmnd", i, i );
+        AutoPtr<XplMsg> pMsg = new XplMsg ( buffer, ( uint32 ) strlen ( buffer ) );
+
+        char schemaClass[16];
+        snprintf ( schemaClass, sizeof(schemaClass), "cl%06u", i );
+        numWrong += ( pMsg->GetSchemaClass() != XplStringView ( schemaClass ) );
+        numWrong += ( pFilterSet->Allow ( *pMsg ) != ( 0 != ( i & 1 ) ) );
+    }
+
+    uint32 const numAdded = XplSymbolTable::GetNumSymbols() - numSymbols;
+    printf ( "made-up schemas: %u names added to the symbol table, %u wrong\n", numAdded, numWrong );
+    return ( 0 == numAdded ) && ( 0 == numWrong );
+}
+
+
+/***************************************************************************
+****																	****
+****	main															****
+****																	****
+****	Builds random sets of filters, and checks that xplFilterSet		****
+****	passes exactly the messages that at least one xplFilter passes	****
+****																	****
+***************************************************************************/
+
+int main()
+{
+    srand ( 3 );
+
+    uint32 numChecked = 0;
+    uint32 numAllowed = 0;
+    uint32 numMismatches = 0;
+    for ( uint32 round=0; round<c_numRounds; ++round )
+    {
+        // The first round has no filters, which must pass everything
+        uint32 const numFilters = round ? ( rand() % c_maxFilters ) : 0;
+        vector<string> filterStrs;
+        vector<xplFilter*> filters;
+        for ( uint32 i=0; i<numFilters; ++i )
+        {
+            filterStrs.push_back ( MakeFilter() );
+            filters.push_back ( new xplFilter ( filterStrs.back() ) );
+        }
+        AutoPtr<xplFilterSet> pFilterSet = new xplFilterSet ( filterStrs );
+
+        for ( uint32 i=0; i<c_msgsPerRound; ++i )
+        {
+            AutoPtr<XplMsg> pMsg = MakeMsg();
+
+            bool bExpected = filters.empty();
+            for ( uint32 j=0; j<filters.size(); ++j )
+            {
+                if ( filters[j]->Allow ( *pMsg ) )
+                {
+                    bExpected = true;
+                    break;
+                }
+            }
+
+            bool const bAllowed = pFilterSet->Allow ( *pMsg );
+            if ( bAllowed != bExpected )
+            {
+                if ( numMismatches < 10 )
+                {
+                    printf ( "mismatch in round %u: set says %d, filters say %d for\n%s", round, bAllowed, bExpected, pMsg->GetRawData().c_str() );
+                }
+                ++numMismatches;
+            }
+            numAllowed += bAllowed;
+            ++numChecked;
+        }
+
+        for ( uint32 j=0; j<filters.size(); ++j )
+        {
+            delete filters[j];
+        }
+    }
+
+    printf ( "checked %u messages, %u allowed, %u mismatches\n", numChecked, numAllowed, numMismatches );
+
+    bool const bOk = CheckMadeUpSchemas();
+    return ( numMismatches || !bOk ) ? 1 : 0;
+}
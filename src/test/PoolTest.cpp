@@ -0,0 +1,230 @@
+/***************************************************************************
+****																	****
+****	PoolTest.cpp													****
+****																	****
+****	Checks that pooled messages do not allocate						****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include "XplCore.h"
+#include "XplMsg.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+using namespace xpl;
+
+// Counts every call to the global allocator
+static long s_numAllocs = 0;
+
+void* operator new ( size_t _size )
+{
+    ++s_numAllocs;
+    void* p = malloc ( _size ? _size : 1 );
+    if ( NULL == p )
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete ( void* _p ) throw()
+{
+    free ( _p );
+}
+
+void operator delete ( void* _p, size_t /*_size*/ ) throw()
+{
+    free ( _p );
+}
+
+static char const* const c_message = "xpl-trig\n{\nhop=1\nsource=acme-weather.roof\ntarget=*\n}\nsensor.basic\n{\ndevice=outside\ntype=temp\ncurrent=21.5\nunits=c\n}\n";
+
+
+/***************************************************************************
+****																	****
+****	ReceiveMessage													****
+****																	****
+****	Does what the receive path does with a message: parse it from	****
+****	raw data, read a few values, then let it go						****
+****																	****
+***************************************************************************/
+
+static bool ReceiveMessage()
+{
+    AutoPtr<XplMsg> pMsg = new XplMsg ( c_message, ( uint32 ) strlen ( c_message ) );
+    XplStringView units;
+    return ( pMsg->GetValue ( "CURRENT" ) == "21.5" ) && pMsg->GetValueView ( "units", &units ) && ( units == "c" );
+}
+
+
+/***************************************************************************
+****																	****
+****	CheckSteadyState												****
+****																	****
+****	Once the pools have warmed up, receiving a message must not		****
+****	call the global allocator at all								****
+****																	****
+***************************************************************************/
+
+static bool CheckSteadyState()
+{
+    XplMsg::SetPooling ( 16 );
+    for ( uint32 i=0; i<10; ++i )
+    {
+        ReceiveMessage();
+    }
+
+    long const before = s_numAllocs;
+    for ( uint32 i=0; i<10000; ++i )
+    {
+        if ( !ReceiveMessage() )
+        {
+            printf ( "FAIL: wrong values read from a pooled message\n" );
+            return false;
+        }
+    }
+    long const allocs = s_numAllocs - before;
+
+    XplPoolStats msgStats;
+    XplPoolStats storageStats;
+    XplMsg::GetPoolStats ( &msgStats, &storageStats );
+    printf ( "pooled: %ld allocations in 10000 messages, %u message hits, %u storage hits\n", allocs, msgStats.m_hits, storageStats.m_hits );
+    if ( allocs )
+    {
+        printf ( "FAIL: pooled messages still allocate\n" );
+        return false;
+    }
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	CheckToggle														****
+****																	****
+****	Messages made while pooling is off and released while it is on	****
+****	must go back into the pool, and be reused without allocating	****
+****																	****
+***************************************************************************/
+
+static bool CheckToggle()
+{
+    XplMsg::SetPooling ( 0 );
+    vector<AutoPtr<XplMsg> > msgs;
+    for ( uint32 i=0; i<8; ++i )
+    {
+        msgs.push_back ( new XplMsg ( c_message, ( uint32 ) strlen ( c_message ) ) );
+    }
+
+    XplMsg::SetPooling ( 16 );
+    msgs.clear();
+
+    // The blocks kept from the unpooled messages must be big enough to
+    // hold a message, and are handed out again
+    XplPoolStats msgStats;
+    XplPoolStats storageStats;
+    XplMsg::GetPoolStats ( &msgStats, &storageStats );
+    uint32 const hits = msgStats.m_hits;
+    for ( uint32 i=0; i<8; ++i )
+    {
+        msgs.push_back ( new XplMsg ( c_message, ( uint32 ) strlen ( c_message ) ) );
+        XplStringView units;
+        if ( !msgs.back()->GetValueView ( "units", &units ) || ( units != "c" ) )
+        {
+            printf ( "FAIL: wrong values read from a reused message\n" );
+            return false;
+        }
+    }
+    msgs.clear();
+
+    XplMsg::GetPoolStats ( &msgStats, &storageStats );
+    printf ( "toggled: %u of 8 messages reused blocks freed after pooling was turned on\n", msgStats.m_hits - hits );
+    if ( 8 != ( msgStats.m_hits - hits ) )
+    {
+        printf ( "FAIL: blocks freed after pooling was turned on were not reused\n" );
+        return false;
+    }
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	main															****
+****																	****
+****	R																****
+****	e																****
+****	t																****
+****	u																****
+****	r																****
+****	n																****
+****	s																****
+****	 																****
+****	n																****
+****	o																****
+****	n																****
+****	-																****
+****	z																****
+****	e																****
+****	r																****
+****	o																****
+****	 																****
+****	i																****
+****	f																****
+****	 																****
+****	a																****
+****	 																****
+****	c																****
+****	h																****
+****	e																****
+****	c																****
+****	k																****
+****	 																****
+****	f																****
+****	a																****
+****	i																****
+****	l																****
+****	s																****
+****																	****
+***************************************************************************/
+
+int main()
+{
+    bool bOk = CheckSteadyState();
+    bOk &= CheckToggle();
+
+    XplMsg::SetPooling ( 0 );
+    long const before = s_numAllocs;
+    ReceiveMessage();
+    printf ( "unpooled: %ld allocations per message\n", s_numAllocs - before );
+
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+/***************************************************************************
+****																	****
+****	ScannerBench.cpp												****
+****																	****
+****	Checks and times the raw message scanner						****
+****																	****
+****	Copyright (c) 2005 Mal Lansell.									****
+****    Email: xpl@lansell.org                                          ****
+****																	****
+****	Permission is hereby granted, free of charge, to any person		****
+****	obtaining a copy of this software and associated documentation	****
+****	files (the "Software"), to deal in the Software without			****
+****	restriction, including without limitation the rights to use,	****
+****	copy, modify, merge, publish, distribute, sublicense, and/or	****
+****	sell copies of the Software, and to permit persons to whom the	****
+****	Software is furnished to do so, subject to the following		****
+****	conditions:														****
+****																	****
+****	The above copyright notice and this permission notice shall		****
+****	be included in all copies or substantial portions of the		****
+****	Software.														****
+****																	****
+****	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY		****
+****	KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE		****
+****	WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR			****
+****	PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR	****
+****	COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER		****
+****	LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR			****
+****	OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE		****
+****	SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.			****
+****																	****
+***************************************************************************/
+
+#include "XplCore.h"
+#include "XplScanner.h"
+#include "XplStringUtils.h"
+#include "XplStringView.h"
+#include "Poco/Timestamp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace xpl;
+
+// Messages of the sizes normally seen on an xPL network
+static char const* const c_messages[] =
+{
+    "xpl-stat\n{\nhop=1\nsource=acme-lamp.hall\ntarget=*\n}\nhbeat.app\n{\ninterval=5\nport=50000\nremote-ip=192.168.1.10\nversion=1.1.0\n}\n",
+    "xpl-cmnd\n{\nhop=1\nsource=xpl-xplhal.server\ntarget=acme-lamp.hall\n}\nconfig.response\n{\nnewconf=hall\ninterval=5\ngroup=xpl-group.lights\ngroup=xpl-group.downstairs\nfilter=xpl-cmnd.*.*.*.x10.basic\nfilter=xpl-cmnd.*.*.*.lighting.basic\n}\n",
+    "xpl-trig\r\n{\r\nhop=1\r\nsource=acme-weather.roof\r\ntarget=*\r\n}\r\nsensor.basic\r\n{\r\ndevice=outside\r\ntype=temp\r\ncurrent=12.5\r\nunits=c\r\nlowest=4.0\r\nhighest=17.2\r\n}\r\n"
+};
+
+static uint32 const c_numMessages = sizeof ( c_messages ) / sizeof ( c_messages[0] );
+
+static ScanMethod const c_methods[] = { kScanScalar, kScanSse2, kScanAvx2 };
+static char const* const c_methodNames[] = { "scalar", "sse2", "avx2" };
+static uint32 const c_numMethods = sizeof ( c_methods ) / sizeof ( c_methods[0] );
+
+
+/***************************************************************************
+****																	****
+****	CheckBuffer														****
+****																	****
+****	Scans a buffer with every available method and compares the		****
+****	offsets with those from the byte loop							****
+****																	****
+***************************************************************************/
+
+static bool CheckBuffer
+(
+    string const& _buffer
+)
+{
+    vector<uint32> expected;
+    vector<uint32> positions;
+    ScanForCharsScalar ( _buffer.data(), ( uint32 ) _buffer.size(), '\n', '\r', '=', &expected );
+
+    for ( uint32 i=0; i<c_numMethods; ++i )
+    {
+        if ( ScanForCharsUsing ( c_methods[i], _buffer.data(), ( uint32 ) _buffer.size(), '\n', '\r', '=', &positions ) && ( positions != expected ) )
+        {
+            printf ( "FAIL: %s scan of a %u byte buffer found %u characters, expected %u\n", c_methodNames[i], ( uint32 ) _buffer.size(), ( uint32 ) positions.size(), ( uint32 ) expected.size() );
+            return false;
+        }
+    }
+
+    ScanForChars ( _buffer.data(), ( uint32 ) _buffer.size(), '\n', '\r', '=', &positions );
+    if ( positions != expected )
+    {
+        printf ( "FAIL: ScanForChars of a %u byte buffer disagrees with the byte loop\n", ( uint32 ) _buffer.size() );
+        return false;
+    }
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	CheckMethods													****
+****																	****
+***************************************************************************/
+
+static bool CheckMethods()
+{
+    bool bOk = true;
+    for ( uint32 i=0; i<c_numMessages; ++i )
+    {
+        bOk &= CheckBuffer ( c_messages[i] );
+    }
+
+    // Random buffers of every length up to a few blocks, with the
+    // characters being looked for common enough to land on every
+    // position within a block, including the first and last.
+    static char const c_alphabet[] = "ab=\n\r\x80\xff";
+    srand ( 1 );
+    for ( uint32 size=0; size<=200; ++size )
+    {
+        for ( uint32 n=0; n<50; ++n )
+        {
+            string buffer ( size, ' ' );
+            for ( uint32 i=0; i<size; ++i )
+            {
+                buffer[i] = c_alphabet[rand() % ( sizeof ( c_alphabet ) - 1 )];
+            }
+            bOk &= CheckBuffer ( buffer );
+        }
+    }
+
+    for ( uint32 i=0; i<c_numMethods; ++i )
+    {
+        printf ( "%-8s %s\n", c_methodNames[i], IsScanMethodAvailable ( c_methods[i] ) ? "checked" : "not available" );
+    }
+    return bOk;
+}
+
+
+/***************************************************************************
+****																	****
+****	TimeReadLine													****
+****																	****
+****	The loop the message parser used before the scanner: read a		****
+****	line at a time and look for the '=' in each						****
+****																	****
+***************************************************************************/
+
+static uint32 TimeReadLine
+(
+    uint32 const _iterations,
+    double* _pNs
+)
+{
+    uint32 count = 0;
+    Poco::Timestamp start;
+    for ( uint32 n=0; n<_iterations; ++n )
+    {
+        XplStringView const message ( c_messages[n % c_numMessages] );
+        XplStringView line;
+        uint32 pos = 0;
+        while ( pos < message.size() )
+        {
+            pos = StringReadLine ( message, pos, &line );
+            if ( line.find ( '=' ) != XplStringView::npos )
+            {
+                ++count;
+            }
+        }
+    }
+    *_pNs = ( double ) start.elapsed() * 1000.0 / _iterations;
+    return count;
+}
+
+
+/***************************************************************************
+****																	****
+****	TimeScan														****
+****																	****
+***************************************************************************/
+
+static uint32 TimeScan
+(
+    ScanMethod const _method,
+    bool const _bAuto,
+    uint32 const _iterations,
+    double* _pNs
+)
+{
+    uint32 count = 0;
+    vector<uint32> positions;
+    Poco::Timestamp start;
+    for ( uint32 n=0; n<_iterations; ++n )
+    {
+        char const* pMessage = c_messages[n % c_numMessages];
+        uint32 const size = ( uint32 ) strlen ( pMessage );
+        if ( _bAuto )
+        {
+            ScanForChars ( pMessage, size, '\n', '\r', '=', &positions );
+        }
+        else
+        {
+            ScanForCharsUsing ( _method, pMessage, size, '\n', '\r', '=', &positions );
+        }
+        count += ( uint32 ) positions.size();
+    }
+    *_pNs = ( double ) start.elapsed() * 1000.0 / _iterations;
+    return count;
+}
+
+
+/***************************************************************************
+****																	****
+****	main															****
+****																	****
+****	Usage: xplscanbench [iterations]								****
+****	Returns non-zero if any scanning method gives different offsets	****
+****																	****
+***************************************************************************/
+
+int main
+(
+    int argc,
+    char* argv[]
+)
+{
+    uint32 const iterations = ( argc > 1 ) ? ( uint32 ) atoi ( argv[1] ) : 200000;
+
+    if ( !CheckMethods() )
+    {
+        return 1;
+    }
+
+    double ns;
+    TimeReadLine ( iterations, &ns );
+    printf ( "%-12s %8.1f ns/message\n", "readline", ns );
+
+    for ( uint32 i=0; i<c_numMethods; ++i )
+    {
+        if ( IsScanMethodAvailable ( c_methods[i] ) )
+        {
+            TimeScan ( c_methods[i], false, iterations, &ns );
+            printf ( "%-12s %8.1f ns/message\n", c_methodNames[i], ns );
+        }
+    }
+
+    TimeScan ( kScanScalar, true, iterations, &ns );
+    printf ( "%-12s %8.1f ns/message\n", "ScanForChars", ns );
+    return 0;
+}
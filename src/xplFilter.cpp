@@ -33,6 +33,7 @@
 
 #include "XplCore.h"
 #include "XplStringUtils.h"
+#include "XplScanner.h"
 #include "xplFilter.h"
 #include "XplMsg.h"
 
@@ -47,44 +48,29 @@ using namespace xpl;
 
 xplFilter::xplFilter ( string const& _filterStr )
 {
-    // Parse the string an break it into its elements
+    // Parse the string an break it into its elements.
+    // A single scan finds all the separators.
     m_filterElementMask = 0;
-    string remainder = _filterStr;
+    vector<uint32> dots;
+    ScanForChars ( _filterStr.data(), ( uint32 ) _filterStr.size(), '.', '.', '.', &dots );
 
-    StringSplit ( remainder, '.', &m_msgType, &remainder );
-    if ( m_msgType != string ( "*" ) )
-    {
-        m_filterElementMask |= FilterElement_MsgType;
-    }
-
-    StringSplit ( remainder, '.', &m_vendor, &remainder );
-    if ( m_vendor != string ( "*" ) )
-    {
-        m_filterElementMask |= FilterElement_Vendor;
-    }
+    string* elements[] = { &m_msgType, &m_vendor, &m_device, &m_instance, &m_class, &m_type };
+    uint32 const flags[] = { FilterElement_MsgType, FilterElement_Vendor, FilterElement_Device, FilterElement_Instance, FilterElement_Class, FilterElement_Type };
+    uint32 const numElements = sizeof ( flags ) / sizeof ( flags[0] );
 
-    StringSplit ( remainder, '.', &m_device, &remainder );
-    if ( m_device != string ( "*" ) )
+    XplStringView const filter ( _filterStr );
+    uint32 start = 0;
+    for ( uint32 i=0; i<numElements; ++i )
     {
-        m_filterElementMask |= FilterElement_Device;
-    }
+        // The last element takes whatever is left
+        uint32 end = ( ( i+1 < numElements ) && ( i < dots.size() ) ) ? dots[i] : filter.size();
+        *elements[i] = filter.substr ( start, end - start ).trim().toString();
+        start = end + 1;
 
-    StringSplit ( remainder, '.', &m_instance, &remainder );
-    if ( m_instance != string ( "*" ) )
-    {
-        m_filterElementMask |= FilterElement_Instance;
-    }
-
-    StringSplit ( remainder, '.', &m_class, &remainder );
-    if ( m_class != string ( "*" ) )
-    {
-        m_filterElementMask |= FilterElement_Class;
-    }
-
-    StringSplit ( remainder, '.', &m_type, &remainder );
-    if ( m_type != string ( "*" ) )
-    {
-        m_filterElementMask |= FilterElement_Type;
+        if ( *elements[i] != string ( "*" ) )
+        {
+            m_filterElementMask |= flags[i];
+        }
     }
 }
 
@@ -121,40 +107,229 @@ bool xplFilter::Allow ( XplMsg const& _msg ) const
     // Check the message source
     if ( m_filterElementMask & ( FilterElement_Vendor|FilterElement_Device|FilterElement_Instance ) )
     {
-        // Extract the vendor from the message source
-        string vendor;
-        string deviceInstance;
-        StringSplit ( _msg.GetSource().toString(), '-', &vendor, &deviceInstance );
+        XplAddress const& source = _msg.GetSource();
 
         // Check the message source vendor
         if ( ( m_filterElementMask & FilterElement_Vendor )
-                && ( vendor != m_vendor ) )
+                && ( source.GetVendor() != XplStringView ( m_vendor ) ) )
         {
             return false;
         }
 
-        if ( m_filterElementMask & ( FilterElement_Device|FilterElement_Instance ) )
+        // Check the message source device
+        if ( ( m_filterElementMask & FilterElement_Device )
+                && ( source.GetDevice() != XplStringView ( m_device ) ) )
         {
-            // Extract the device and instance from the message source
-            string device;
-            string instance;
-            StringSplit ( deviceInstance, '.', &device, &instance );
-
-            // Check the message source device
-            if ( ( m_filterElementMask & FilterElement_Device )
-                    && ( device != m_device ) )
-            {
-                return false;
-            }
-
-            if ( ( m_filterElementMask & FilterElement_Instance )
-                    && ( instance != m_instance ) )
-            {
-                return false;
-            }
+            return false;
+        }
+
+        // Check the message source instance
+        if ( ( m_filterElementMask & FilterElement_Instance )
+                && ( source.GetInstance() != XplStringView ( m_instance ) ) )
+        {
+            return false;
         }
     }
 
     return true;
 }
 
+
+/***************************************************************************
+****																	****
+****	xplFilterSet::xplFilterSet										****
+****																	****
+***************************************************************************/
+
+xplFilterSet::xplFilterSet
+(
+    vector<string> const& _filterStrs
+) :
+    m_numFilters ( ( uint32 ) _filterStrs.size() ),
+    m_numWords ( ( ( uint32 ) _filterStrs.size() + 31 ) >> 5 )
+{
+    for ( uint32 e=0; e<Element_Count; ++e )
+    {
+        m_elements[e].m_wildcards.resize ( m_numWords, 0 );
+    }
+
+    for ( uint32 i=0; i<m_numFilters; ++i )
+    {
+        xplFilter const filter ( _filterStrs[i] );
+        uint32 const mask = filter.m_filterElementMask;
+        AddElement ( Element_MsgType, filter.m_msgType, !( mask & xplFilter::FilterElement_MsgType ), i );
+        AddElement ( Element_Vendor, filter.m_vendor, !( mask & xplFilter::FilterElement_Vendor ), i );
+        AddElement ( Element_Device, filter.m_device, !( mask & xplFilter::FilterElement_Device ), i );
+        AddElement ( Element_Instance, filter.m_instance, !( mask & xplFilter::FilterElement_Instance ), i );
+        AddElement ( Element_Class, filter.m_class, !( mask & xplFilter::FilterElement_Class ), i );
+        AddElement ( Element_Type, filter.m_type, !( mask & xplFilter::FilterElement_Type ), i );
+    }
+}
+
+
+/***************************************************************************
+****																	****
+****	xplFilterSet::AddElement										****
+****																	****
+***************************************************************************/
+
+void xplFilterSet::AddElement
+(
+    uint32 const _element,
+    string const& _value,
+    bool const _bWildcard,
+    uint32 const _filter
+)
+{
+    Element& element = m_elements[_element];
+    uint32 const bit = 1u << ( _filter & 31 );
+    uint32 const word = _filter >> 5;
+
+    if ( _bWildcard )
+    {
+        element.m_wildcards[word] |= bit;
+        return;
+    }
+
+    // Values are looked up by their symbol ID, so matching a message
+    // needs no string compares.  A value that cannot be added to the
+    // symbol table cannot be in any message either.
+    uint32 const id = XplSymbolTable::Intern ( _value );
+    if ( XplSymbolTable::c_none == id )
+    {
+        return;
+    }
+
+    map<uint32, uint32>::iterator iter = element.m_values.find ( id );
+    if ( iter == element.m_values.end() )
+    {
+        // First filter to want this value.  Give it a row of its own.
+        iter = element.m_values.insert ( make_pair ( id, ( uint32 ) element.m_values.size() ) ).first;
+        element.m_rows.resize ( element.m_rows.size() + m_numWords, 0 );
+    }
+    element.m_rows[iter->second * m_numWords + word] |= bit;
+}
+
+
+/***************************************************************************
+****																	****
+****	xplFilterSet::Allow												****
+****																	****
+***************************************************************************/
+
+bool xplFilterSet::Allow
+(
+    XplMsg const& _msg
+) const
+{
+    if ( 0 == m_numFilters )
+    {
+        return true;
+    }
+
+    uint32 ids[Element_Count];
+    for ( uint32 e=0; e<Element_Count; ++e )
+    {
+        ids[e] = GetMsgElement ( _msg, e );
+    }
+    return Allow ( ids );
+}
+
+bool xplFilterSet::Allow
+(
+    uint32 const* _pIds
+) const
+{
+    if ( 0 == m_numFilters )
+    {
+        return true;
+    }
+
+    // Find the row of bits for each element of the message.
+    // A value that no filter mentions only passes the wildcards.
+    uint32 const* rows[Element_Count];
+    for ( uint32 e=0; e<Element_Count; ++e )
+    {
+        Element const& element = m_elements[e];
+        map<uint32, uint32>::const_iterator iter = element.m_values.find ( _pIds[e] );
+        rows[e] = ( iter == element.m_values.end() ) ? NULL : &element.m_rows[iter->second * m_numWords];
+    }
+
+    for ( uint32 w=0; w<m_numWords; ++w )
+    {
+        uint32 bits = 0xffffffff;
+        for ( uint32 e=0; ( e<Element_Count ) && bits; ++e )
+        {
+            bits &= ( m_elements[e].m_wildcards[w] | ( rows[e] ? rows[e][w] : 0 ) );
+        }
+        if ( bits )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/***************************************************************************
+****																	****
+****	xplFilterSet::GetValues											****
+****																	****
+***************************************************************************/
+
+bool xplFilterSet::GetValues
+(
+    uint32 const _element,
+    vector<string>* _pValues
+) const
+{
+    if ( 0 == m_numFilters )
+    {
+        return false;
+    }
+
+    Element const& element = m_elements[_element];
+    for ( uint32 w=0; w<m_numWords; ++w )
+    {
+        if ( element.m_wildcards[w] )
+        {
+            return false;
+        }
+    }
+
+    for ( map<uint32, uint32>::const_iterator iter = element.m_values.begin(); iter != element.m_values.end(); ++iter )
+    {
+        _pValues->push_back ( XplSymbolTable::GetString ( iter->first ) );
+    }
+    return true;
+}
+
+
+/***************************************************************************
+****																	****
+****	xplFilterSet::GetMsgElement										****
+****																	****
+***************************************************************************/
+
+uint32 xplFilterSet::GetMsgElement
+(
+    XplMsg const& _msg,
+    uint32 const _element
+)
+{
+    switch ( _element )
+    {
+    case Element_MsgType:
+        return XplSymbolTable::Find ( _msg.GetType() );
+    case Element_Vendor:
+        return XplSymbolTable::Find ( _msg.GetSource().GetVendor() );
+    case Element_Device:
+        return XplSymbolTable::Find ( _msg.GetSource().GetDevice() );
+    case Element_Instance:
+        return XplSymbolTable::Find ( _msg.GetSource().GetInstance() );
+    case Element_Class:
+        return _msg.GetSchemaClassId();
+    default:
+        return _msg.GetSchemaTypeId();
+    }
+}
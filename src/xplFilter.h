@@ -37,7 +37,10 @@
 #define _XPLFILTER_H
 
 #include <string>
+#include <vector>
+#include <map>
 #include "XplCore.h"
+#include "Poco/RefCountedObject.h"
 
 namespace xpl
 {
@@ -62,9 +65,7 @@ class XplMsg;
  */
 class xplFilter
 {
-private:
-    friend class XplDevice;
-
+public:
     /**
      * Constructor.
      * @param _filterStr A string in the form
@@ -87,6 +88,9 @@ private:
      */
     bool Allow ( XplMsg const& _msg ) const;
 
+private:
+    friend class xplFilterSet;
+
     enum
     {
         FilterElement_MsgType	= 0x00000001,
@@ -107,6 +111,105 @@ private:
 
 }; // class xplFilter
 
+
+/**
+ * All of a device's filters, compiled into a single matcher.
+ * Rather than testing the filters one by one, the set keeps, for each of
+ * the six elements, a bit per filter saying whether the filter has a '*'
+ * there, and for every value that appears in the filters, a bit per filter
+ * saying whether the filter wants that value.  Checking a message takes
+ * one map lookup per element, with the element taken straight from the
+ * message, and then an AND of the bits a word at a time.  Any bit left
+ * set belongs to a filter that passes the message.
+ * <p>
+ * The set cannot be changed once built.  XplDevice builds a new one when
+ * its configuration changes and swaps it in, so a message is always checked
+ * against either the old filters or the new ones.
+ */
+class xplFilterSet: public Poco::RefCountedObject
+{
+public:
+    /**
+     * Constructor.
+     * @param _filterStrs the filters, each in the form
+     * [msgtype].[vendor].[device].[instance].[class].[type]
+     */
+    xplFilterSet ( vector<string> const& _filterStrs );
+
+    /**
+     * Filters a message.
+     * @param _msg the message to be tested.
+     * @return True if there are no filters, or if at least one
+     * of them passes the message.
+     */
+    bool Allow ( XplMsg const& _msg ) const;
+
+private:
+    friend class XplDevice;
+    friend class XplPrefilter;
+
+    /**
+     * Destructor.
+     */
+    ~xplFilterSet() {}
+
+    /**
+     * Filters a message that has been read only as far as the schema.
+     * @param _pIds the XplSymbolTable ID of each element of the message,
+     * in the order of the Element_ constants.
+     * @return True if there are no filters, or if at least one
+     * of them passes the message.
+     */
+    bool Allow ( uint32 const* _pIds ) const;
+
+    /**
+     * Gets every value that the filters want for one element.
+     * @param _element one of the Element_ constants.
+     * @param _pValues the values are added to the end of this.
+     * @return False, and nothing is added, if there are no filters or
+     * any of them has a '*' for this element.
+     */
+    bool GetValues ( uint32 const _element, vector<string>* _pValues ) const;
+
+    uint32 GetNumFilters() const
+    {
+        return m_numFilters;
+    }
+
+    enum
+    {
+        Element_MsgType = 0,
+        Element_Vendor,
+        Element_Device,
+        Element_Instance,
+        Element_Class,
+        Element_Type,
+        Element_Count
+    };
+
+    struct Element
+    {
+        map<uint32, uint32>	m_values;		// XplSymbolTable ID of each value in the filters, and its row in m_rows
+        vector<uint32>		m_rows;			// For each value, m_numWords words with a bit per filter that wants it
+        vector<uint32>		m_wildcards;	// m_numWords words with a bit per filter that has '*'
+    };
+
+    /**
+     * Records one element of a filter.
+     */
+    void AddElement ( uint32 const _element, string const& _value, bool const _bWildcard, uint32 const _filter );
+
+    /**
+     * Gets the XplSymbolTable ID of one of the elements of a message.
+     */
+    static uint32 GetMsgElement ( XplMsg const& _msg, uint32 const _element );
+
+    Element	m_elements[Element_Count];
+    uint32	m_numFilters;
+    uint32	m_numWords;			// Words in each bit row
+
+}; // class xplFilterSet
+
 } // namespace xpl
 
 #endif //_XPLFILTER_H